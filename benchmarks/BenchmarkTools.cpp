@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+
+#if defined(WIN32) || defined(_WIN32)
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+    #include <psapi.h>
+#else
+    #include <sys/resource.h>
+    #include <unistd.h>
+#endif
+#ifdef __APPLE__
+    #include <mach/mach.h>
+#endif
+
+#include "Mp4Parse.h"
+#include "BenchmarkTools.h"
+
+namespace fs = std::filesystem;
+
+double nowMs()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t getCurrentRssKb()
+{
+#if defined(WIN32) || defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.WorkingSetSize / 1024;
+    return 0;
+#elif defined(__APPLE__)
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t      count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) == KERN_SUCCESS)
+        return info.resident_size / 1024;
+    return 0;
+#elif defined(__linux)
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (nullptr == fp)
+        return 0;
+    unsigned long long pages = 0, residentPages = 0;
+    int                res   = fscanf(fp, "%llu %llu", &pages, &residentPages);
+    fclose(fp);
+    return 2 == res ? residentPages * (uint64_t)sysconf(_SC_PAGESIZE) / 1024 : 0;
+#else
+    return 0;
+#endif
+}
+
+uint64_t getPeakRssKb()
+{
+#if defined(WIN32) || defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.PeakWorkingSetSize / 1024;
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    #ifdef __APPLE__
+    return usage.ru_maxrss / 1024; // bytes on macOS
+    #else
+    return usage.ru_maxrss;
+    #endif
+#endif
+}
+
+void keepErrorLogsOnly()
+{
+    setMp4ParseLogLevel(MP4_LOG_LEVEL_ERR);
+}
+
+BenchArgs::BenchArgs(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0)
+        {
+            fprintf(stderr, "ignore argument %s\n", arg.c_str());
+            continue;
+        }
+        arg     = arg.substr(2);
+        auto eq = arg.find('=');
+        if (eq != std::string::npos)
+            mArgs[arg.substr(0, eq)] = arg.substr(eq + 1);
+        else if (i + 1 < argc && std::string(argv[i + 1]).compare(0, 2, "--") != 0)
+            mArgs[arg] = argv[++i];
+        else
+            mArgs[arg] = "1";
+    }
+}
+
+uint64_t BenchArgs::getUint(const std::string &name, uint64_t defaultVal) const
+{
+    auto it = mArgs.find(name);
+    return it == mArgs.end() ? defaultVal : strtoull(it->second.c_str(), nullptr, 0);
+}
+
+std::string BenchArgs::getString(const std::string &name, const std::string &defaultVal) const
+{
+    auto it = mArgs.find(name);
+    return it == mArgs.end() ? defaultVal : it->second;
+}
+
+BenchStats summarize(std::vector<double> values)
+{
+    BenchStats stats;
+    if (values.empty())
+        return stats;
+    std::sort(values.begin(), values.end());
+    stats.min    = values.front();
+    stats.median = values[values.size() / 2];
+    stats.max    = values.back();
+    return stats;
+}
+
+std::string benchFilePath(const std::string &dir, const std::string &name)
+{
+    std::error_code errCode;
+    fs::path        path = dir.empty() ? fs::temp_directory_path(errCode) : fs::path(dir);
+    fs::create_directories(path, errCode);
+    return (path / name).string();
+}
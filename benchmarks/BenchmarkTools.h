@@ -0,0 +1,41 @@
+#ifndef _BENCHMARK_TOOLS_H_
+#define _BENCHMARK_TOOLS_H_
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+double   nowMs();           // steady clock
+uint64_t getCurrentRssKb(); // 0 where it isn't supported
+uint64_t getPeakRssKb();    // whole process so far, 0 where it isn't supported
+
+// the library logs everything by default, keep errors only so the tables stay readable and no logging is timed
+void keepErrorLogsOnly();
+
+// "--name value", "--name=value" or "--name" (value "1")
+class BenchArgs
+{
+public:
+    BenchArgs(int argc, char *argv[]);
+
+    bool        has(const std::string &name) const { return mArgs.count(name) > 0; }
+    uint64_t    getUint(const std::string &name, uint64_t defaultVal) const;
+    std::string getString(const std::string &name, const std::string &defaultVal) const;
+
+private:
+    std::map<std::string, std::string> mArgs;
+};
+
+struct BenchStats
+{
+    double min    = 0;
+    double median = 0;
+    double max    = 0;
+};
+BenchStats summarize(std::vector<double> values);
+
+// dir/name, dir is created if needed; an empty dir is the system temporary directory
+std::string benchFilePath(const std::string &dir, const std::string &name);
+
+#endif
@@ -0,0 +1,271 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <filesystem>
+
+#include "Mp4Parse.h"
+#include "Mp4Generator.h"
+#include "BenchmarkTools.h"
+
+using std::string;
+namespace fs = std::filesystem;
+
+static void printUsage(const char *name)
+{
+    printf("usage: %s [options]\n"
+           "  --samples N      video samples per video track (default 20000), audio tracks get 1.5 times as many\n"
+           "  --video N        video tracks (default 1)\n"
+           "  --audio N        audio tracks (default 1)\n"
+           "  --fragmented     fetch from a fragmented file instead of one with the moov first\n"
+           "  --mmap           parse with MP4_READ_MODE_MMAP\n"
+           "  --max-threads N  thread counts 2, 4 ... up to N are run (default the core count, at most 16)\n"
+           "  --dir PATH       where the file is generated (default the temporary directory)\n"
+           "  --keep           keep the generated file\n"
+           "every case reads each sample of the selected tracks once; \"shared\" runs all threads on one parser,\n"
+           "\"own\" gives each thread its parser, the gap between them is the cost of sharing the parser\n",
+           name);
+}
+
+enum FetchApi
+{
+    FETCH_RAW,   // getSample, all tracks
+    FETCH_VIDEO, // getVideoSample, AVCC to Annex-B with SPS/PPS before key frames
+    FETCH_AUDIO, // getAudioSample, ADTS header added
+};
+
+static const char *fetchApiName(FetchApi api)
+{
+    switch (api)
+    {
+        case FETCH_RAW:
+            return "getSample";
+        case FETCH_VIDEO:
+            return "getVideoSample";
+        case FETCH_AUDIO:
+            return "getAudioSample";
+    }
+    return "";
+}
+
+struct SampleRef
+{
+    uint32_t trackIdx;
+    uint32_t sampleIdx;
+};
+
+struct FetchResult
+{
+    double   sec     = 0;
+    uint64_t bytes   = 0;
+    uint64_t samples = 0;
+    bool     ok      = true;
+};
+
+// data size of the sample, negative on failure; buf grows when a sample doesn't fit
+static int64_t fetchOne(Mp4Parser *parser, FetchApi api, const SampleRef &ref, std::vector<uint8_t> &buf)
+{
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        int      ret      = 0;
+        uint64_t dataSize = 0;
+        if (FETCH_VIDEO == api)
+        {
+            Mp4VideoFrame frame;
+            ret      = parser->getVideoSample(ref.trackIdx, ref.sampleIdx, frame, buf.data(), buf.size());
+            dataSize = frame.dataSize;
+        }
+        else if (FETCH_AUDIO == api)
+        {
+            Mp4AudioFrame frame;
+            ret      = parser->getAudioSample(ref.trackIdx, ref.sampleIdx, frame, buf.data(), buf.size());
+            dataSize = frame.dataSize;
+        }
+        else
+        {
+            Mp4RawSample sample;
+            ret      = parser->getSample(ref.trackIdx, ref.sampleIdx, sample, buf.data(), buf.size());
+            dataSize = sample.dataSize;
+        }
+
+        if (MP4_BUFFER_TOO_SMALL == ret && dataSize > buf.size())
+        {
+            buf.resize(dataSize);
+            continue;
+        }
+        return ret < 0 ? -1 : (int64_t)dataSize;
+    }
+    return -1;
+}
+
+// thread t fetches refs[t], refs[t + threadCount] ... through parsers[t % parsers.size()]
+static FetchResult runFetch(const std::vector<Mp4ParserHandle> &parsers, FetchApi api,
+                            const std::vector<SampleRef> &refs, uint32_t threadCount)
+{
+    std::vector<FetchResult> results(threadCount);
+    std::atomic<uint32_t>    ready(0);
+    std::atomic<bool>        go(false);
+
+    auto worker = [&](uint32_t t) {
+        std::vector<uint8_t> buf(1024 * 1024);
+        Mp4Parser           *parser = parsers[t % parsers.size()].get();
+        FetchResult         &result = results[t];
+        ready++;
+        while (!go)
+            std::this_thread::yield();
+        for (size_t i = t; i < refs.size(); i += threadCount)
+        {
+            int64_t size = fetchOne(parser, api, refs[i], buf);
+            if (size < 0)
+            {
+                printf("%s track %u sample %u fail\n", fetchApiName(api), refs[i].trackIdx, refs[i].sampleIdx);
+                result.ok = false;
+                return;
+            }
+            result.bytes += size;
+            result.samples++;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < threadCount; t++)
+        threads.emplace_back(worker, t);
+    while (ready < threadCount)
+        std::this_thread::yield();
+
+    double start = nowMs();
+    go           = true;
+    for (auto &thread : threads)
+        thread.join();
+
+    FetchResult total;
+    total.sec = (nowMs() - start) / 1000;
+    for (auto &result : results)
+    {
+        total.bytes += result.bytes;
+        total.samples += result.samples;
+        total.ok = total.ok && result.ok;
+    }
+    return total;
+}
+
+static Mp4ParserHandle openParser(const string &path, const Mp4ParseOptions &options)
+{
+    auto parser = createMp4Parser();
+    if (parser->parse(path, options) < 0 || !parser->isParseSuccess())
+    {
+        printf("parse %s fail: %s\n", path.c_str(), parser->getErrorMessage().c_str());
+        return nullptr;
+    }
+    return parser;
+}
+
+int main(int argc, char *argv[])
+{
+    BenchArgs args(argc, argv);
+    if (args.has("help"))
+    {
+        printUsage(argv[0]);
+        return 0;
+    }
+    keepErrorLogsOnly();
+
+    Mp4GenOptions genOptions;
+    genOptions.videoSamples = (uint32_t)args.getUint("samples", 20000);
+    genOptions.videoTracks  = (uint32_t)args.getUint("video", 1);
+    genOptions.audioTracks  = (uint32_t)args.getUint("audio", 1);
+    genOptions.fragmented   = args.has("fragmented");
+
+    Mp4ParseOptions parseOptions;
+    if (args.has("mmap"))
+        parseOptions.readMode = MP4_READ_MODE_MMAP;
+
+    uint32_t maxThreads = (uint32_t)args.getUint("max-threads", MIN(MAX(std::thread::hardware_concurrency(), 1u), 16u));
+
+    string path = benchFilePath(args.getString("dir", ""), "mp4bench_fetch.mp4");
+    if (generateMp4File(path, genOptions) < 0)
+    {
+        printf("generate %s fail\n", path.c_str());
+        return 1;
+    }
+
+    std::vector<Mp4ParserHandle> parsers;
+    for (uint32_t i = 0; i < maxThreads; i++)
+    {
+        parsers.push_back(openParser(path, parseOptions));
+        if (nullptr == parsers.back())
+            return 1;
+    }
+    std::vector<Mp4ParserHandle> shared = {parsers[0]};
+
+    printf("%-15s %-11s %7s %11s %12s %10s\n", "api", "pattern", "threads", "MB/s", "samples/s", "scaling");
+    for (FetchApi api : {FETCH_RAW, FETCH_VIDEO, FETCH_AUDIO})
+    {
+        std::vector<SampleRef> sequential;
+        auto                  &tracks = parsers[0]->getTracksInfo();
+        for (uint32_t trackIdx = 0; trackIdx < tracks.size(); trackIdx++)
+        {
+            if ((FETCH_VIDEO == api && tracks[trackIdx]->trackType != TRACK_TYPE_VIDEO) ||
+                (FETCH_AUDIO == api && tracks[trackIdx]->trackType != TRACK_TYPE_AUDIO))
+                continue;
+            for (uint64_t sampleIdx = 0; sampleIdx < tracks[trackIdx]->mediaInfo->sampleCount; sampleIdx++)
+                sequential.push_back({trackIdx, (uint32_t)sampleIdx});
+        }
+        if (sequential.empty())
+            continue;
+        std::vector<SampleRef> random = sequential;
+        std::shuffle(random.begin(), random.end(), std::mt19937(1234));
+
+        // scaling is the samples/s against threads times the single thread random rate of the same api
+        double singleRate = 0;
+        auto   report     = [&](const char *pattern, uint32_t threadCount, const FetchResult &result) {
+            double rate = result.sec > 0 ? result.samples / result.sec : 0;
+            double mbps = result.sec > 0 ? result.bytes / 1024.0 / 1024.0 / result.sec : 0;
+            printf("%-15s %-11s %7u %11.1f %12.0f", fetchApiName(api), pattern, threadCount, mbps, rate);
+            if (singleRate > 0 && threadCount > 1)
+                printf(" %9.0f%%\n", rate * 100 / (singleRate * threadCount));
+            else
+                printf(" %10s\n", "-");
+            return rate;
+        };
+
+        FetchResult result = runFetch(shared, api, sequential, 1);
+        if (!result.ok)
+            return 1;
+        report("sequential", 1, result);
+
+        result = runFetch(shared, api, random, 1);
+        if (!result.ok)
+            return 1;
+        singleRate = report("random", 1, result);
+
+        for (uint32_t threadCount = 2; threadCount <= maxThreads; threadCount *= 2)
+        {
+            result = runFetch(shared, api, random, threadCount);
+            if (!result.ok)
+                return 1;
+            report("shared", threadCount, result);
+
+            result = runFetch(parsers, api, random, threadCount);
+            if (!result.ok)
+                return 1;
+            report("own", threadCount, result);
+        }
+    }
+
+    parsers.clear();
+    shared.clear();
+    if (!args.has("keep"))
+    {
+        std::error_code errCode;
+        fs::remove(path, errCode);
+    }
+    return 0;
+}
@@ -0,0 +1,667 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "Mp4Generator.h"
+
+namespace
+{
+
+struct Random
+{
+    uint64_t state;
+
+    explicit Random(uint64_t seed) : state(seed * 0x9e3779b97f4a7c15ull + 1) {}
+
+    uint64_t next()
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    // in [min, max]
+    uint32_t range(uint32_t min, uint32_t max) { return min + (uint32_t)(next() % ((uint64_t)max - min + 1)); }
+};
+
+// big endian writer, begin() starts a box whose size end() fills in
+class BoxWriter
+{
+public:
+    std::vector<uint8_t> data;
+
+    void u8(uint8_t val) { data.push_back(val); }
+    void u16(uint16_t val)
+    {
+        u8(val >> 8);
+        u8(val & 0xff);
+    }
+    void u32(uint32_t val)
+    {
+        u16(val >> 16);
+        u16(val & 0xffff);
+    }
+    void u64(uint64_t val)
+    {
+        u32(val >> 32);
+        u32(val & 0xffffffff);
+    }
+    void bytes(const void *buf, size_t len) { data.insert(data.end(), (const uint8_t *)buf, (const uint8_t *)buf + len); }
+    void zeros(size_t len) { data.insert(data.end(), len, 0); }
+
+    void setU32(size_t pos, uint32_t val)
+    {
+        for (int i = 0; i < 4; i++)
+            data[pos + i] = (uint8_t)(val >> (24 - i * 8));
+    }
+
+    size_t begin(const char *type)
+    {
+        size_t start = data.size();
+        u32(0);
+        bytes(type, 4);
+        return start;
+    }
+    size_t beginFull(const char *type, uint8_t version, uint32_t flags)
+    {
+        size_t start = begin(type);
+        u32((uint32_t)version << 24 | flags);
+        return start;
+    }
+    void end(size_t start) { setU32(start, (uint32_t)(data.size() - start)); }
+
+    void matrix()
+    {
+        const uint32_t unity[9] = {0x10000, 0, 0, 0, 0x10000, 0, 0, 0, 0x40000000};
+        for (auto val : unity)
+            u32(val);
+    }
+};
+
+struct GenTrack
+{
+    bool     isVideo   = true;
+    uint32_t trackId   = 0;
+    uint32_t timescale = 0;
+    uint32_t delta     = 0;
+
+    std::vector<uint32_t> sizes;
+
+    // non fragmented: chunk c holds samples chunkFirst[c] ... chunkFirst[c] + chunkSamples[c] - 1
+    std::vector<uint32_t> chunkFirst;
+    std::vector<uint32_t> chunkSamples;
+    std::vector<uint64_t> chunkOffsets;
+
+    bool     isKey(uint32_t idx, uint32_t gop) const { return !isVideo || 0 == idx % gop; }
+    int32_t  ctsOffset(uint32_t idx) const { return isVideo ? (int32_t)(idx % 3) * (int32_t)delta : 0; }
+    uint64_t durationMs() const { return (uint64_t)sizes.size() * delta * 1000 / timescale; }
+};
+
+const uint8_t kSps[] = {0x67, 0x42, 0xc0, 0x1e, 0xda, 0x02, 0x80, 0xbf, 0xe5, 0x84, 0x00};
+const uint8_t kPps[] = {0x68, 0xce, 0x3c, 0x80};
+
+const uint32_t kWidth  = 640;
+const uint32_t kHeight = 480;
+
+std::vector<GenTrack> makeTracks(const Mp4GenOptions &options)
+{
+    std::vector<GenTrack> tracks;
+    Random                rnd(options.seed);
+    uint32_t              videoSize = std::max(options.videoSampleSize, 16u);
+    uint32_t              audioSize = std::max(options.audioSampleSize, 2u);
+
+    for (uint32_t i = 0; i < options.videoTracks + options.audioTracks; i++)
+    {
+        GenTrack track;
+        track.isVideo   = i < options.videoTracks;
+        track.trackId   = i + 1;
+        track.timescale = track.isVideo ? 90000 : 48000;
+        track.delta     = track.isVideo ? 3000 : 1024;
+
+        uint32_t count = track.isVideo ? options.videoSamples : options.videoSamples * 3 / 2;
+        uint32_t avg   = track.isVideo ? videoSize : audioSize;
+        track.sizes.resize(count);
+        for (auto &size : track.sizes)
+            size = rnd.range(avg / 2, avg * 3 / 2);
+        tracks.push_back(std::move(track));
+    }
+    return tracks;
+}
+
+// sample payload: one length prefixed NAL for video, raw bytes for audio
+void fillSample(const GenTrack &track, uint32_t idx, uint32_t gop, std::vector<uint8_t> &buf)
+{
+    uint32_t size = track.sizes[idx];
+    buf.resize(size);
+    Random rnd((uint64_t)track.trackId << 32 | idx);
+    for (uint32_t pos = 0; pos < size; pos += 8)
+    {
+        uint64_t val = rnd.next();
+        memcpy(&buf[pos], &val, std::min(8u, size - pos));
+    }
+    if (!track.isVideo)
+        return;
+
+    uint32_t naluSize = size - 4;
+    buf[0]            = (uint8_t)(naluSize >> 24);
+    buf[1]            = (uint8_t)(naluSize >> 16);
+    buf[2]            = (uint8_t)(naluSize >> 8);
+    buf[3]            = (uint8_t)naluSize;
+    // IDR slice with first_mb 0 and slice_type I, or non-IDR with slice_type P
+    bool key          = track.isKey(idx, gop);
+    buf[4]            = key ? 0x65 : 0x61;
+    buf[5]            = key ? 0x88 : 0x98;
+    buf[6]            = key ? 0x80 : 0x00;
+}
+
+void writeAvc1(BoxWriter &w)
+{
+    size_t avc1 = w.begin("avc1");
+    w.zeros(6);
+    w.u16(1); // data reference index
+    w.zeros(16);
+    w.u16(kWidth);
+    w.u16(kHeight);
+    w.u32(0x480000);
+    w.u32(0x480000);
+    w.zeros(4);
+    w.u16(1); // frame count
+    char compressor[32] = {4, 'b', 'e', 'n', 'c'};
+    w.bytes(compressor, sizeof(compressor));
+    w.u16(24);
+    w.u16(0xffff);
+
+    size_t avcC = w.begin("avcC");
+    w.u8(1);
+    w.u8(kSps[1]);
+    w.u8(kSps[2]);
+    w.u8(kSps[3]);
+    w.u8(0xff); // 4 bytes NALU length
+    w.u8(0xe1);
+    w.u16(sizeof(kSps));
+    w.bytes(kSps, sizeof(kSps));
+    w.u8(1);
+    w.u16(sizeof(kPps));
+    w.bytes(kPps, sizeof(kPps));
+    w.end(avcC);
+    w.end(avc1);
+}
+
+void writeDescriptor(BoxWriter &w, uint8_t tag, const std::vector<uint8_t> &payload)
+{
+    w.u8(tag);
+    w.u8((uint8_t)payload.size());
+    w.bytes(payload.data(), payload.size());
+}
+
+void writeMp4a(BoxWriter &w)
+{
+    size_t mp4a = w.begin("mp4a");
+    w.zeros(6);
+    w.u16(1); // data reference index
+    w.zeros(8);
+    w.u16(2);  // channels
+    w.u16(16); // sample size
+    w.zeros(4);
+    w.u32(48000u << 16);
+
+    // AAC LC, 48 kHz, 2 channels
+    BoxWriter dsi;
+    writeDescriptor(dsi, 5, {0x11, 0x90});
+    BoxWriter dcd;
+    dcd.u8(0x40); // MPEG-4 audio
+    dcd.u8(0x15); // audio stream
+    dcd.zeros(3);
+    dcd.u32(128000);
+    dcd.u32(128000);
+    dcd.bytes(dsi.data.data(), dsi.data.size());
+    BoxWriter es;
+    es.u16(1);
+    es.u8(0);
+    writeDescriptor(es, 4, dcd.data);
+    writeDescriptor(es, 6, {2});
+
+    size_t esds = w.beginFull("esds", 0, 0);
+    writeDescriptor(w, 3, es.data);
+    w.end(esds);
+    w.end(mp4a);
+}
+
+void writeSampleTables(BoxWriter &w, const GenTrack &track, const Mp4GenOptions &options, bool co64)
+{
+    uint32_t count = (uint32_t)track.sizes.size();
+
+    size_t stts = w.beginFull("stts", 0, 0);
+    w.u32(1);
+    w.u32(count);
+    w.u32(track.delta);
+    w.end(stts);
+
+    if (track.isVideo)
+    {
+        size_t ctts = w.beginFull("ctts", 0, 0);
+        w.u32(count);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            w.u32(1);
+            w.u32(track.ctsOffset(i));
+        }
+        w.end(ctts);
+
+        size_t stss = w.beginFull("stss", 0, 0);
+        w.u32((count + options.gop - 1) / options.gop);
+        for (uint32_t i = 0; i < count; i += options.gop)
+            w.u32(i + 1);
+        w.end(stss);
+    }
+
+    size_t   stsc        = w.beginFull("stsc", 0, 0);
+    size_t   countPos    = w.data.size();
+    uint32_t stscCount   = 0;
+    uint32_t lastSamples = 0;
+    w.u32(0);
+    for (size_t c = 0; c < track.chunkSamples.size(); c++)
+    {
+        if (0 == stscCount || track.chunkSamples[c] != lastSamples)
+        {
+            w.u32((uint32_t)c + 1);
+            w.u32(track.chunkSamples[c]);
+            w.u32(1);
+            lastSamples = track.chunkSamples[c];
+            stscCount++;
+        }
+    }
+    w.setU32(countPos, stscCount);
+    w.end(stsc);
+
+    size_t stsz = w.beginFull("stsz", 0, 0);
+    w.u32(0);
+    w.u32(count);
+    for (auto size : track.sizes)
+        w.u32(size);
+    w.end(stsz);
+
+    size_t stco = w.beginFull(co64 ? "co64" : "stco", 0, 0);
+    w.u32((uint32_t)track.chunkOffsets.size());
+    for (auto offset : track.chunkOffsets)
+    {
+        if (co64)
+            w.u64(offset);
+        else
+            w.u32((uint32_t)offset);
+    }
+    w.end(stco);
+}
+
+// empty sample tables when tables is false, as in the moov of a fragmented file
+void writeTrak(BoxWriter &w, const GenTrack &track, const Mp4GenOptions &options, bool tables, bool co64,
+               uint64_t movieDurationMs)
+{
+    uint32_t mediaDuration = tables ? (uint32_t)(track.sizes.size() * track.delta) : 0;
+
+    size_t trak = w.begin("trak");
+
+    size_t tkhd = w.beginFull("tkhd", 0, 3);
+    w.zeros(8);
+    w.u32(track.trackId);
+    w.zeros(4);
+    w.u32((uint32_t)movieDurationMs);
+    w.zeros(8);
+    w.u16(0);
+    w.u16(0);
+    w.u16(track.isVideo ? 0 : 0x100);
+    w.u16(0);
+    w.matrix();
+    w.u32(track.isVideo ? kWidth << 16 : 0);
+    w.u32(track.isVideo ? kHeight << 16 : 0);
+    w.end(tkhd);
+
+    size_t mdia = w.begin("mdia");
+    size_t mdhd = w.beginFull("mdhd", 0, 0);
+    w.zeros(8);
+    w.u32(track.timescale);
+    w.u32(mediaDuration);
+    w.u16(0x55c4); // und
+    w.u16(0);
+    w.end(mdhd);
+
+    size_t hdlr = w.beginFull("hdlr", 0, 0);
+    w.zeros(4);
+    w.bytes(track.isVideo ? "vide" : "soun", 4);
+    w.zeros(12);
+    w.bytes(track.isVideo ? "VideoHandler" : "SoundHandler", 13);
+    w.end(hdlr);
+
+    size_t minf = w.begin("minf");
+    if (track.isVideo)
+    {
+        size_t vmhd = w.beginFull("vmhd", 0, 1);
+        w.zeros(8);
+        w.end(vmhd);
+    }
+    else
+    {
+        size_t smhd = w.beginFull("smhd", 0, 0);
+        w.zeros(4);
+        w.end(smhd);
+    }
+    size_t dinf = w.begin("dinf");
+    size_t dref = w.beginFull("dref", 0, 0);
+    w.u32(1);
+    w.end(w.beginFull("url ", 0, 1));
+    w.end(dref);
+    w.end(dinf);
+
+    size_t stbl = w.begin("stbl");
+    size_t stsd = w.beginFull("stsd", 0, 0);
+    w.u32(1);
+    if (track.isVideo)
+        writeAvc1(w);
+    else
+        writeMp4a(w);
+    w.end(stsd);
+    if (tables)
+    {
+        writeSampleTables(w, track, options, co64);
+    }
+    else
+    {
+        size_t stts = w.beginFull("stts", 0, 0);
+        w.u32(0);
+        w.end(stts);
+        size_t stsc = w.beginFull("stsc", 0, 0);
+        w.u32(0);
+        w.end(stsc);
+        size_t stsz = w.beginFull("stsz", 0, 0);
+        w.u64(0);
+        w.end(stsz);
+        size_t stco = w.beginFull("stco", 0, 0);
+        w.u32(0);
+        w.end(stco);
+    }
+    w.end(stbl);
+    w.end(minf);
+    w.end(mdia);
+    w.end(trak);
+}
+
+void writeMoov(BoxWriter &w, const std::vector<GenTrack> &tracks, const Mp4GenOptions &options, bool tables,
+               bool co64)
+{
+    uint64_t movieDurationMs = 0;
+    if (tables)
+    {
+        for (auto &track : tracks)
+            movieDurationMs = std::max(movieDurationMs, track.durationMs());
+    }
+
+    size_t moov = w.begin("moov");
+    size_t mvhd = w.beginFull("mvhd", 0, 0);
+    w.zeros(8);
+    w.u32(1000);
+    w.u32((uint32_t)movieDurationMs);
+    w.u32(0x10000);
+    w.u16(0x100);
+    w.zeros(10);
+    w.matrix();
+    w.zeros(24);
+    w.u32((uint32_t)tracks.size() + 1);
+    w.end(mvhd);
+
+    for (auto &track : tracks)
+        writeTrak(w, track, options, tables, co64, movieDurationMs);
+
+    if (!tables)
+    {
+        size_t mvex = w.begin("mvex");
+        for (auto &track : tracks)
+        {
+            size_t trex = w.beginFull("trex", 0, 0);
+            w.u32(track.trackId);
+            w.u32(1);
+            w.u32(track.delta);
+            w.u32(0);
+            w.u32(0x10000);
+            w.end(trex);
+        }
+        w.end(mvex);
+    }
+    w.end(moov);
+}
+
+void writeFtyp(BoxWriter &w, bool fragmented)
+{
+    size_t ftyp = w.begin("ftyp");
+    w.bytes(fragmented ? "iso5" : "isom", 4);
+    w.u32(512);
+    w.bytes(fragmented ? "iso5iso6mp41" : "isomiso2avc1mp41", fragmented ? 12 : 16);
+    w.end(ftyp);
+}
+
+bool writeBuf(FILE *fp, const void *buf, size_t len)
+{
+    return fwrite(buf, 1, len, fp) == len;
+}
+
+struct ChunkRef
+{
+    uint32_t trackIdx;
+    uint32_t chunkIdx;
+};
+
+int writeIsoFile(FILE *fp, std::vector<GenTrack> &tracks, const Mp4GenOptions &options)
+{
+    uint32_t perChunk = std::max(options.samplesPerChunk, 1u);
+
+    // chunks of every track, interleaved one chunk per track in turn
+    std::vector<ChunkRef> order;
+    uint64_t              mdatPayload = 0;
+    for (uint32_t t = 0; t < tracks.size(); t++)
+    {
+        auto &track = tracks[t];
+        for (uint32_t first = 0; first < track.sizes.size(); first += perChunk)
+        {
+            track.chunkFirst.push_back(first);
+            track.chunkSamples.push_back(std::min(perChunk, (uint32_t)track.sizes.size() - first));
+        }
+        for (auto size : track.sizes)
+            mdatPayload += size;
+    }
+    for (uint32_t c = 0;; c++)
+    {
+        size_t before = order.size();
+        for (uint32_t t = 0; t < tracks.size(); t++)
+        {
+            if (c < tracks[t].chunkFirst.size())
+                order.push_back({t, c});
+        }
+        if (order.size() == before)
+            break;
+    }
+
+    BoxWriter head;
+    writeFtyp(head, false);
+
+    uint32_t mdatHeader = mdatPayload + 8 > UINT32_MAX ? 16 : 8;
+    bool     co64       = options.largeOffsets || head.data.size() + mdatPayload + mdatHeader > UINT32_MAX;
+
+    auto setOffsets = [&](uint64_t base) {
+        for (auto &track : tracks)
+            track.chunkOffsets.assign(track.chunkFirst.size(), 0);
+        uint64_t pos = base;
+        for (auto &ref : order)
+        {
+            auto &track                      = tracks[ref.trackIdx];
+            track.chunkOffsets[ref.chunkIdx] = pos;
+            for (uint32_t i = 0; i < track.chunkSamples[ref.chunkIdx]; i++)
+                pos += track.sizes[track.chunkFirst[ref.chunkIdx] + i];
+        }
+    };
+
+    BoxWriter moov;
+    if (options.moovAtEnd)
+    {
+        setOffsets(head.data.size() + mdatHeader);
+        writeMoov(moov, tracks, options, true, co64);
+    }
+    else
+    {
+        // the moov size doesn't depend on the offset values
+        setOffsets(0);
+        writeMoov(moov, tracks, options, true, co64);
+        setOffsets(head.data.size() + moov.data.size() + mdatHeader);
+        moov.data.clear();
+        writeMoov(moov, tracks, options, true, co64);
+        head.bytes(moov.data.data(), moov.data.size());
+    }
+
+    if (16 == mdatHeader)
+    {
+        head.u32(1);
+        head.bytes("mdat", 4);
+        head.u64(mdatPayload + 16);
+    }
+    else
+    {
+        head.u32((uint32_t)mdatPayload + 8);
+        head.bytes("mdat", 4);
+    }
+    if (!writeBuf(fp, head.data.data(), head.data.size()))
+        return -1;
+
+    std::vector<uint8_t> sample;
+    for (auto &ref : order)
+    {
+        auto &track = tracks[ref.trackIdx];
+        for (uint32_t i = 0; i < track.chunkSamples[ref.chunkIdx]; i++)
+        {
+            fillSample(track, track.chunkFirst[ref.chunkIdx] + i, options.gop, sample);
+            if (!writeBuf(fp, sample.data(), sample.size()))
+                return -1;
+        }
+    }
+
+    if (options.moovAtEnd && !writeBuf(fp, moov.data.data(), moov.data.size()))
+        return -1;
+    return 0;
+}
+
+int writeFragmentedFile(FILE *fp, std::vector<GenTrack> &tracks, const Mp4GenOptions &options)
+{
+    BoxWriter head;
+    writeFtyp(head, true);
+    writeMoov(head, tracks, options, false, false);
+    if (!writeBuf(fp, head.data.data(), head.data.size()))
+        return -1;
+
+    uint32_t              perFragment = std::max(options.samplesPerFragment, 1u);
+    std::vector<uint32_t> next(tracks.size(), 0);
+    std::vector<uint8_t>  sample;
+    for (uint32_t seq = 1;; seq++)
+    {
+        struct Run
+        {
+            uint32_t trackIdx;
+            uint32_t first;
+            uint32_t count;
+            size_t   dataOffsetPos;
+        };
+        std::vector<Run> runs;
+        for (uint32_t t = 0; t < tracks.size(); t++)
+        {
+            uint32_t count = tracks[t].isVideo ? perFragment : perFragment * 3 / 2;
+            count          = std::min(count, (uint32_t)tracks[t].sizes.size() - next[t]);
+            if (count > 0)
+                runs.push_back({t, next[t], count, 0});
+            next[t] += count;
+        }
+        if (runs.empty())
+            break;
+
+        BoxWriter moof;
+        size_t    moofStart = moof.begin("moof");
+        size_t    mfhd      = moof.beginFull("mfhd", 0, 0);
+        moof.u32(seq);
+        moof.end(mfhd);
+        for (auto &run : runs)
+        {
+            auto  &track = tracks[run.trackIdx];
+            size_t traf  = moof.begin("traf");
+            size_t tfhd  = moof.beginFull("tfhd", 0, 0x020000); // default-base-is-moof
+            moof.u32(track.trackId);
+            moof.end(tfhd);
+            size_t tfdt = moof.beginFull("tfdt", 1, 0);
+            moof.u64((uint64_t)run.first * track.delta);
+            moof.end(tfdt);
+
+            // data offset, then size + flags + cts offset for video, duration + size for audio
+            uint32_t flags = track.isVideo ? 0x1 | 0x200 | 0x400 | 0x800 : 0x1 | 0x100 | 0x200;
+            size_t   trun  = moof.beginFull("trun", 0, flags);
+            moof.u32(run.count);
+            run.dataOffsetPos = moof.data.size();
+            moof.u32(0);
+            for (uint32_t i = run.first; i < run.first + run.count; i++)
+            {
+                if (track.isVideo)
+                {
+                    moof.u32(track.sizes[i]);
+                    moof.u32(track.isKey(i, options.gop) ? 0x02000000 : 0x01010000);
+                    moof.u32(track.ctsOffset(i));
+                }
+                else
+                {
+                    moof.u32(track.delta);
+                    moof.u32(track.sizes[i]);
+                }
+            }
+            moof.end(trun);
+            moof.end(traf);
+        }
+        moof.end(moofStart);
+
+        uint64_t dataPos = moof.data.size() + 8;
+        for (auto &run : runs)
+        {
+            moof.setU32(run.dataOffsetPos, (uint32_t)dataPos);
+            for (uint32_t i = run.first; i < run.first + run.count; i++)
+                dataPos += tracks[run.trackIdx].sizes[i];
+        }
+        moof.u32((uint32_t)(dataPos - moof.data.size()));
+        moof.bytes("mdat", 4);
+        if (!writeBuf(fp, moof.data.data(), moof.data.size()))
+            return -1;
+
+        for (auto &run : runs)
+        {
+            for (uint32_t i = run.first; i < run.first + run.count; i++)
+            {
+                fillSample(tracks[run.trackIdx], i, options.gop, sample);
+                if (!writeBuf(fp, sample.data(), sample.size()))
+                    return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+} // namespace
+
+int generateMp4File(const std::string &path, const Mp4GenOptions &options)
+{
+    if (0 == options.gop || options.videoTracks + options.audioTracks == 0)
+        return -1;
+
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (nullptr == fp)
+        return -1;
+    setvbuf(fp, nullptr, _IOFBF, 1024 * 1024);
+
+    auto tracks = makeTracks(options);
+    int  ret    = options.fragmented ? writeFragmentedFile(fp, tracks, options) : writeIsoFile(fp, tracks, options);
+    if (fclose(fp) != 0)
+        ret = -1;
+    return ret;
+}
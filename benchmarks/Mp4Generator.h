@@ -0,0 +1,34 @@
+#ifndef _MP4_GENERATOR_H_
+#define _MP4_GENERATOR_H_
+
+#include <stdint.h>
+#include <string>
+
+// layout of a synthetic file: H.264 video tracks (30 fps, a key frame every gop samples, pts reordered like
+// IBP) and AAC audio tracks (48 kHz, 1024 samples per frame, so 1.5 audio samples per video sample);
+// sample bytes are pseudo random, only the NAL headers are meaningful
+struct Mp4GenOptions
+{
+    bool fragmented   = false;
+    bool moovAtEnd    = false; // non fragmented only
+    bool largeOffsets = false; // co64 instead of stco, non fragmented only
+
+    uint32_t videoTracks  = 1;
+    uint32_t audioTracks  = 1;
+    uint32_t videoSamples = 3000; // per video track, audio tracks get videoSamples * 3 / 2
+    uint32_t gop          = 30;
+
+    uint32_t samplesPerChunk    = 5;  // non fragmented only
+    uint32_t samplesPerFragment = 30; // video samples in each moof, audio gets 1.5 times as many
+
+    uint32_t videoSampleSize = 8000; // average, sizes are spread over [size / 2, size * 3 / 2]
+    uint32_t audioSampleSize = 400;
+
+    uint32_t seed = 1234;
+};
+
+// write the file at path, the moov is built in memory and the mdat streamed;
+// return 0 if success, otherwise a negative value
+int generateMp4File(const std::string &path, const Mp4GenOptions &options);
+
+#endif
@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <filesystem>
+
+#include "Mp4Parse.h"
+#include "Mp4Generator.h"
+#include "BenchmarkTools.h"
+
+using std::string;
+namespace fs = std::filesystem;
+
+static void printUsage(const char *name)
+{
+    printf("usage: %s [options]\n"
+           "  --samples N     video samples per video track (default 20000), audio tracks get 1.5 times as many\n"
+           "  --video N       video tracks (default 1)\n"
+           "  --audio N       audio tracks (default 1)\n"
+           "  --iterations N  parses per case, the median and the min are reported (default 5)\n"
+           "  --threads N     Mp4ParseOptions::threadCount of the \"threads\" mode (default 0, all cores)\n"
+           "  --dir PATH      where the files are generated (default the temporary directory)\n"
+           "  --keep          keep the generated files\n"
+           "  --layout NAME   only moov-start, moov-end or fragmented\n"
+           "  --mode NAME     only default, lazy, header-only, mmap or threads;\n"
+           "                  with --layout, the peak rss printed at the end is the one of that case\n"
+           "files are parsed from the page cache, generate them on the target disk and drop the cache to time cold reads\n",
+           name);
+}
+
+struct ParseMode
+{
+    const char     *name;
+    Mp4ParseOptions options;
+};
+
+struct ParseResult
+{
+    BenchStats parseMs;
+    double     rssDeltaMb = 0; // held by the parser after parsing
+    uint64_t   samples    = 0;
+};
+
+static bool parseOnce(const string &path, const Mp4ParseOptions &options, double &ms, Mp4ParserHandle &parser)
+{
+    parser       = createMp4Parser();
+    double start = nowMs();
+    int    ret   = parser->parse(path, options);
+    ms           = nowMs() - start;
+    if (ret < 0 || !parser->isParseSuccess())
+    {
+        printf("parse %s fail: %s\n", path.c_str(), parser->getErrorMessage().c_str());
+        return false;
+    }
+    return true;
+}
+
+static bool runParse(const string &path, const Mp4ParseOptions &options, uint32_t iterations, ParseResult &result)
+{
+    std::vector<double> times;
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        Mp4ParserHandle parser;
+        uint64_t        rssBefore = getCurrentRssKb();
+        double          ms        = 0;
+        if (!parseOnce(path, options, ms, parser))
+            return false;
+        times.push_back(ms);
+        if (0 == i)
+        {
+            result.rssDeltaMb = ((double)getCurrentRssKb() - (double)rssBefore) / 1024;
+            for (auto &track : parser->getTracksInfo())
+                result.samples += track->mediaInfo->sampleCount;
+        }
+    }
+    result.parseMs = summarize(times);
+    return true;
+}
+
+// every sample of every track in order, into one reused buffer
+static bool runSequentialFetch(const string &path, double &mbPerSec, double &samplesPerSec)
+{
+    Mp4ParserHandle parser;
+    double          ms = 0;
+    if (!parseOnce(path, Mp4ParseOptions(), ms, parser))
+        return false;
+
+    std::vector<uint8_t> buf(1024 * 1024);
+    uint64_t             bytes   = 0;
+    uint64_t             samples = 0;
+    double               start   = nowMs();
+    auto                &tracks  = parser->getTracksInfo();
+    for (uint32_t trackIdx = 0; trackIdx < tracks.size(); trackIdx++)
+    {
+        for (uint64_t sampleIdx = 0; sampleIdx < tracks[trackIdx]->mediaInfo->sampleCount; sampleIdx++)
+        {
+            Mp4RawSample sample;
+            int          ret = parser->getSample(trackIdx, (uint32_t)sampleIdx, sample, buf.data(), buf.size());
+            if (MP4_BUFFER_TOO_SMALL == ret)
+            {
+                buf.resize(sample.dataSize);
+                ret = parser->getSample(trackIdx, (uint32_t)sampleIdx, sample, buf.data(), buf.size());
+            }
+            if (ret < 0)
+            {
+                printf("get sample %" PRIu64 " of track %u fail\n", sampleIdx, trackIdx);
+                return false;
+            }
+            bytes += sample.dataSize;
+            samples++;
+        }
+    }
+    double sec    = (nowMs() - start) / 1000;
+    mbPerSec      = sec > 0 ? bytes / 1024.0 / 1024.0 / sec : 0;
+    samplesPerSec = sec > 0 ? samples / sec : 0;
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    BenchArgs args(argc, argv);
+    if (args.has("help"))
+    {
+        printUsage(argv[0]);
+        return 0;
+    }
+    keepErrorLogsOnly();
+
+    Mp4GenOptions genBase;
+    genBase.videoSamples = (uint32_t)args.getUint("samples", 20000);
+    genBase.videoTracks  = (uint32_t)args.getUint("video", 1);
+    genBase.audioTracks  = (uint32_t)args.getUint("audio", 1);
+    uint32_t iterations  = (uint32_t)MAX(args.getUint("iterations", 5), 1);
+    string   dir         = args.getString("dir", "");
+
+    struct Layout
+    {
+        const char   *name;
+        Mp4GenOptions options;
+    };
+    std::vector<Layout> layouts     = {{"moov-start", genBase}, {"moov-end", genBase}, {"fragmented", genBase}};
+    layouts[1].options.moovAtEnd    = true;
+    layouts[1].options.largeOffsets = true;
+    layouts[2].options.fragmented   = true;
+
+    std::vector<ParseMode> modes(5);
+    modes[0].name                    = "default";
+    modes[1].name                    = "lazy";
+    modes[1].options.lazySampleTable = true;
+    modes[2].name                    = "header-only";
+    modes[2].options.headerOnly      = true;
+    modes[3].name                    = "mmap";
+    modes[3].options.readMode        = MP4_READ_MODE_MMAP;
+    modes[4].name                    = "threads";
+    modes[4].options.threadCount     = (uint32_t)args.getUint("threads", 0);
+    modes[4].options.moofsPerTask    = 64;
+
+    printf("%-11s %-12s %9s %9s %11s %11s %10s %12s %12s\n", "layout", "mode", "file(MB)", "samples", "median(ms)",
+           "min(ms)", "rss(MB)", "fetch(MB/s)", "fetch(smp/s)");
+    string onlyLayout = args.getString("layout", "");
+    string onlyMode   = args.getString("mode", "");
+    for (auto &layout : layouts)
+    {
+        if (!onlyLayout.empty() && onlyLayout != layout.name)
+            continue;
+        string path = benchFilePath(dir, string("mp4bench_") + layout.name + ".mp4");
+        if (generateMp4File(path, layout.options) < 0)
+        {
+            printf("generate %s fail\n", path.c_str());
+            return 1;
+        }
+        std::error_code errCode;
+        double          fileMb = fs::file_size(path, errCode) / 1024.0 / 1024.0;
+
+        for (auto &mode : modes)
+        {
+            if (!onlyMode.empty() && onlyMode != mode.name)
+                continue;
+            ParseResult result;
+            if (!runParse(path, mode.options, iterations, result))
+                return 1;
+            printf("%-11s %-12s %9.1f %9" PRIu64 " %11.3f %11.3f %10.2f", layout.name, mode.name, fileMb, result.samples,
+                   result.parseMs.median, result.parseMs.min, result.rssDeltaMb);
+
+            // fetching doesn't depend on how the tables were built, once per file is enough
+            double mbPerSec = 0, samplesPerSec = 0;
+            if (&mode == &modes[0] && runSequentialFetch(path, mbPerSec, samplesPerSec))
+                printf(" %12.1f %12.0f\n", mbPerSec, samplesPerSec);
+            else
+                printf(" %12s %12s\n", "-", "-");
+        }
+
+        if (!args.has("keep"))
+            fs::remove(path, errCode);
+    }
+    printf("peak rss %.2f MB\n", getPeakRssKb() / 1024.0);
+    return 0;
+}
@@ -13,6 +13,9 @@
 #define MP4_UNUSED(val) ((void)val)
 #define MP4_UUID_LEN    (16)
 
+// returned by the sample getters writing to a caller buffer, dataSize of the frame is the size needed
+#define MP4_BUFFER_TOO_SMALL (-2)
+
 using Mp4BoxType = uint32_t;
 
 #endif // _MP4_DEFS_H_
\ No newline at end of file
@@ -5,25 +5,65 @@
 #include "Mp4Defs.h"
 #include "Mp4Types.h"
 
+// random access bytes the parser reads from, instead of a file path
+class Mp4ByteSource
+{
+public:
+    virtual ~Mp4ByteSource() {}
+
+    virtual std::string    getName() const                               = 0; // shown as the file name
+    // may grow between calls for a stream still being written, see Mp4Parser::refresh()
+    virtual uint64_t       getSize()                                     = 0;
+    // copy up to len bytes at pos into buf, called from several threads when samples are fetched in parallel;
+    // return the bytes copied, less than len only at the end or on failure
+    virtual uint64_t       readAt(uint64_t pos, void *buf, uint64_t len) = 0;
+    // the whole content if it's in memory already, it's then read without copying through readAt
+    virtual const uint8_t *getData() const { return nullptr; }
+};
+typedef std::shared_ptr<Mp4ByteSource> Mp4ByteSourcePtr;
+
+Mp4ByteSourcePtr createFileByteSource(const std::string &filePath, MP4_READ_MODE_E readMode = MP4_READ_MODE_STDIO);
+// data must stay valid as long as the source, owner (if any) is kept to make sure of that
+Mp4ByteSourcePtr createMemoryByteSource(const uint8_t *data, uint64_t size, std::shared_ptr<const void> owner = nullptr,
+                                        const std::string &name = "memory");
+// readAtCallback has the same contract as Mp4ByteSource::readAt, getSizeCallback as Mp4ByteSource::getSize
+Mp4ByteSourcePtr createCallbackByteSource(std::function<uint64_t()>                                    getSizeCallback,
+                                          std::function<uint64_t(uint64_t pos, void *buf, uint64_t len)> readAtCallback,
+                                          const std::string                                           &name = "callback");
+
 class Mp4Parser
 {
 public:
     virtual ~Mp4Parser() {}
 
 public:
-    virtual int  parse(std::string filePath) = 0;
-    virtual void clear()                     = 0;
+    virtual int  parse(std::string filePath)                                    = 0;
+    virtual int  parse(std::string filePath, const Mp4ParseOptions &options)    = 0;
+    virtual int  parse(Mp4ByteSourcePtr source, const Mp4ParseOptions &options) = 0; // options.readMode not used
+    virtual void clear()                                                        = 0;
+    // read what Mp4ParseOptions::headerOnly skipped and generate the sample tables;
+    // the sample getters below can be called from other threads meanwhile, they wait until the tables are filled
+    virtual int  loadSampleTables()                                             = 0;
+    // for a fragmented file still being written: parse the moof/mdat appended since the last call and
+    // extend the sample tables with them; a moof is taken once its mdat is complete.
+    // The sample getters below can be called from other threads meanwhile, they only wait while the tables grow;
+    // return the number of new moof boxes, negative on failure
+    virtual int  refresh()                                                      = 0;
 
     virtual bool        isParseSuccess() const = 0;
     virtual std::string getErrorMessage()      = 0;
 
     virtual std::string getFilePath() const = 0;
-    virtual float       getParseProgress()  = 0;
+    virtual float       getParseProgress()  = 0; // doesn't wait for the parse, can be polled from another thread
     virtual MP4_TYPE_E  getMp4Type() const  = 0;
 
+    // counters of the current parse; waits while a parse in another thread is reading the box tree
+    virtual Mp4ParseStats getStats() = 0;
+
     virtual Mp4BoxPtr   asBox() const              = 0; // for more convenient box recursion
     virtual std::string getBasicInfoString() const = 0;
 
+    // the tables behind it are changed by refresh() and loadSampleTables(), don't read them during those calls
     virtual const std::vector<TrackInfoPtr> &getTracksInfo() const = 0;
     virtual const std::vector<Mp4BoxPtr>     getBoxes() const      = 0;
 
@@ -34,10 +74,58 @@ public:
     virtual int getAudioSample(uint32_t trackIdx, uint32_t sampleIdx, Mp4AudioFrame &frm) = 0;
     virtual int getVideoSample(uint32_t trackIdx, uint32_t sampleIdx, Mp4VideoFrame &frm) = 0;
     virtual int getSample(uint32_t trackIdx, uint32_t sampleIdx, Mp4RawSample &outFrame)  = 0;
+    // same as above, but the data is written to buf and sampleData is left empty, so one buffer can be reused;
+    // if dataSize is more than bufSize nothing is read and MP4_BUFFER_TOO_SMALL is returned
+    virtual int getAudioSample(uint32_t trackIdx, uint32_t sampleIdx, Mp4AudioFrame &frm, uint8_t *buf, uint64_t bufSize) = 0;
+    virtual int getVideoSample(uint32_t trackIdx, uint32_t sampleIdx, Mp4VideoFrame &frm, uint8_t *buf, uint64_t bufSize) = 0;
+    virtual int getSample(uint32_t trackIdx, uint32_t sampleIdx, Mp4RawSample &outFrame, uint8_t *buf, uint64_t bufSize) = 0;
+    // only when the file is in memory: MP4_READ_MODE_MMAP (if the mapping succeeded) or a memory byte source;
+    // return a negative value otherwise, getSample copies in all modes
+    virtual int getSampleView(uint32_t trackIdx, uint64_t sampleIdx, Mp4SampleView &view) const = 0;
+    // samples firstIdx ... firstIdx + count - 1 (cut at the end of the track) with one read per run of samples
+    // stored back to back, e.g. a whole chunk; every sampleData points into one buffer, released with the last of them
+    virtual int getSamples(uint32_t trackIdx, uint64_t firstIdx, uint64_t count, std::vector<Mp4RawSample> &outSamples) = 0;
+
+    // works both with and without Mp4ParseOptions::lazySampleTable
+    virtual int getSampleInfo(uint32_t trackIdx, uint64_t sampleIdx, Mp4SampleItem &sampleInfo) const = 0;
+
+    // sample index by decode time, binary searched over the sample dts and the sync sample table;
+    // return a negative value if no sample matches
+    virtual int64_t findSampleByTime(uint32_t trackIdx, uint64_t timeMs, MP4_SEEK_MODE_E mode) const = 0;
 };
 typedef std::shared_ptr<Mp4Parser> Mp4ParserHandle;
 Mp4ParserHandle                    createMp4Parser();
 
+// push parser for MP4/fMP4 bytes arriving in order, e.g. from a socket; the stream is never read backwards.
+// Only the top-level box being received and the samples not complete yet are buffered, mdat bodies pass through.
+// Samples are located by moov (when it's before mdat) or by each moof, a moov after its mdat only gives the tracks.
+class Mp4StreamParser
+{
+public:
+    virtual ~Mp4StreamParser() {}
+
+    // a top-level box other than mdat is parsed; only ftyp/moov are kept after the call
+    using BoxCallback = std::function<void(Mp4BoxPtr box)>;
+    // all bytes of a sample have arrived, data is only valid during the call
+    using SampleCallback = std::function<void(uint32_t trackIdx, const Mp4SampleItem &sample, const uint8_t *data)>;
+
+    virtual void setBoxCallback(BoxCallback callback)       = 0;
+    virtual void setSampleCallback(SampleCallback callback) = 0;
+
+    // the next len bytes of the stream, the callbacks are called from here;
+    // return a negative value if the stream is broken, the parser can't go on after that
+    virtual int push(const uint8_t *data, uint64_t len) = 0;
+
+    virtual MP4_TYPE_E                       getMp4Type() const      = 0;
+    virtual const std::vector<TrackInfoPtr> &getTracksInfo() const   = 0; // empty until moov is parsed
+    virtual uint64_t                         getStreamPos() const    = 0; // bytes pushed so far
+    virtual uint64_t                         getBufferedSize() const = 0;
+    virtual std::string                      getErrorMessage()       = 0;
+};
+typedef std::shared_ptr<Mp4StreamParser> Mp4StreamParserHandle;
+// maxBufferSize bounds the bytes kept for one box (mdat excluded) or one sample
+Mp4StreamParserHandle createMp4StreamParser(uint64_t maxBufferSize = 64 * 1024 * 1024);
+
 // data is after uuid(for uuid boxes) or box type(for other boxes);
 // you can store the data in *pData in any form you prefer;
 // return 0 if success, otherwise return a negative value;
@@ -48,6 +136,10 @@ void registerUdtaCallback(uint8_t uuid[MP4_UUID_LEN], BoxParseFunc parseDataCall
                           void *userData);
 void registerBoxCallback(Mp4BoxType boxType, BoxParseFunc parseDataCallback, BoxDataFunc getDataCallback, void *userData);
 
-void defaultLogCallback(MP4_LOG_LEVEL_E logLevel, const char *logBuffer);
-void setMp4ParseLogCallback(std::function<void(MP4_LOG_LEVEL_E, const char *)> logCallback);
+void            defaultLogCallback(MP4_LOG_LEVEL_E logLevel, const char *logBuffer);
+void            setMp4ParseLogCallback(std::function<void(MP4_LOG_LEVEL_E, const char *)> logCallback);
+// messages above maxLevel are dropped before being formatted, MP4_LOG_LEVEL_ALL by default;
+// the library can also be built with MP4_LOG_COMPILE_LEVEL to leave them out entirely
+void            setMp4ParseLogLevel(MP4_LOG_LEVEL_E maxLevel);
+MP4_LOG_LEVEL_E getMp4ParseLogLevel();
 #endif
\ No newline at end of file
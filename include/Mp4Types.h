@@ -2,7 +2,10 @@
 #define MP4_TYPES_H
 
 #include <stdint.h>
+#include <string.h>
 
+#include <iterator>
+#include <map>
 #include <string>
 #include <vector>
 
@@ -213,6 +216,167 @@ struct Mp4SampleItem
     std::vector<int>  naluTypes;
 };
 
+// column stored in NarrowT, switch the whole column to WideT once a value doesn't fit
+template <typename NarrowT, typename WideT>
+class Mp4PackedColumn
+{
+public:
+    size_t size() const { return mWide.empty() ? mNarrow.size() : mWide.size(); }
+    void   reserve(size_t count) { mNarrow.reserve(count); }
+    void   clear()
+    {
+        mNarrow.clear();
+        mWide.clear();
+    }
+
+    WideT operator[](size_t idx) const { return mWide.empty() ? (WideT)mNarrow[idx] : mWide[idx]; }
+
+    // the values as stored, NarrowT or WideT each, for Mp4SampleIndex::appendTo/readFrom
+    bool        isWide() const { return !mWide.empty(); }
+    const void *rawData() const { return isWide() ? (const void *)mWide.data() : (const void *)mNarrow.data(); }
+    void        assignRaw(bool wide, const uint8_t *data, size_t count)
+    {
+        clear();
+        if (wide)
+        {
+            mWide.resize(count);
+            memcpy(mWide.data(), data, count * sizeof(WideT));
+        }
+        else
+        {
+            mNarrow.resize(count);
+            memcpy(mNarrow.data(), data, count * sizeof(NarrowT));
+        }
+    }
+
+    void push_back(WideT val)
+    {
+        if (mWide.empty() && (WideT)(NarrowT)val == val)
+        {
+            mNarrow.push_back((NarrowT)val);
+            return;
+        }
+        widen();
+        mWide.push_back(val);
+    }
+
+private:
+    void widen()
+    {
+        if (!mWide.empty() || mNarrow.empty())
+            return;
+        mWide.assign(mNarrow.begin(), mNarrow.end());
+        mNarrow.clear();
+        mNarrow.shrink_to_fit();
+    }
+
+    std::vector<NarrowT> mNarrow;
+    std::vector<WideT>   mWide;
+};
+
+#define MP4_SAMPLE_INDEX_DTS_BLOCK 256 // samples of Mp4SampleIndex sharing one full dtsMs, the others keep an offset to it
+
+// samples of a track stored column by column, sampleIdx is the position;
+// frameType and naluTypes are only allocated once Mp4Parser::parseVideoNaluType fills them.
+// It replaces the std::vector<Mp4SampleItem> Mp4MediaInfo::samplesInfo used to be: operator[] and the iterator
+// return a const copy built from the columns, so samples can only be read, writes like `samplesInfo[i].dtsMs = x`
+// no longer compile and the iterator is an input iterator only
+class Mp4SampleIndex
+{
+public:
+    size_t size() const { return mSampleOffset.size(); }
+    bool   empty() const { return mSampleOffset.empty(); }
+    void   reserve(size_t count);
+    void   clear();
+    void   push_back(const Mp4SampleItem &item);
+
+    // last sample whose dtsMs is not after dtsMs, -1 if there's none
+    int64_t findByDts(uint64_t dtsMs) const;
+
+    const Mp4SampleItem operator[](size_t idx) const;
+    // withNaluInfo = false leaves frameType/naluTypes empty and doesn't touch their columns
+    void                getItem(size_t idx, Mp4SampleItem &item, bool withNaluInfo = true) const;
+
+    uint64_t          getSampleOffset(size_t idx) const { return mSampleOffset[idx]; }
+    uint64_t          getSampleSize(size_t idx) const { return mSampleSize[idx]; }
+    uint64_t          getDtsMs(size_t idx) const { return mDtsBaseMs[idx / MP4_SAMPLE_INDEX_DTS_BLOCK] + mDtsOffsetMs[idx]; }
+    uint64_t          getDtsDeltaMs(size_t idx) const { return mDtsDeltaMs[idx]; }
+    uint64_t          getPtsMs(size_t idx) const { return getDtsMs(idx) + (uint64_t)mPtsOffsetMs[idx]; }
+    int               getKeyFrame(size_t idx) const { return mKeyFrame[idx]; }
+    uint32_t          getSampleDescriptionIndex(size_t idx) const { return mSampleDescriptionIndex[idx]; }
+    H26X_FRAME_TYPE_E getFrameType(size_t idx) const;
+
+    // the samples in order as Mp4SampleItem, built from the columns on each dereference
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type        = Mp4SampleItem;
+        using difference_type   = std::ptrdiff_t;
+        using reference         = const Mp4SampleItem;
+        // operator-> keeps the item it points to
+        struct pointer
+        {
+            const Mp4SampleItem  item;
+            const Mp4SampleItem *operator->() const { return &item; }
+        };
+
+        const_iterator() = default;
+        const_iterator(const Mp4SampleIndex *index, size_t idx) : mIndex(index), mIdx(idx) {}
+
+        reference operator*() const { return (*mIndex)[mIdx]; }
+        pointer   operator->() const { return pointer{**this}; }
+
+        const_iterator &operator++()
+        {
+            ++mIdx;
+            return *this;
+        }
+        const_iterator operator++(int)
+        {
+            const_iterator old = *this;
+            ++mIdx;
+            return old;
+        }
+
+        bool operator==(const const_iterator &other) const { return mIdx == other.mIdx && mIndex == other.mIndex; }
+        bool operator!=(const const_iterator &other) const { return !(*this == other); }
+
+    private:
+        const Mp4SampleIndex *mIndex = nullptr;
+        size_t                mIdx   = 0;
+    };
+    using iterator = const_iterator;
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, size()); }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+
+private:
+    friend class MP4ParserImpl;
+
+    // filled in by the parser only
+    void setKeyFrame(size_t idx, int isKeyFrame) { mKeyFrame[idx] = (int8_t)isKeyFrame; }
+    void setFrameType(size_t idx, H26X_FRAME_TYPE_E frameType);
+    void setNaluTypes(size_t idx, const std::vector<int> &naluTypes);
+
+    // the columns in host byte order appended to out, frameType/naluTypes are not kept;
+    // readFrom replaces the columns with the ones at data + pos and moves pos after them, negative if they don't fit in size
+    void appendTo(std::vector<uint8_t> &out) const;
+    int  readFrom(const uint8_t *data, uint64_t size, uint64_t &pos);
+
+    std::vector<uint64_t>                 mSampleOffset;
+    Mp4PackedColumn<uint32_t, uint64_t>   mSampleSize;
+    std::vector<uint64_t>                 mDtsBaseMs;   // dtsMs of every MP4_SAMPLE_INDEX_DTS_BLOCK sample
+    Mp4PackedColumn<uint32_t, uint64_t>   mDtsOffsetMs; // dtsMs - the base of its block
+    Mp4PackedColumn<uint32_t, uint64_t>   mDtsDeltaMs;
+    Mp4PackedColumn<int32_t, int64_t>     mPtsOffsetMs; // ptsMs - dtsMs
+    std::vector<int8_t>                   mKeyFrame;
+    Mp4PackedColumn<uint16_t, uint32_t>   mSampleDescriptionIndex;
+    std::vector<int8_t>                   mFrameType;
+    std::vector<std::vector<int>>         mNaluTypes;
+};
+
 struct Mp4ChunkItem
 {
     uint64_t chunkIdx = 0;
@@ -238,7 +402,7 @@ struct Mp4MediaInfo
     uint64_t                   totalSize   = 0;
     double                     avgBitrate  = 0; // bps
     std::vector<Mp4ChunkItem>  chunksInfo;
-    std::vector<Mp4SampleItem> samplesInfo;
+    Mp4SampleIndex             samplesInfo;
     std::vector<uint64_t>      syncSampleTable;
 
     virtual std::shared_ptr<Mp4BoxData> getData(std::shared_ptr<Mp4BoxData> src = nullptr) const;
@@ -299,6 +463,19 @@ struct Mp4RawSample
     std::shared_ptr<uint8_t[]> sampleData;
 };
 
+// sample bytes inside the read-only mapping of the file, nothing is copied;
+// the mapping is kept alive by data, even after the parser is cleared
+struct Mp4SampleView
+{
+    uint32_t                       trackIdx   = 0;
+    uint64_t                       fileOffset = 0;
+    uint64_t                       sampleSize = 0;
+    uint64_t                       dtsMs      = 0;
+    uint64_t                       ptsMs      = 0;
+    uint64_t                       sampleIdx  = 0;
+    std::shared_ptr<const uint8_t> data;
+};
+
 struct Mp4MediaFrame : public Mp4RawSample
 {
     MP4_MEDIA_TYPE_E mediaType = MP4_MEDIA_TYPE_BUTT;
@@ -325,6 +502,86 @@ std::string     &mp4GetMediaTypeName(MP4_MEDIA_TYPE_E type);
 std::string     &mp4GetCodecName(uint8_t codec);
 MP4_CODEC_TYPE_E mp4GetCodecType(uint8_t codec);
 
+enum MP4_READ_MODE_E
+{
+    MP4_READ_MODE_STDIO = 0, // buffered fread
+    MP4_READ_MODE_MMAP  = 1, // read-only memory mapping, fall back to stdio if the file can't be mapped
+};
+
+struct Mp4ParseOptions
+{
+    MP4_READ_MODE_E readMode = MP4_READ_MODE_STDIO;
+
+    // keep only the sample table boxes, Mp4MediaInfo::samplesInfo and chunksInfo stay empty,
+    // every sample is computed when asked, use Mp4Parser::getSampleInfo to get it
+    bool lazySampleTable = false;
+
+    // only ftyp and moov are read, other top-level boxes and the sample table boxes are skipped,
+    // track info only has what the headers carry (codec, resolution, tkhd duration...);
+    // call Mp4Parser::loadSampleTables before getting any sample
+    bool headerOnly = false;
+
+    // threads generating the sample tables, one task per track; 0 uses all cores, 1 generates in the calling thread
+    uint32_t threadCount  = 1;
+    // > 0 splits the moof walk of a fragmented track into tasks of this many moof boxes, run on threadCount threads
+    uint32_t moofsPerTask = 0;
+
+    // unless mapped, box data is read through an LRU cache of cacheBlockCount blocks of cacheBlockSize bytes,
+    // sequential misses read ahead up to readaheadBlocks blocks at once; cacheBlockCount 0 disables the cache
+    uint32_t cacheBlockSize  = 64 * 1024;
+    uint32_t cacheBlockCount = 16;
+    uint32_t readaheadBlocks = 8;
+
+    // not empty: the sample tables generated from a file path are saved in this directory, and a later parse of the
+    // same file (same absolute path, size and modification time) reads them back instead of generating them again;
+    // the box tree is still parsed, lazySampleTable and byte sources don't use it
+    std::string sampleIndexCacheDir;
+};
+
+// counters of the current parse, reset by parse() and clear(), loadSampleTables() and refresh() add to them;
+// times are in microseconds, the per track ones summed over the tracks even when generated in parallel
+struct Mp4ParseStats
+{
+    // cursor reads, the ones parsing the boxes
+    uint64_t sourceReads = 0; // fread or Mp4ByteSource::readAt calls: cache refills, reads larger than the cache,
+                              // headers of the top-level boxes jumped over
+    uint64_t sourceBytes = 0;
+    uint64_t seeks       = 0; // fseek calls
+    uint64_t cacheHits   = 0; // block lookups found in the read cache
+    uint64_t cacheMisses = 0; // read cache refills
+    // positional reads, the ones of the sample getters; none when the file is in memory
+    uint64_t positionalReads = 0;
+    uint64_t positionalBytes = 0;
+
+    uint64_t                        boxCount = 0; // boxes parsed
+    std::map<std::string, uint64_t> boxCountByType;
+    uint64_t                        tableEntries = 0; // sample table entries decoded
+
+    uint64_t totalUs            = 0; // in parse(), loadSampleTables() and refresh()
+    uint64_t boxParseUs         = 0; // reading the box tree
+    uint64_t fragmentCollectUs  = 0; // walking the moof boxes
+    uint64_t isoTableUs         = 0; // sample tables from the moov boxes
+    uint64_t fragmentTableUs    = 0; // sample tables from the moof boxes
+    uint64_t sampleLocatorUs    = 0; // Mp4ParseOptions::lazySampleTable index
+    uint64_t sampleIndexCacheUs = 0; // loading or saving Mp4ParseOptions::sampleIndexCacheDir
+
+    bool sampleIndexFromCache = false; // the sample tables were loaded from Mp4ParseOptions::sampleIndexCacheDir
+
+    // the lock serializing the cursor reads: parsing, loadSampleTables(), refresh()
+    uint64_t fileLockCount     = 0;
+    uint64_t fileLockContended = 0; // acquisitions that had to wait
+    uint64_t fileLockWaitUs    = 0;
+
+    std::string toJson() const;
+};
+
+enum MP4_SEEK_MODE_E
+{
+    MP4_SEEK_MODE_NEAREST       = 0, // sample whose dts is the closest
+    MP4_SEEK_MODE_PREV_KEYFRAME = 1, // last key frame with dts not after the time
+    MP4_SEEK_MODE_NEXT_KEYFRAME = 2, // first key frame with dts not before the time
+};
+
 enum MP4_LOG_LEVEL_E
 {
     MP4_LOG_LEVEL_ERR = 0,
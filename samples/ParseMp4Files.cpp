@@ -56,23 +56,24 @@ void generateResultTable(Mp4ParserHandle mp4_info, string dirPath)
                       << std::endl;
         for (unsigned int j = 0; j < curTrackMedia->samplesInfo.size(); j++)
         {
-            trackInfoFile << curTrackMedia->samplesInfo[j].sampleIdx << "," << curTrackMedia->samplesInfo[j].sampleOffset << ","
-                          << "0x" << std::hex << curTrackMedia->samplesInfo[j].sampleOffset << std::dec << ","
-                          << curTrackMedia->samplesInfo[j].sampleSize << ","
-                          << "0x" << std::hex << curTrackMedia->samplesInfo[j].sampleSize << std::dec << ","
-                          << curTrackMedia->samplesInfo[j].ptsMs << "," << curTrackMedia->samplesInfo[j].dtsMs << ","
-                          << curTrackMedia->samplesInfo[j].dtsDeltaMs << ", ";
+            Mp4SampleItem curSample = curTrackMedia->samplesInfo[j];
+            trackInfoFile << curSample.sampleIdx << "," << curSample.sampleOffset << ","
+                          << "0x" << std::hex << curSample.sampleOffset << std::dec << ","
+                          << curSample.sampleSize << ","
+                          << "0x" << std::hex << curSample.sampleSize << std::dec << ","
+                          << curSample.ptsMs << "," << curSample.dtsMs << ","
+                          << curSample.dtsDeltaMs << ", ";
             auto codecType = mp4GetCodecType(curTrackMedia->codecCode);
-            trackInfoFile << mp4GetFrameTypeStr(curTrackMedia->samplesInfo[j].frameType) << ", ";
-            for (size_t naluIdx = 0; naluIdx < curTrackMedia->samplesInfo[j].naluTypes.size(); naluIdx++)
+            trackInfoFile << mp4GetFrameTypeStr(curSample.frameType) << ", ";
+            for (size_t naluIdx = 0; naluIdx < curSample.naluTypes.size(); naluIdx++)
             {
-                trackInfoFile << mp4GetNaluTypeStr(codecType, curTrackMedia->samplesInfo[j].naluTypes[naluIdx]);
-                if (naluIdx < curTrackMedia->samplesInfo[j].naluTypes.size() - 1)
+                trackInfoFile << mp4GetNaluTypeStr(codecType, curSample.naluTypes[naluIdx]);
+                if (naluIdx < curSample.naluTypes.size() - 1)
                 {
                     trackInfoFile << "|";
                 }
             }
-            trackInfoFile << ", " << curTrackMedia->samplesInfo[j].isKeyFrame << ", " << curTrackMedia->samplesInfo[j].sampleDescriptionIndex;
+            trackInfoFile << ", " << curSample.isKeyFrame << ", " << curSample.sampleDescriptionIndex;
             if (j < curTrackMedia->chunksInfo.size())
             {
                 trackInfoFile << ",," << curTrackMedia->chunksInfo[j].chunkIdx << ","
@@ -103,12 +104,11 @@ int main(int argc, char **argv)
     int fileIdx;
 
     Mp4ParserHandle mp4Parser = createMp4Parser();
-    setMp4ParseLogCallback(
-        [](MP4_LOG_LEVEL_E logLevel, const char *logBuffer)
-        {
-            if (logLevel <= MP4_LOG_LEVEL_INFO)
-                printf("%s", logBuffer);
-        });
+    setMp4ParseLogLevel(MP4_LOG_LEVEL_INFO);
+    setMp4ParseLogCallback([](MP4_LOG_LEVEL_E logLevel, const char *logBuffer) {
+        MP4_UNUSED(logLevel);
+        printf("%s", logBuffer);
+    });
 
     for (fileIdx = 1; fileIdx < argc; ++fileIdx)
     {
@@ -157,6 +157,7 @@ protected:
     std::vector<std::shared_ptr<CommonBox>> mContainBoxes;
 
     friend class MP4ParserImpl;
+    friend struct FragmentSampleLocator;
 };
 using CommonBoxPtr = std::shared_ptr<CommonBox>;
 
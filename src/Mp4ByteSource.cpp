@@ -0,0 +1,121 @@
+#include <string.h>
+
+#include <filesystem>
+
+#include "Mp4Parse.h"
+#include "Mp4ParseTools.h"
+
+namespace fs = std::filesystem;
+
+// pread/mmap through BinaryFileReader::readAt, which is safe to call from several threads
+class FileByteSource : public Mp4ByteSource
+{
+public:
+    int open(std::string filePath, MP4_READ_MODE_E readMode)
+    {
+        CHECK_RET(mReader.open(filePath, readMode));
+        mReaderSize   = mReader.getFileSize();
+        mReportedSize = mReaderSize.load();
+        return 0;
+    }
+
+    std::string getName() const override { return mReader.getFileName(); }
+    // only asks the file system, the reader is grown by the first readAt past the size it knows
+    uint64_t    getSize() override
+    {
+        std::error_code errCode;
+        uint64_t        size = fs::file_size(mReader.getFileFullPath(), errCode);
+        if (errCode)
+        {
+            MP4_ERR("Get file size %s fail %s\n", mReader.getFileFullPath().c_str(), errCode.message().c_str());
+            return 0;
+        }
+        mReportedSize = size;
+        return size;
+    }
+    uint64_t readAt(uint64_t pos, void *buf, uint64_t len) override
+    {
+        // grown only up to a size getSize() reported, reading at the end of file stays a plain read;
+        // updateFileSize() remaps under the reader's lock, readAt calls of other threads keep the old mapping
+        uint64_t reportedSize = mReportedSize;
+        if (pos + len > mReaderSize && mReaderSize < reportedSize && mReader.updateFileSize() >= 0)
+            mReaderSize = reportedSize;
+        return mReader.readAt(pos, buf, len);
+    }
+
+private:
+    BinaryFileReader      mReader;
+    std::atomic<uint64_t> mReaderSize{0};   // the file size mReader knows at least
+    std::atomic<uint64_t> mReportedSize{0}; // the last one getSize() returned
+};
+
+class MemoryByteSource : public Mp4ByteSource
+{
+public:
+    MemoryByteSource(const uint8_t *data, uint64_t size, std::shared_ptr<const void> owner, const std::string &name)
+        : mData(data), mSize(size), mOwner(owner), mName(name)
+    {
+    }
+
+    std::string getName() const override { return mName; }
+    uint64_t    getSize() override { return mSize; }
+    uint64_t    readAt(uint64_t pos, void *buf, uint64_t len) override
+    {
+        if (pos >= mSize)
+            return 0;
+        len = MIN(len, mSize - pos);
+        memcpy(buf, mData + pos, len);
+        return len;
+    }
+    const uint8_t *getData() const override { return mData; }
+
+private:
+    const uint8_t              *mData;
+    uint64_t                    mSize;
+    std::shared_ptr<const void> mOwner;
+    std::string                 mName;
+};
+
+class CallbackByteSource : public Mp4ByteSource
+{
+public:
+    CallbackByteSource(std::function<uint64_t()> getSizeCallback,
+                       std::function<uint64_t(uint64_t, void *, uint64_t)> readAtCallback, const std::string &name)
+        : mGetSizeCallback(getSizeCallback), mReadAtCallback(readAtCallback), mName(name)
+    {
+    }
+
+    std::string getName() const override { return mName; }
+    uint64_t    getSize() override { return mGetSizeCallback(); }
+    uint64_t    readAt(uint64_t pos, void *buf, uint64_t len) override { return mReadAtCallback(pos, buf, len); }
+
+private:
+    std::function<uint64_t()>                           mGetSizeCallback;
+    std::function<uint64_t(uint64_t, void *, uint64_t)> mReadAtCallback;
+    std::string                                         mName;
+};
+
+Mp4ByteSourcePtr createFileByteSource(const std::string &filePath, MP4_READ_MODE_E readMode)
+{
+    auto source = std::make_shared<FileByteSource>();
+    if (source->open(filePath, readMode) < 0)
+        return nullptr;
+    return source;
+}
+
+Mp4ByteSourcePtr createMemoryByteSource(const uint8_t *data, uint64_t size, std::shared_ptr<const void> owner,
+                                        const std::string &name)
+{
+    if (nullptr == data && size > 0)
+        return nullptr;
+    return std::make_shared<MemoryByteSource>(data, size, owner, name);
+}
+
+Mp4ByteSourcePtr createCallbackByteSource(std::function<uint64_t()>                                    getSizeCallback,
+                                          std::function<uint64_t(uint64_t pos, void *buf, uint64_t len)> readAtCallback,
+                                          const std::string                                           &name)
+{
+    if (!getSizeCallback || !readAtCallback)
+        return nullptr;
+    return std::make_shared<CallbackByteSource>(getSizeCallback, readAtCallback, name);
+}
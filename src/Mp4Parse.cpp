@@ -1,7 +1,9 @@
 
+#include <algorithm>
 #include <stdarg.h>
 #include <sstream>
 #include <string.h>
+#include <thread>
 
 #include "Mp4Parse.h"
 #include "Mp4ParseInternal.h"
@@ -134,16 +136,43 @@ void MP4ParserImpl::clear()
 {
     mAvailable = false;
     tracksInfo.clear();
+    mSampleLocators.clear();
+    mFragmentRanges.clear();
+    mNewMoofBoxes.clear();
+    mFragmentNextDts.clear();
     mContainBoxes.clear();
+    mBoxArena = std::make_shared<MonotonicArena>();
 
-    while (!mErrors.empty())
-        mErrors.pop();
+    mDeferSampleTables = false;
+    mDeferredBoxes.clear();
+    mSkippedBoxPos.clear();
+    mScanEndPos = 0;
+
+    mParseProgress = 1.f;
+
+    mSampleIndexKey       = SampleIndexKey();
+    mSampleIndexFromCache = false;
+
+    mStats.reset();
+
+    {
+        std::unique_lock<std::mutex> locker(mErrorMutex);
+        while (!mErrors.empty())
+            mErrors.pop();
+    }
 
     mFileReader.close();
 }
 
+void MP4ParserImpl::pushError(const std::string &err)
+{
+    std::unique_lock<std::mutex> locker(mErrorMutex);
+    mErrors.push(err);
+}
+
 string MP4ParserImpl::getErrorMessage()
 {
+    std::unique_lock<std::mutex> locker(mErrorMutex);
     if (mErrors.empty())
         return "";
     std::string err = mErrors.front();
@@ -152,29 +181,111 @@ string MP4ParserImpl::getErrorMessage()
 };
 
 int MP4ParserImpl::parse(string filepath)
+{
+    return parse(filepath, Mp4ParseOptions());
+}
+
+int MP4ParserImpl::parse(string filepath, const Mp4ParseOptions &options)
 {
     int ret = 0;
 
     clear();
 
-    ret = mFileReader.open(filepath);
+    ScopedTimer timer(mStats.totalUs);
+
+    mOptions = options;
+
+    ret = mFileReader.open(filepath, mOptions.readMode);
     if (ret < 0)
         return ret;
+    setSampleIndexKey(filepath);
 
-    std::unique_lock<std::mutex> locker(mFileMutex);
+    return parseOpened();
+}
 
-    while (mFileReader.getCursorPos() < mFileReader.getFileSize())
+int MP4ParserImpl::parse(Mp4ByteSourcePtr source, const Mp4ParseOptions &options)
+{
+    int ret = 0;
+
+    clear();
+
+    ScopedTimer timer(mStats.totalUs);
+
+    mOptions = options;
+
+    ret = mFileReader.open(source);
+    if (ret < 0)
+        return ret;
+
+    return parseOpened();
+}
+
+int MP4ParserImpl::parseOpened()
+{
+    int ret = 0;
+
+    auto     locker     = lockFile();
+    uint64_t parseStart = steadyClockUs();
+
+    mFileReader.setCacheConfig(mOptions.cacheBlockSize, mOptions.cacheBlockCount, mOptions.readaheadBlocks);
+    mParseProgress = 0.f;
+
+    mDeferSampleTables = mOptions.headerOnly;
+    if (mDeferSampleTables)
     {
-        bool         parseErr = false;
-        CommonBoxPtr curBox   = parseBox(mFileReader, nullptr, parseErr);
-        if (curBox == nullptr)
-            break;
+        while (mFileReader.getCursorPos() < mFileReader.getFileSize())
+        {
+            updateParseProgress();
+
+            // only look at the header, the body is jumped over unless it's ftyp/moov
+            uint32_t type;
+            uint64_t boxPos = mFileReader.getCursorPos();
+            uint64_t boxSize, headerSize;
+            if (peek_box_header(mFileReader, boxPos, type, boxSize, headerSize) < 0)
+                break;
+            if (MP4_BOX_MAKE_TYPE("ftyp") != type && MP4_BOX_MAKE_TYPE("moov") != type)
+            {
+                mSkippedBoxPos.push_back(boxPos);
+                mFileReader.setCursor(boxPos + boxSize);
+                continue;
+            }
+
+            bool         parseErr = false;
+            CommonBoxPtr curBox   = parseBox(mFileReader, nullptr, parseErr);
+            if (curBox == nullptr)
+                break;
+
+            mContainBoxes.push_back(curBox);
 
-        mContainBoxes.push_back(curBox);
+            if (MP4_BOX_MAKE_TYPE("moov") == curBox->mBoxType)
+                break;
+        }
+        mScanEndPos = mFileReader.getCursorPos();
+        updateParseProgress();
+    }
+    else
+    {
+        parseTopLevelBoxes(mContainBoxes);
     }
 
+    mStats.boxParseUs += steadyClockUs() - parseStart;
     locker.unlock();
 
+    ret = generateTracks();
+    if (ret < 0)
+        return ret;
+
+    mAvailable = true;
+
+    mBoxOffset = 0;
+    mBoxSize   = mFileReader.getFileSize();
+
+    return 0;
+}
+
+// tracks from moov, and their sample tables unless Mp4ParseOptions::headerOnly
+int MP4ParserImpl::generateTracks()
+{
     mMp4Type = MP4_TYPE_ISO;
     if (getSubBoxRecursive<CommonBox>("moof") != nullptr || getSubBoxRecursive<CommonBox>("mvex") != nullptr)
         mMp4Type = MP4_TYPE_FRAGMENT;
@@ -304,21 +415,261 @@ int MP4ParserImpl::parse(string filepath)
         MP4_PARSE_ERR("get moov fail\n");
     }
 
-    for (unsigned int i = 0; i < tracksInfo.size(); ++i)
+    if (!mDeferSampleTables)
+        mSampleIndexFromCache = loadSampleIndexCache() == 0;
+
+    // one walk over the moof boxes for all tracks
+    mNewMoofBoxes = takeCompleteMoofBoxes(mContainBoxes);
+    if (!mDeferSampleTables && !mSampleIndexFromCache && !mOptions.lazySampleTable && MP4_TYPE_FRAGMENT == mMp4Type)
+        collectFragmentSamples();
+
+    // tracks don't depend on each other once moov is parsed
+    std::atomic<bool> trackFailed(false);
+    mSampleLocators.resize(tracksInfo.size());
+    runTasks(mOptions.threadCount, tracksInfo.size(), [&](size_t trackIdx) {
+        if (generateInfoTable((uint32_t)trackIdx) < 0)
+            trackFailed = true;
+    });
+    mFragmentRanges.clear();
+    mNewMoofBoxes.clear();
+
+    if (!mDeferSampleTables && !mSampleIndexFromCache && !trackFailed)
+        saveSampleIndexCache();
+
+    return 0;
+}
+
+int MP4ParserImpl::loadSampleTables()
+{
+    if (!mAvailable)
+        return -1;
+
+    ScopedTimer timer(mStats.totalUs);
+
+    // both held to the end, the deferred boxes and the tables are filled in while sample getters wait
+    auto locker    = lockFile();
+    auto tableLock = lockTablesExclusive();
+    if (!mDeferSampleTables)
+        return 0;
+    mDeferSampleTables  = false;
+    uint64_t parseStart = steadyClockUs();
+
+    // sdtp needs the sample count from stsz/stz2, parse it after them
+    vector<CommonBoxPtr> stblWithSdtp;
+    for (auto &box : mDeferredBoxes)
+    {
+        if (MP4_BOX_MAKE_TYPE("sdtp") == box->mBoxType)
+        {
+            stblWithSdtp.push_back(box->getUpperBox());
+            continue;
+        }
+        mFileReader.setCursor(box->mBodyPos);
+        if (box->parse(mFileReader, box->mBoxOffset, box->mBoxSize, box->mBodySize) < 0)
+        {
+            MP4_PARSE_ERR("%s parse fail\n", boxType2Str(box->mBoxType).c_str());
+            box->mInvalid = true;
+        }
+        countParsedBox(box);
+    }
+    for (auto &stbl : stblWithSdtp)
     {
-        generateInfoTable(i);
+        if (stbl != nullptr)
+            parseSdtp(mFileReader, stbl);
     }
+    mDeferredBoxes.clear();
 
-    mAvailable = true;
+    for (auto boxPos : mSkippedBoxPos)
+    {
+        bool parseErr = false;
+        mFileReader.setCursor(boxPos);
+        CommonBoxPtr curBox = parseTopLevelBox(parseErr);
+        if (curBox != nullptr)
+            mContainBoxes.push_back(curBox);
+    }
+    mSkippedBoxPos.clear();
 
-    mBoxOffset = 0;
-    mBoxSize   = mFileReader.getFileSize();
+    parseTopLevelBoxes(mContainBoxes);
+    std::stable_sort(mContainBoxes.begin(), mContainBoxes.end(),
+                     [](const CommonBoxPtr &a, const CommonBoxPtr &b) { return a->mBoxOffset < b->mBoxOffset; });
+
+    mStats.boxParseUs += steadyClockUs() - parseStart;
+
+    if (getSubBoxRecursive<CommonBox>("moof") != nullptr)
+        mMp4Type = MP4_TYPE_FRAGMENT;
+
+    mSampleIndexFromCache = loadSampleIndexCache() == 0;
+
+    mNewMoofBoxes = takeCompleteMoofBoxes(mContainBoxes);
+    if (!mSampleIndexFromCache && !mOptions.lazySampleTable && MP4_TYPE_FRAGMENT == mMp4Type)
+        collectFragmentSamples();
+
+    std::atomic<bool>    trackFailed(false);
+    vector<CommonBoxPtr> trakBoxes = getSubBox("moov")->getSubBoxes("trak");
+    runTasks(mOptions.threadCount, MIN(tracksInfo.size(), trakBoxes.size()), [&](size_t trackIdx) {
+        if (!mSampleIndexFromCache && generateSampleTable((uint32_t)trackIdx) < 0)
+        {
+            trackFailed = true;
+            return;
+        }
+        if (tracksInfo[trackIdx]->mediaInfo != nullptr)
+            tracksInfo[trackIdx]->mediaInfo->getInfoFromTrack(trakBoxes[trackIdx], tracksInfo[trackIdx]);
+    });
+
+    mFragmentRanges.clear();
+    mNewMoofBoxes.clear();
+
+    if (!mSampleIndexFromCache && !trackFailed)
+        saveSampleIndexCache();
 
     return 0;
 }
 
+vector<CommonBoxPtr> MP4ParserImpl::takeCompleteMoofBoxes(const vector<CommonBoxPtr> &boxes)
+{
+    // a moof is only taken once the box after it (its mdat) is complete too,
+    // the samples of a moof whose mdat is still being written are not in the file yet
+    vector<CommonBoxPtr> moofBoxes;
+    for (size_t boxIdx = 0; boxIdx < boxes.size(); ++boxIdx)
+    {
+        const CommonBoxPtr &curBox = boxes[boxIdx];
+        if (curBox->mBoxOffset >= mScanEndPos)
+            break;
+        if (MP4_BOX_MAKE_TYPE("moof") != curBox->mBoxType)
+            continue;
+        if (boxIdx + 1 >= boxes.size() || boxes[boxIdx + 1]->mBoxOffset >= mScanEndPos)
+        {
+            mScanEndPos = curBox->mBoxOffset;
+            break;
+        }
+        moofBoxes.push_back(curBox);
+    }
+    return moofBoxes;
+}
+
+void MP4ParserImpl::parseTopLevelBoxes(vector<CommonBoxPtr> &boxes)
+{
+    mFileReader.setCursor(mScanEndPos);
+    while (mFileReader.getCursorPos() < mFileReader.getFileSize())
+    {
+        bool         parseErr = false;
+        CommonBoxPtr curBox   = parseTopLevelBox(parseErr);
+        if (curBox == nullptr)
+            break;
+
+        boxes.push_back(curBox);
+
+        // cut short by the end of file, the file may still be being written
+        if (curBox->mBoxOffset + curBox->mBoxSize > mFileReader.getFileSize())
+            break;
+        mScanEndPos = curBox->mBoxOffset + curBox->mBoxSize;
+    }
+    updateParseProgress();
+}
+
+void MP4ParserImpl::updateParseProgress()
+{
+    uint64_t fileSize = mFileReader.getFileSize();
+    mParseProgress    = 0 == fileSize ? 1.f : (float)MIN(mFileReader.getCursorPos(), fileSize) / fileSize;
+}
+
+int MP4ParserImpl::refresh()
+{
+    if (!mAvailable)
+        return -1;
+    if (mDeferSampleTables)
+    {
+        MP4_PARSE_ERR("sample tables not loaded\n");
+        return -1;
+    }
+    if (MP4_TYPE_FRAGMENT != mMp4Type)
+    {
+        MP4_PARSE_ERR("only fragmented files can be refreshed\n");
+        return -1;
+    }
+
+    ScopedTimer timer(mStats.totalUs);
+
+    // held to the end, so refresh() and loadSampleTables() don't overlap
+    auto locker = lockFile();
+
+    int ret;
+    {
+        // sample getters check the file size
+        auto tableLock = lockTablesExclusive();
+        ret            = mFileReader.updateFileSize();
+    }
+    if (ret <= 0)
+        return ret;
+    uint64_t parseStart = steadyClockUs();
+
+    // boxes from mScanEndPos on were incomplete, parse them again; the new ones are kept aside meanwhile,
+    // sample getters go on with the box tree and the tables as they were
+    uint64_t             scanStart = mScanEndPos;
+    vector<CommonBoxPtr> newBoxes;
+    parseTopLevelBoxes(newBoxes);
+    mNewMoofBoxes = takeCompleteMoofBoxes(newBoxes);
+
+    mStats.boxParseUs += steadyClockUs() - parseStart;
+
+    // the new moof boxes are walked before the tables are taken, so the getters only wait while they're appended
+    int newMoofCount = (int)mNewMoofBoxes.size();
+    if (newMoofCount > 0 && !mOptions.lazySampleTable)
+        ret = collectFragmentSamples();
+    else if (newMoofCount > 0)
+        ret = prepareSampleLocators();
+
+    auto tableLock = lockTablesExclusive();
+    while (!mContainBoxes.empty() && mContainBoxes.back()->mBoxOffset >= scanStart)
+        mContainBoxes.pop_back();
+    mContainBoxes.insert(mContainBoxes.end(), newBoxes.begin(), newBoxes.end());
+
+    if (ret < 0)
+    {
+        mFragmentRanges.clear();
+        mNewMoofBoxes.clear();
+        return -1;
+    }
+    if (0 == newMoofCount)
+        return 0;
+
+    std::atomic<bool>    trackFailed(false);
+    vector<CommonBoxPtr> trakBoxes = getSubBox("moov")->getSubBoxes("trak");
+    runTasks(mOptions.threadCount, MIN(tracksInfo.size(), trakBoxes.size()), [&](size_t trackIdx) {
+        if (generateSampleTable((uint32_t)trackIdx) < 0)
+        {
+            trackFailed = true;
+            return;
+        }
+        if (tracksInfo[trackIdx]->mediaInfo != nullptr)
+            tracksInfo[trackIdx]->mediaInfo->getInfoFromTrack(trakBoxes[trackIdx], tracksInfo[trackIdx]);
+    });
+
+    mFragmentRanges.clear();
+    mNewMoofBoxes.clear();
+
+    if (trackFailed)
+    {
+        MP4_PARSE_ERR("sample table of a track not extended\n");
+        return -1;
+    }
+    return newMoofCount;
+}
+
+int MP4ParserImpl::prepareSampleLocators()
+{
+    std::atomic<bool> trackFailed(false);
+    runTasks(mOptions.threadCount, MIN(tracksInfo.size(), mSampleLocators.size()), [&](size_t trackIdx) {
+        auto fragLocator = std::dynamic_pointer_cast<FragmentSampleLocator>(mSampleLocators[trackIdx]);
+        if (fragLocator != nullptr && fragLocator->prepare(mNewMoofBoxes) < 0)
+            trackFailed = true;
+    });
+    return trackFailed ? -1 : 0;
+}
+
 bool MP4ParserImpl::isTrackHasProperty(uint32_t trackIdx, MP4_TRACK_PROPERTY_E prop) const
 {
+    auto tableLock = lockTablesShared();
+
     CommonBoxPtr         moov      = getSubBox("moov");
     vector<CommonBoxPtr> trakBoxes = moov->getSubBoxes("trak");
     if (trackIdx >= trakBoxes.size())
@@ -333,6 +684,131 @@ bool MP4ParserImpl::isTrackHasProperty(uint32_t trackIdx, MP4_TRACK_PROPERTY_E p
         return false;
 }
 
+int MP4ParserImpl::getSampleItem(uint32_t trackIdx, uint64_t sampleIdx, Mp4SampleItem &item) const
+{
+    if (trackIdx >= tracksInfo.size() || nullptr == tracksInfo[trackIdx]->mediaInfo)
+        return -1;
+
+    if (trackIdx < mSampleLocators.size() && mSampleLocators[trackIdx] != nullptr)
+        return mSampleLocators[trackIdx]->getSampleItem(sampleIdx, item);
+
+    const Mp4SampleIndex &samplesInfo = tracksInfo[trackIdx]->mediaInfo->samplesInfo;
+    if (sampleIdx >= samplesInfo.size())
+        return -1;
+    samplesInfo.getItem(sampleIdx, item, false);
+    return 0;
+}
+
+int MP4ParserImpl::getSampleInfo(uint32_t trackIdx, uint64_t sampleIdx, Mp4SampleItem &sampleInfo) const
+{
+    auto tableLock = lockTablesShared();
+
+    if (!mAvailable)
+        return -1;
+
+    if (trackIdx < mSampleLocators.size() && mSampleLocators[trackIdx] != nullptr)
+        return getSampleItem(trackIdx, sampleIdx, sampleInfo);
+
+    if (trackIdx >= tracksInfo.size() || nullptr == tracksInfo[trackIdx]->mediaInfo)
+        return -1;
+
+    const Mp4SampleIndex &samplesInfo = tracksInfo[trackIdx]->mediaInfo->samplesInfo;
+    if (sampleIdx >= samplesInfo.size())
+        return -1;
+
+    std::lock_guard<std::mutex> lock(mNaluInfoMutex);
+    samplesInfo.getItem(sampleIdx, sampleInfo, true);
+    return 0;
+}
+
+int64_t MP4ParserImpl::scanKeyFrame(uint32_t trackIdx, int64_t sampleIdx, bool forward) const
+{
+    Mp4SampleItem item;
+    for (; sampleIdx >= 0; sampleIdx += forward ? 1 : -1)
+    {
+        if (getSampleItem(trackIdx, (uint64_t)sampleIdx, item) < 0)
+            return -1;
+        if (item.isKeyFrame != 0)
+            return sampleIdx;
+    }
+    return -1;
+}
+
+int64_t MP4ParserImpl::findSampleByTime(uint32_t trackIdx, uint64_t timeMs, MP4_SEEK_MODE_E mode) const
+{
+    auto tableLock = lockTablesShared();
+
+    if (!mAvailable || trackIdx >= tracksInfo.size() || nullptr == tracksInfo[trackIdx]->mediaInfo)
+        return -1;
+
+    const Mp4MediaInfo *mediaInfo = tracksInfo[trackIdx]->mediaInfo.get();
+    if (0 == mediaInfo->sampleCount)
+        return -1;
+
+    // last sample not after timeMs
+    SampleLocatorPtr locator   = trackIdx < mSampleLocators.size() ? mSampleLocators[trackIdx] : nullptr;
+    int64_t          sampleIdx = locator != nullptr ? locator->findSampleByDts(timeMs) : mediaInfo->samplesInfo.findByDts(timeMs);
+
+    Mp4SampleItem item;
+    switch (mode)
+    {
+        case MP4_SEEK_MODE_NEAREST:
+        {
+            if (sampleIdx < 0)
+                return 0;
+            if ((uint64_t)sampleIdx + 1 >= mediaInfo->sampleCount)
+                return sampleIdx;
+
+            CHECK_RET(getSampleItem(trackIdx, (uint64_t)sampleIdx, item));
+            uint64_t prevDiff = timeMs - item.dtsMs;
+            CHECK_RET(getSampleItem(trackIdx, (uint64_t)sampleIdx + 1, item));
+            return item.dtsMs - timeMs < prevDiff ? sampleIdx + 1 : sampleIdx;
+        }
+        case MP4_SEEK_MODE_PREV_KEYFRAME:
+        {
+            if (sampleIdx < 0)
+                return -1;
+
+            const std::vector<uint64_t> &syncTable = mediaInfo->syncSampleTable;
+            if (syncTable.empty() && locator != nullptr)
+                return locator->findKeySample((uint64_t)sampleIdx, false);
+            if (syncTable.empty())
+                return scanKeyFrame(trackIdx, sampleIdx, false);
+
+            auto it = std::upper_bound(syncTable.begin(), syncTable.end(), (uint64_t)sampleIdx);
+            if (it == syncTable.begin())
+                return -1;
+            return (int64_t)*(it - 1);
+        }
+        case MP4_SEEK_MODE_NEXT_KEYFRAME:
+        {
+            // first sample not before timeMs
+            uint64_t firstIdx = 0;
+            if (sampleIdx >= 0)
+            {
+                CHECK_RET(getSampleItem(trackIdx, (uint64_t)sampleIdx, item));
+                firstIdx = item.dtsMs == timeMs ? (uint64_t)sampleIdx : (uint64_t)sampleIdx + 1;
+            }
+            if (firstIdx >= mediaInfo->sampleCount)
+                return -1;
+
+            const std::vector<uint64_t> &syncTable = mediaInfo->syncSampleTable;
+            if (syncTable.empty() && locator != nullptr)
+                return locator->findKeySample(firstIdx, true);
+            if (syncTable.empty())
+                return scanKeyFrame(trackIdx, (int64_t)firstIdx, true);
+
+            auto it = std::lower_bound(syncTable.begin(), syncTable.end(), firstIdx);
+            if (it == syncTable.end())
+                return -1;
+            return (int64_t)*it;
+        }
+        default:
+            MP4_ERR("unknown seek mode %d\n", mode);
+            return -1;
+    }
+}
+
 void copySampleInfo(const Mp4SampleItem &src, Mp4RawSample &dst)
 {
     dst.sampleIdx  = src.sampleIdx;
@@ -343,40 +819,160 @@ void copySampleInfo(const Mp4SampleItem &src, Mp4RawSample &dst)
     dst.ptsMs = src.ptsMs;
 }
 
-int MP4ParserImpl::getSample(uint32_t trackIdx, uint32_t sampleIdx, Mp4RawSample &outSample)
+// buf if it's given and large enough for dataSize, otherwise a new sampleData
+static uint8_t *sampleBuffer(Mp4RawSample &sample, uint8_t *buf, uint64_t bufSize)
+{
+    if (nullptr == buf)
+    {
+        sample.sampleData = shared_ptr<uint8_t[]>(new uint8_t[sample.dataSize]);
+        return sample.sampleData.get();
+    }
+
+    sample.sampleData.reset();
+    return sample.dataSize <= bufSize ? buf : nullptr;
+}
+
+int MP4ParserImpl::getSample(uint32_t trackIdx, uint32_t sampleIdx, Mp4RawSample &outSample, uint8_t *buf, uint64_t bufSize)
+{
+    auto tableLock = lockTablesShared();
+    return readSample(trackIdx, sampleIdx, outSample, buf, bufSize);
+}
+
+int MP4ParserImpl::readSample(uint32_t trackIdx, uint32_t sampleIdx, Mp4RawSample &outSample, uint8_t *buf, uint64_t bufSize)
 {
     if (!mAvailable)
         return -1;
 
-    if (trackIdx >= tracksInfo.size())
+    Mp4SampleItem curSample;
+    if (getSampleItem(trackIdx, sampleIdx, curSample) < 0)
         return -1;
 
-    if (sampleIdx >= tracksInfo[trackIdx]->mediaInfo->samplesInfo.size())
+    outSample.trackIdx = trackIdx;
+    copySampleInfo(curSample, outSample);
+
+    uint8_t *sampleData = sampleBuffer(outSample, buf, bufSize);
+    if (nullptr == sampleData)
+        return MP4_BUFFER_TOO_SMALL;
+
+    if (mFileReader.readAt(outSample.fileOffset, sampleData, outSample.sampleSize) != outSample.sampleSize)
+    {
+        MP4_PARSE_ERR("read sample %" PRIu32 " of track %" PRIu32 " fail\n", sampleIdx, trackIdx);
         return -1;
+    }
+    return 0;
+}
 
-    Mp4SampleItem *curSample = &tracksInfo[trackIdx]->mediaInfo->samplesInfo[sampleIdx];
-    outSample.trackIdx       = trackIdx;
-    copySampleInfo(*curSample, outSample);
+int MP4ParserImpl::getSampleView(uint32_t trackIdx, uint64_t sampleIdx, Mp4SampleView &view) const
+{
+    auto tableLock = lockTablesShared();
 
-    outSample.sampleData = shared_ptr<uint8_t[]>(new uint8_t[outSample.dataSize]);
+    if (!mAvailable)
+        return -1;
 
-    std::unique_lock<std::mutex> locker(mFileMutex);
+    if (mFileReader.getReadMode() != MP4_READ_MODE_MMAP)
+    {
+        MP4_ERR("sample view needs the file in memory\n");
+        return -1;
+    }
+
+    Mp4SampleItem curSample;
+    if (getSampleItem(trackIdx, sampleIdx, curSample) < 0)
+        return -1;
+
+    view.data = mFileReader.getMappedData(curSample.sampleOffset, curSample.sampleSize);
+    if (nullptr == view.data)
+    {
+        MP4_ERR("sample %" PRIu64 " of track %" PRIu32 " out of file\n", sampleIdx, trackIdx);
+        return -1;
+    }
+
+    view.trackIdx   = trackIdx;
+    view.sampleIdx  = sampleIdx;
+    view.fileOffset = curSample.sampleOffset;
+    view.sampleSize = curSample.sampleSize;
+    view.dtsMs      = curSample.dtsMs;
+    view.ptsMs      = curSample.ptsMs;
 
-    mFileReader.readAt(outSample.fileOffset, outSample.sampleData.get(), outSample.sampleSize);
     return 0;
 }
 
-int MP4ParserImpl::getH26xFrame(uint32_t trackIdx, uint32_t sampleIdx, Mp4VideoFrame &outFrame)
+int MP4ParserImpl::getSamples(uint32_t trackIdx, uint64_t firstIdx, uint64_t count, std::vector<Mp4RawSample> &outSamples)
+{
+    auto tableLock = lockTablesShared();
+
+    outSamples.clear();
+    if (!mAvailable || trackIdx >= tracksInfo.size() || nullptr == tracksInfo[trackIdx]->mediaInfo)
+        return -1;
+
+    uint64_t sampleCount = tracksInfo[trackIdx]->mediaInfo->sampleCount;
+    if (firstIdx >= sampleCount)
+        return -1;
+    count = MIN(count, sampleCount - firstIdx);
+
+    outSamples.resize(count);
+    uint64_t      totalSize = 0;
+    Mp4SampleItem curSample;
+    for (uint64_t i = 0; i < count; i++)
+    {
+        if (getSampleItem(trackIdx, firstIdx + i, curSample) < 0)
+        {
+            outSamples.clear();
+            return -1;
+        }
+        outSamples[i].trackIdx = trackIdx;
+        copySampleInfo(curSample, outSamples[i]);
+        totalSize += curSample.sampleSize;
+    }
+
+    shared_ptr<uint8_t[]> arena(new uint8_t[MAX(totalSize, (uint64_t)1)]);
+
+    // samples are laid out in the arena in index order, a run contiguous in the file is contiguous there too
+    uint64_t arenaPos = 0;
+    for (uint64_t runStart = 0; runStart < count;)
+    {
+        uint64_t runEnd  = runStart + 1;
+        uint64_t runSize = outSamples[runStart].sampleSize;
+        while (runEnd < count && outSamples[runEnd].fileOffset == outSamples[runStart].fileOffset + runSize)
+        {
+            runSize += outSamples[runEnd].sampleSize;
+            runEnd++;
+        }
+
+        if (mFileReader.readAt(outSamples[runStart].fileOffset, arena.get() + arenaPos, runSize) != runSize)
+        {
+            MP4_PARSE_ERR("read samples %" PRIu64 "-%" PRIu64 " of track %" PRIu32 " fail\n", firstIdx + runStart,
+                          firstIdx + runEnd - 1, trackIdx);
+            outSamples.clear();
+            return -1;
+        }
+
+        for (uint64_t i = runStart; i < runEnd; i++)
+        {
+            outSamples[i].sampleData = shared_ptr<uint8_t[]>(arena, arena.get() + arenaPos);
+            arenaPos += outSamples[i].sampleSize;
+        }
+        runStart = runEnd;
+    }
+
+    return 0;
+}
+
+int MP4ParserImpl::getH26xFrame(uint32_t trackIdx, uint32_t sampleIdx, Mp4VideoFrame &outFrame, uint8_t *buf, uint64_t bufSize)
 {
     CommonBoxPtr         moov       = getSubBox("moov");
     vector<CommonBoxPtr> trakBoxes  = moov->getSubBoxes("trak");
     CommonBoxPtr         curTrakBox = trakBoxes[trackIdx];
     TrackHeaderBoxPtr    tkhd       = curTrakBox->getSubBox<TrackHeaderBox>("tkhd");
 
-    Mp4SampleItem *pCurSample = &tracksInfo[trackIdx]->mediaInfo->samplesInfo[sampleIdx];
-    uint64_t       samplePos  = pCurSample->sampleOffset;
-    uint64_t       sampleSize = pCurSample->sampleSize;
-    bool           attachNalu = false;
+    Mp4SampleItem curSample;
+    if (getSampleItem(trackIdx, sampleIdx, curSample) < 0)
+    {
+        MP4_PARSE_ERR("sample %" PRIu32 " of track %" PRIu32 " not found\n", sampleIdx, trackIdx);
+        return -1;
+    }
+    uint64_t samplePos  = curSample.sampleOffset;
+    uint64_t sampleSize = curSample.sampleSize;
+    bool     attachNalu = false;
 
     if (samplePos + sampleSize > mFileReader.getFileSize())
     {
@@ -385,7 +981,7 @@ int MP4ParserImpl::getH26xFrame(uint32_t trackIdx, uint32_t sampleIdx, Mp4VideoF
         return -1;
     }
 
-    if (pCurSample->isKeyFrame > 0)
+    if (curSample.isKeyFrame > 0)
     {
         attachNalu = true;
     }
@@ -401,14 +997,14 @@ int MP4ParserImpl::getH26xFrame(uint32_t trackIdx, uint32_t sampleIdx, Mp4VideoF
         return -1;
     }
 
-    if (pCurSample->sampleDescriptionIndex - 1 >= stsd->mContainBoxes.size())
+    if (curSample.sampleDescriptionIndex - 1 >= stsd->mContainBoxes.size())
     {
-        MP4_PARSE_ERR("sample description index %d out of range %zu\n", pCurSample->sampleDescriptionIndex,
+        MP4_PARSE_ERR("sample description index %d out of range %zu\n", curSample.sampleDescriptionIndex,
                       stsd->mContainBoxes.size());
         return -1;
     }
 
-    CommonBoxPtr curSampleEntry = stsd->mContainBoxes[pCurSample->sampleDescriptionIndex - 1];
+    CommonBoxPtr curSampleEntry = stsd->mContainBoxes[curSample.sampleDescriptionIndex - 1];
 
     // TODO：support mutiple smaple entrys in stsd
     switch (getCompatibleBoxType(curSampleEntry->mBoxType))
@@ -477,12 +1073,13 @@ int MP4ParserImpl::getH26xFrame(uint32_t trackIdx, uint32_t sampleIdx, Mp4VideoF
             break;
     }
     outFrame.trackIdx = trackIdx;
-    copySampleInfo(*pCurSample, outFrame);
+    copySampleInfo(curSample, outFrame);
     outFrame.dataSize += attachSize;
-    outFrame.sampleData = shared_ptr<uint8_t[]>(new uint8_t[outFrame.dataSize]);
 
-    uint8_t *frameData = outFrame.sampleData.get();
+    uint8_t *frameData = sampleBuffer(outFrame, buf, bufSize);
     uint64_t copyPos   = 0;
+    if (nullptr == frameData)
+        return MP4_BUFFER_TOO_SMALL;
 
     uint32_t numNaluAttach = (uint32_t)naluAttach.size();
     for (unsigned int i = 0; i < numNaluAttach; ++i)
@@ -503,17 +1100,31 @@ int MP4ParserImpl::getH26xFrame(uint32_t trackIdx, uint32_t sampleIdx, Mp4VideoF
         copyPos += naluAttach[i].length;
     }
 
-    std::unique_lock<std::mutex> locker(mFileMutex);
+    // with 4-byte nalu length the sample is read in place and each length is overwritten by a start code
+    uint8_t   *naluSrc = frameData + copyPos;
+    BinaryData sampleBuf;
+    if (4 != lengthSize)
+    {
+        sampleBuf.create(sampleSize);
+        naluSrc = sampleBuf.ptr();
+    }
+    if (mFileReader.readAt(samplePos, naluSrc, sampleSize) != sampleSize)
+    {
+        MP4_PARSE_ERR("read sample %" PRIu32 " of track %" PRIu32 " fail\n", sampleIdx, trackIdx);
+        return -1;
+    }
 
-    uint64_t pos = mFileReader.getCursorPos();
-    mFileReader.setCursor(samplePos);
-    while (sampleSize > 0)
+    uint64_t srcPos = 0;
+    while (srcPos + lengthSize <= sampleSize)
     {
         uint32_t naluSize = 0;
+        for (uint16_t i = 0; i < lengthSize; i++)
+        {
+            naluSize = (naluSize << 8) | naluSrc[srcPos + i];
+        }
+        srcPos += lengthSize;
 
-        naluSize = (uint32_t)mFileReader.readUnsigned(lengthSize, true);
-
-        if (copyPos + 4 + naluSize > outFrame.dataSize)
+        if (naluSize > sampleSize - srcPos || copyPos + 4 + naluSize > outFrame.dataSize)
         {
             MP4_PARSE_ERR("out of data size %" PRIu64 " + 4 + %" PRIu32 " > %" PRIu64 "\n", copyPos, naluSize, outFrame.dataSize);
             return -1;
@@ -525,12 +1136,11 @@ int MP4ParserImpl::getH26xFrame(uint32_t trackIdx, uint32_t sampleIdx, Mp4VideoF
         frameData[copyPos + 3] = 1;
 
         copyPos += 4;
-        sampleSize -= 4;
-        mFileReader.read(frameData + copyPos, naluSize);
+        if (frameData + copyPos != naluSrc + srcPos)
+            memmove(frameData + copyPos, naluSrc + srcPos, naluSize);
         copyPos += naluSize;
-        sampleSize -= naluSize;
+        srcPos += naluSize;
     }
-    mFileReader.setCursor(pos);
 
     outFrame.mediaType  = MP4_MEDIA_TYPE_VIDEO;
     outFrame.codec      = mp4GetCodecType(tracksInfo[trackIdx]->mediaInfo->codecCode);
@@ -541,12 +1151,15 @@ int MP4ParserImpl::getH26xFrame(uint32_t trackIdx, uint32_t sampleIdx, Mp4VideoF
     return 0;
 }
 
-int MP4ParserImpl::getVideoSample(uint32_t trackIdx, uint32_t sampleIdx, Mp4VideoFrame &outFrame)
+int MP4ParserImpl::getVideoSample(uint32_t trackIdx, uint32_t sampleIdx, Mp4VideoFrame &outFrame, uint8_t *buf,
+                                  uint64_t bufSize)
 {
+    auto tableLock = lockTablesShared();
+
     auto codecType = mp4GetCodecType(tracksInfo[trackIdx]->mediaInfo->codecCode);
     if (MP4_CODEC_H264 == codecType || MP4_CODEC_HEVC == codecType)
     {
-        return getH26xFrame(trackIdx, sampleIdx, outFrame);
+        return getH26xFrame(trackIdx, sampleIdx, outFrame, buf, bufSize);
     }
     else
     {
@@ -555,14 +1168,21 @@ int MP4ParserImpl::getVideoSample(uint32_t trackIdx, uint32_t sampleIdx, Mp4Vide
         CommonBoxPtr         pCurTrakBox = trakBoxes[trackIdx];
         TrackHeaderBoxPtr    tkhd        = pCurTrakBox->getSubBox<TrackHeaderBox>("tkhd");
 
-        Mp4SampleItem *curSample = &tracksInfo[trackIdx]->mediaInfo->samplesInfo[sampleIdx];
-        if (curSample->sampleOffset + curSample->sampleSize > mFileReader.getFileSize())
+        Mp4SampleItem curSample;
+        if (getSampleItem(trackIdx, sampleIdx, curSample) < 0)
+        {
+            MP4_PARSE_ERR("sample %" PRIu32 " of track %" PRIu32 " not found\n", sampleIdx, trackIdx);
+            return -1;
+        }
+        if (curSample.sampleOffset + curSample.sampleSize > mFileReader.getFileSize())
         {
-            MP4_PARSE_ERR("sample pos %" PRIu64 " + size %" PRIu64 " out of file size %" PRIu64 "\n", curSample->sampleOffset,
-                          curSample->sampleSize, mFileReader.getFileSize());
+            MP4_PARSE_ERR("sample pos %" PRIu64 " + size %" PRIu64 " out of file size %" PRIu64 "\n", curSample.sampleOffset,
+                          curSample.sampleSize, mFileReader.getFileSize());
             return -1;
         }
-        int ret = getSample(trackIdx, sampleIdx, outFrame);
+        int ret = readSample(trackIdx, sampleIdx, outFrame, buf, bufSize);
+        if (MP4_BUFFER_TOO_SMALL == ret)
+            return ret;
         if (ret < 0)
         {
             MP4_PARSE_ERR("get sample fail trackIdx %" PRIu32 " sampleIdx %" PRIu32 "\n", trackIdx, sampleIdx);
@@ -581,7 +1201,7 @@ int MP4ParserImpl::getVideoSample(uint32_t trackIdx, uint32_t sampleIdx, Mp4Vide
 
         outFrame.width      = (unsigned int)tkhd->width;
         outFrame.height     = (unsigned int)tkhd->height;
-        outFrame.isKeyFrame = curSample->isKeyFrame;
+        outFrame.isKeyFrame = curSample.isKeyFrame;
     }
 
     return 0;
@@ -660,13 +1280,24 @@ int writeAdts(uint8_t *buf, uint8_t codec, uint64_t size, int sampleRate, int ch
     return 0;
 }
 
-int MP4ParserImpl::getAudioSample(uint32_t trackIdx, uint32_t sampleIdx, Mp4AudioFrame &outFrame)
+int MP4ParserImpl::getAudioSample(uint32_t trackIdx, uint32_t sampleIdx, Mp4AudioFrame &outFrame, uint8_t *buf,
+                                  uint64_t bufSize)
 {
-    Mp4SampleItem *curSample = &tracksInfo[trackIdx]->mediaInfo->samplesInfo[sampleIdx];
+    auto tableLock = lockTablesShared();
 
-    copySampleInfo(*curSample, outFrame);
+    Mp4SampleItem curSample;
+    if (getSampleItem(trackIdx, sampleIdx, curSample) < 0)
+    {
+        MP4_PARSE_ERR("sample %" PRIu32 " of track %" PRIu32 " not found\n", sampleIdx, trackIdx);
+        return -1;
+    }
+
+    copySampleInfo(curSample, outFrame);
     outFrame.dataSize += ADTS_HEAD_SIZE;
-    outFrame.sampleData = shared_ptr<uint8_t[]>(new uint8_t[outFrame.dataSize]);
+
+    uint8_t *frameData = sampleBuffer(outFrame, buf, bufSize);
+    if (nullptr == frameData)
+        return MP4_BUFFER_TOO_SMALL;
 
     shared_ptr<Mp4AudioInfo> audioInfo = dynamic_pointer_cast<Mp4AudioInfo>(tracksInfo[trackIdx]->mediaInfo);
     if (audioInfo == nullptr)
@@ -675,11 +1306,13 @@ int MP4ParserImpl::getAudioSample(uint32_t trackIdx, uint32_t sampleIdx, Mp4Audi
         MP4_PARSE_ERR("cast fail %s\n", typeid(*rawPtr).name());
         return -1;
     }
-    writeAdts(outFrame.sampleData.get(), audioInfo->codecCode, outFrame.sampleSize, audioInfo->audioSampleRate,
-              audioInfo->channels);
+    writeAdts(frameData, audioInfo->codecCode, outFrame.sampleSize, audioInfo->audioSampleRate, audioInfo->channels);
 
-    std::unique_lock<std::mutex> locker(mFileMutex);
-    mFileReader.readAt(outFrame.fileOffset, outFrame.sampleData.get() + ADTS_HEAD_SIZE, outFrame.sampleSize);
+    if (mFileReader.readAt(outFrame.fileOffset, frameData + ADTS_HEAD_SIZE, outFrame.sampleSize) != outFrame.sampleSize)
+    {
+        MP4_PARSE_ERR("read sample %" PRIu32 " of track %" PRIu32 " fail\n", sampleIdx, trackIdx);
+        return -1;
+    }
 
     outFrame.mediaType       = MP4_MEDIA_TYPE_AUDIO;
     outFrame.codec           = mp4GetCodecType(audioInfo->codecCode);
@@ -692,6 +1325,8 @@ int MP4ParserImpl::getAudioSample(uint32_t trackIdx, uint32_t sampleIdx, Mp4Audi
 
 string MP4ParserImpl::getBasicInfoString() const
 {
+    auto tableLock = lockTablesShared();
+
     stringstream infoString;
 
     if (!mAvailable)
@@ -777,6 +1412,8 @@ std::shared_ptr<Mp4BoxData> Mp4TrackInfo::getData(std::shared_ptr<Mp4BoxData> sr
 
 std::shared_ptr<Mp4BoxData> MP4ParserImpl::getData(std::shared_ptr<Mp4BoxData> src) const
 {
+    auto tableLock = lockTablesShared();
+
     std::shared_ptr<Mp4BoxData> item = nullptr;
     if (nullptr == src)
         item = Mp4BoxData::createKeyValuePairsData();
@@ -822,15 +1459,141 @@ std::shared_ptr<Mp4BoxData> MP4ParserImpl::getData(std::shared_ptr<Mp4BoxData> s
 }
 float MP4ParserImpl::getParseProgress()
 {
+    return mParseProgress;
+}
+
+std::unique_lock<std::mutex> MP4ParserImpl::lockFile()
+{
+    std::unique_lock<std::mutex> locker(mFileMutex, std::try_to_lock);
+    if (!locker.owns_lock())
+    {
+        uint64_t waitStart = steadyClockUs();
+        locker.lock();
+        mStats.fileLockWaitUs += steadyClockUs() - waitStart;
+        mStats.fileLockContended++;
+    }
+    mStats.fileLockCount++;
+    return locker;
+}
+
+std::shared_lock<std::shared_mutex> MP4ParserImpl::lockTablesShared() const
+{
+    // the shared_mutex may prefer readers, new ones let a waiting writer go first
+    while (mTableWriterWaiting.load(std::memory_order_acquire))
+        std::this_thread::yield();
+    return std::shared_lock<std::shared_mutex>(mTableMutex);
+}
+
+std::unique_lock<std::shared_mutex> MP4ParserImpl::lockTablesExclusive()
+{
+    // writers are serialized by mFileMutex, one flag is enough
+    mTableWriterWaiting = true;
+    std::unique_lock<std::shared_mutex> tableLock(mTableMutex);
+    mTableWriterWaiting = false;
+    return tableLock;
+}
+
+void MP4ParserImpl::StatCounters::reset()
+{
+    for (auto counter : {&totalUs, &boxParseUs, &fragmentCollectUs, &isoTableUs, &fragmentTableUs, &sampleLocatorUs,
+                         &sampleIndexCacheUs, &fileLockCount, &fileLockContended, &fileLockWaitUs})
+        counter->store(0);
+    boxCount.clear();
+    tableEntries = 0;
+}
+
+Mp4ParseStats MP4ParserImpl::getStats()
+{
+    Mp4ParseStats stats;
+
+    // not through lockFile(), asking for the stats shouldn't change them
     std::unique_lock<std::mutex> locker(mFileMutex);
+    mFileReader.getIoStats(stats);
+    for (auto &count : mStats.boxCount)
+    {
+        stats.boxCountByType[boxType2Str(count.first)] += count.second;
+        stats.boxCount += count.second;
+    }
+    stats.tableEntries = mStats.tableEntries;
+    locker.unlock();
+
+    stats.totalUs              = mStats.totalUs;
+    stats.boxParseUs           = mStats.boxParseUs;
+    stats.fragmentCollectUs    = mStats.fragmentCollectUs;
+    stats.isoTableUs           = mStats.isoTableUs;
+    stats.fragmentTableUs      = mStats.fragmentTableUs;
+    stats.sampleLocatorUs      = mStats.sampleLocatorUs;
+    stats.sampleIndexCacheUs   = mStats.sampleIndexCacheUs;
+    stats.sampleIndexFromCache = mSampleIndexFromCache;
+    stats.fileLockCount        = mStats.fileLockCount;
+    stats.fileLockContended    = mStats.fileLockContended;
+    stats.fileLockWaitUs       = mStats.fileLockWaitUs;
+    return stats;
+}
 
-    if (!mFileReader.isOpened() || 0 == mFileReader.getFileSize())
-        return 1.f;
+static string jsonString(const string &str)
+{
+    string res = "\"";
+    for (char c : str)
+    {
+        if ('"' == c || '\\' == c)
+        {
+            res += '\\';
+            res += c;
+        }
+        else if ((unsigned char)c < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)c);
+            res += escaped;
+        }
+        else
+        {
+            res += c;
+        }
+    }
+    return res + "\"";
+}
 
-    return (float)mFileReader.getCursorPos() / mFileReader.getFileSize();
+string Mp4ParseStats::toJson() const
+{
+    const std::pair<const char *, uint64_t> counters[] = {
+        {"sourceReads", sourceReads},
+        {"sourceBytes", sourceBytes},
+        {"seeks", seeks},
+        {"cacheHits", cacheHits},
+        {"cacheMisses", cacheMisses},
+        {"positionalReads", positionalReads},
+        {"positionalBytes", positionalBytes},
+        {"boxCount", boxCount},
+        {"tableEntries", tableEntries},
+        {"totalUs", totalUs},
+        {"boxParseUs", boxParseUs},
+        {"fragmentCollectUs", fragmentCollectUs},
+        {"isoTableUs", isoTableUs},
+        {"fragmentTableUs", fragmentTableUs},
+        {"sampleLocatorUs", sampleLocatorUs},
+        {"sampleIndexCacheUs", sampleIndexCacheUs},
+        {"fileLockCount", fileLockCount},
+        {"fileLockContended", fileLockContended},
+        {"fileLockWaitUs", fileLockWaitUs},
+    };
+
+    stringstream ss;
+    ss << "{";
+    for (auto &counter : counters)
+        ss << "\"" << counter.first << "\":" << counter.second << ",";
+    ss << "\"sampleIndexFromCache\":" << (sampleIndexFromCache ? "true" : "false") << ",";
+    ss << "\"boxCountByType\":{";
+    for (auto it = boxCountByType.begin(); it != boxCountByType.end(); ++it)
+        ss << (it == boxCountByType.begin() ? "" : ",") << jsonString(it->first) << ":" << it->second;
+    ss << "}}";
+    return ss.str();
 }
 const std::vector<Mp4BoxPtr> MP4ParserImpl::getBoxes() const
 {
+    auto tableLock = lockTablesShared();
+
     std::vector<Mp4BoxPtr> res;
     std::copy(mContainBoxes.begin(), mContainBoxes.end(), std::back_inserter(res));
     return res;
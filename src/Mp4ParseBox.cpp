@@ -150,26 +150,204 @@ void registerUdtaCallback(uint8_t uuid[MP4_UUID_LEN], BoxParseFunc parseDataCall
     gUdtaRegisterCallbacks[MP4_UUID(uuid)] = {parseDataCallback, getDataCallback, userData};
 }
 
-std::map<Mp4BoxType, userBoxCallback> gUserDefineBoxCallbacks;
+// how parseBox makes a box of a type, type is the one read from the file
+using BoxFactory = CommonBoxPtr (*)(MP4ParserImpl &parser, uint32_t type);
 
-void registerBoxCallback(Mp4BoxType boxType, BoxParseFunc parseDataCallback, BoxDataFunc getDataCallback,
-                         void *userData)
+template <typename T>
+static CommonBoxPtr makeBox(MP4ParserImpl &parser, uint32_t type)
 {
-    gUserDefineBoxCallbacks[boxType] = {parseDataCallback, getDataCallback, userData};
+    MP4_UNUSED(type);
+    return parser.newBox<T>();
 }
 
-map<uint32_t, uint32_t> compatible_box_types = {
-    {MP4_BOX_MAKE_TYPE("free"), MP4_BOX_MAKE_TYPE("skip")},
-    {MP4_BOX_MAKE_TYPE("avc2"), MP4_BOX_MAKE_TYPE("avc1")},
-    {MP4_BOX_MAKE_TYPE("avc3"), MP4_BOX_MAKE_TYPE("avc1")},
-    {MP4_BOX_MAKE_TYPE("avc4"), MP4_BOX_MAKE_TYPE("avc1")},
-    {MP4_BOX_MAKE_TYPE("hvc2"), MP4_BOX_MAKE_TYPE("hvc1")},
-    {MP4_BOX_MAKE_TYPE("hvc3"), MP4_BOX_MAKE_TYPE("hvc1")},
-    {MP4_BOX_MAKE_TYPE("hev1"), MP4_BOX_MAKE_TYPE("hvc1")},
-    {MP4_BOX_MAKE_TYPE("hev2"), MP4_BOX_MAKE_TYPE("hvc1")},
-    {MP4_BOX_MAKE_TYPE("hev3"), MP4_BOX_MAKE_TYPE("hvc1")},
+template <typename T>
+static CommonBoxPtr makeTypedBox(MP4ParserImpl &parser, uint32_t type)
+{
+    return parser.newBox<T>(type);
+}
+
+struct BoxRegistryEntry
+{
+    uint32_t   type           = 0; // 0 for an empty slot
+    uint32_t   compatibleType = 0; // the type it's handled as, e.g. avc1 for avc3
+    BoxFactory factory        = nullptr;
+    bool       sampleTable    = false; // kept aside by Mp4ParseOptions::headerOnly
+    int32_t    userCallback   = -1;    // index of the registerBoxCallback one, used instead of factory
+};
+
+// FourCC -> BoxRegistryEntry, open addressing over a power of two slots kept at most half full,
+// so a lookup is a multiply, a shift and mostly one compare; types not in it are plain CommonBox
+class BoxRegistry
+{
+public:
+    BoxRegistry(std::initializer_list<BoxRegistryEntry> entries)
+    {
+        mSlots.resize(128);
+        for (auto &entry : entries)
+            insert(entry.type) = entry;
+    }
+
+    const BoxRegistryEntry *find(uint32_t type) const
+    {
+        if (0 == type)
+            return nullptr;
+        for (size_t slot = slotOf(type);; slot = (slot + 1) & (mSlots.size() - 1))
+        {
+            if (mSlots[slot].type == type)
+                return &mSlots[slot];
+            if (0 == mSlots[slot].type)
+                return nullptr;
+        }
+    }
+
+    uint32_t getCompatibleType(uint32_t type) const
+    {
+        const BoxRegistryEntry *entry = find(type);
+        return nullptr == entry ? type : entry->compatibleType;
+    }
+
+    const userBoxCallback *getUserCallback(uint32_t type) const
+    {
+        const BoxRegistryEntry *entry = find(type);
+        return (nullptr == entry || entry->userCallback < 0) ? nullptr : &mUserCallbacks[entry->userCallback];
+    }
+
+    void setUserCallback(uint32_t type, const userBoxCallback &callback)
+    {
+        BoxRegistryEntry &entry = insert(type);
+        if (entry.userCallback < 0)
+        {
+            entry.userCallback = (int32_t)mUserCallbacks.size();
+            mUserCallbacks.push_back(callback);
+        }
+        else
+        {
+            mUserCallbacks[entry.userCallback] = callback;
+        }
+    }
+
+private:
+    // Fibonacci hashing, the top bits of the product pick the slot
+    size_t slotOf(uint32_t type) const { return (uint32_t)(type * 0x9E3779B1u) >> (32 - mSlotBits); }
+
+    // the slot of type, a CommonBox one is added if it's not there yet
+    BoxRegistryEntry &insert(uint32_t type)
+    {
+        assert(type != 0);
+        if ((mCount + 1) * 2 > mSlots.size())
+            grow();
+        size_t slot = slotOf(type);
+        while (mSlots[slot].type != 0 && mSlots[slot].type != type)
+            slot = (slot + 1) & (mSlots.size() - 1);
+        if (0 == mSlots[slot].type)
+        {
+            mSlots[slot].type           = type;
+            mSlots[slot].compatibleType = type;
+            mSlots[slot].factory        = makeTypedBox<CommonBox>;
+            ++mCount;
+        }
+        return mSlots[slot];
+    }
+
+    void grow()
+    {
+        std::vector<BoxRegistryEntry> old;
+        old.swap(mSlots);
+        mSlots.resize(old.size() * 2);
+        ++mSlotBits;
+        mCount = 0;
+        for (auto &entry : old)
+        {
+            if (entry.type != 0)
+                insert(entry.type) = entry;
+        }
+    }
+
+    std::vector<BoxRegistryEntry> mSlots;
+    uint32_t                      mSlotBits = 7; // log2(mSlots.size())
+    size_t                        mCount    = 0;
+    std::vector<userBoxCallback>  mUserCallbacks;
 };
 
+// the boxes parsed here, registerBoxCallback adds to them
+static BoxRegistry gBoxRegistry = {
+    {MP4_BOX_MAKE_TYPE("edts"), MP4_BOX_MAKE_TYPE("edts"), makeTypedBox<ContainBox>,                     false},
+    {MP4_BOX_MAKE_TYPE("stbl"), MP4_BOX_MAKE_TYPE("stbl"), makeTypedBox<ContainBox>,                     false},
+    {MP4_BOX_MAKE_TYPE("moov"), MP4_BOX_MAKE_TYPE("moov"), makeTypedBox<ContainBox>,                     false},
+    {MP4_BOX_MAKE_TYPE("trak"), MP4_BOX_MAKE_TYPE("trak"), makeTypedBox<ContainBox>,                     false},
+    {MP4_BOX_MAKE_TYPE("minf"), MP4_BOX_MAKE_TYPE("minf"), makeTypedBox<ContainBox>,                     false},
+    {MP4_BOX_MAKE_TYPE("dinf"), MP4_BOX_MAKE_TYPE("dinf"), makeTypedBox<ContainBox>,                     false},
+    {MP4_BOX_MAKE_TYPE("mdia"), MP4_BOX_MAKE_TYPE("mdia"), makeTypedBox<ContainBox>,                     false},
+    {MP4_BOX_MAKE_TYPE("moof"), MP4_BOX_MAKE_TYPE("moof"), makeTypedBox<ContainBox>,                     false},
+    {MP4_BOX_MAKE_TYPE("mvex"), MP4_BOX_MAKE_TYPE("mvex"), makeTypedBox<ContainBox>,                     false},
+    {MP4_BOX_MAKE_TYPE("traf"), MP4_BOX_MAKE_TYPE("traf"), makeTypedBox<ContainBox>,                     false},
+    {MP4_BOX_MAKE_TYPE("mfra"), MP4_BOX_MAKE_TYPE("mfra"), makeTypedBox<ContainBox>,                     false},
+    {MP4_BOX_MAKE_TYPE("ftyp"), MP4_BOX_MAKE_TYPE("ftyp"), makeBox<FileTypeBox>,                         false},
+    {MP4_BOX_MAKE_TYPE("mvhd"), MP4_BOX_MAKE_TYPE("mvhd"), makeBox<MovieHeaderBox>,                      false},
+    {MP4_BOX_MAKE_TYPE("tkhd"), MP4_BOX_MAKE_TYPE("tkhd"), makeBox<TrackHeaderBox>,                      false},
+    {MP4_BOX_MAKE_TYPE("elst"), MP4_BOX_MAKE_TYPE("elst"), makeBox<EditListBox>,                         false},
+    {MP4_BOX_MAKE_TYPE("mdhd"), MP4_BOX_MAKE_TYPE("mdhd"), makeBox<MediaHeaderBox>,                      false},
+    {MP4_BOX_MAKE_TYPE("hdlr"), MP4_BOX_MAKE_TYPE("hdlr"), makeBox<HandlerBox>,                          false},
+    {MP4_BOX_MAKE_TYPE("vmhd"), MP4_BOX_MAKE_TYPE("vmhd"), makeBox<VideoMediaHeaderBox>,                 false},
+    {MP4_BOX_MAKE_TYPE("smhd"), MP4_BOX_MAKE_TYPE("smhd"), makeBox<SoundMediaHeaderBox>,                 false},
+    {MP4_BOX_MAKE_TYPE("dref"), MP4_BOX_MAKE_TYPE("dref"), makeBox<DataReferenceBox>,                    false},
+    {MP4_BOX_MAKE_TYPE("url "), MP4_BOX_MAKE_TYPE("url "), makeBox<DataEntryUrlBox>,                     false},
+    {MP4_BOX_MAKE_TYPE("urn "), MP4_BOX_MAKE_TYPE("urn "), makeBox<DataEntryUrnBox>,                     false},
+    {MP4_BOX_MAKE_TYPE("stts"), MP4_BOX_MAKE_TYPE("stts"), makeBox<TimeToSampleBox>,                     true },
+    {MP4_BOX_MAKE_TYPE("ctts"), MP4_BOX_MAKE_TYPE("ctts"), makeBox<CompositionOffsetBox>,                true },
+    {MP4_BOX_MAKE_TYPE("stsc"), MP4_BOX_MAKE_TYPE("stsc"), makeBox<SampleToChunkBox>,                    true },
+    {MP4_BOX_MAKE_TYPE("stsz"), MP4_BOX_MAKE_TYPE("stsz"), makeBox<SampleSizeBox>,                       true },
+    {MP4_BOX_MAKE_TYPE("stz2"), MP4_BOX_MAKE_TYPE("stz2"), makeBox<CompactSampleSizeBox>,                true },
+    {MP4_BOX_MAKE_TYPE("sdtp"), MP4_BOX_MAKE_TYPE("sdtp"), makeBox<SampleDependencyTypeBox>,             true },
+    {MP4_BOX_MAKE_TYPE("stco"), MP4_BOX_MAKE_TYPE("stco"), makeBox<ChunkOffsetBox>,                      true },
+    {MP4_BOX_MAKE_TYPE("co64"), MP4_BOX_MAKE_TYPE("co64"), makeBox<ChunkLargeOffsetBox>,                 true },
+    {MP4_BOX_MAKE_TYPE("stss"), MP4_BOX_MAKE_TYPE("stss"), makeBox<SyncSampleBox>,                       true },
+    {MP4_BOX_MAKE_TYPE("sgpd"), MP4_BOX_MAKE_TYPE("sgpd"), makeBox<SampleGroupDescriptionBox>,           false},
+    {MP4_BOX_MAKE_TYPE("sbgp"), MP4_BOX_MAKE_TYPE("sbgp"), makeBox<SampleToGroupBox>,                    false},
+    {MP4_BOX_MAKE_TYPE("stsd"), MP4_BOX_MAKE_TYPE("stsd"), makeBox<SampleDescriptionBox>,                false},
+    {MP4_BOX_MAKE_TYPE("skip"), MP4_BOX_MAKE_TYPE("skip"), makeTypedBox<CommonBox>,                      false},
+    {MP4_BOX_MAKE_TYPE("free"), MP4_BOX_MAKE_TYPE("skip"), makeTypedBox<CommonBox>,                      false},
+    {MP4_BOX_MAKE_TYPE("mdat"), MP4_BOX_MAKE_TYPE("mdat"), makeTypedBox<CommonBox>,                      false},
+    {MP4_BOX_MAKE_TYPE("colr"), MP4_BOX_MAKE_TYPE("colr"), makeBox<ColourInformationBox>,                false},
+    {MP4_BOX_MAKE_TYPE("mehd"), MP4_BOX_MAKE_TYPE("mehd"), makeBox<MovieExtendsHeaderBox>,               false},
+    {MP4_BOX_MAKE_TYPE("trex"), MP4_BOX_MAKE_TYPE("trex"), makeBox<TrackExtendsBox>,                     false},
+    {MP4_BOX_MAKE_TYPE("mfhd"), MP4_BOX_MAKE_TYPE("mfhd"), makeBox<MovieFragmentHeaderBox>,              false},
+    {MP4_BOX_MAKE_TYPE("tfhd"), MP4_BOX_MAKE_TYPE("tfhd"), makeBox<TrackFragmentHeaderBox>,              false},
+    {MP4_BOX_MAKE_TYPE("tfdt"), MP4_BOX_MAKE_TYPE("tfdt"), makeBox<TrackFragmentBaseMediaDecodeTimeBox>, false},
+    {MP4_BOX_MAKE_TYPE("trun"), MP4_BOX_MAKE_TYPE("trun"), makeBox<TrackRunBox>,                         false},
+    {MP4_BOX_MAKE_TYPE("tfra"), MP4_BOX_MAKE_TYPE("tfra"), makeBox<TrackFragmentRandomAccessBox>,        false},
+    {MP4_BOX_MAKE_TYPE("mfro"), MP4_BOX_MAKE_TYPE("mfro"), makeBox<MovieFragmentRandomAccessOffsetBox>,  false},
+    {MP4_BOX_MAKE_TYPE("hvc1"), MP4_BOX_MAKE_TYPE("hvc1"), makeTypedBox<HEVCSampleEntry>,                false},
+    {MP4_BOX_MAKE_TYPE("hvc2"), MP4_BOX_MAKE_TYPE("hvc1"), makeTypedBox<HEVCSampleEntry>,                false},
+    {MP4_BOX_MAKE_TYPE("hvc3"), MP4_BOX_MAKE_TYPE("hvc1"), makeTypedBox<HEVCSampleEntry>,                false},
+    {MP4_BOX_MAKE_TYPE("hev1"), MP4_BOX_MAKE_TYPE("hvc1"), makeTypedBox<HEVCSampleEntry>,                false},
+    {MP4_BOX_MAKE_TYPE("hev2"), MP4_BOX_MAKE_TYPE("hvc1"), makeTypedBox<HEVCSampleEntry>,                false},
+    {MP4_BOX_MAKE_TYPE("hev3"), MP4_BOX_MAKE_TYPE("hvc1"), makeTypedBox<HEVCSampleEntry>,                false},
+    {MP4_BOX_MAKE_TYPE("avc1"), MP4_BOX_MAKE_TYPE("avc1"), makeTypedBox<AVCSampleEntry>,                 false},
+    {MP4_BOX_MAKE_TYPE("avc2"), MP4_BOX_MAKE_TYPE("avc1"), makeTypedBox<AVCSampleEntry>,                 false},
+    {MP4_BOX_MAKE_TYPE("avc3"), MP4_BOX_MAKE_TYPE("avc1"), makeTypedBox<AVCSampleEntry>,                 false},
+    {MP4_BOX_MAKE_TYPE("avc4"), MP4_BOX_MAKE_TYPE("avc1"), makeTypedBox<AVCSampleEntry>,                 false},
+    {MP4_BOX_MAKE_TYPE("mp4v"), MP4_BOX_MAKE_TYPE("mp4v"), makeBox<MP4VisualSampleEntry>,                false},
+    {MP4_BOX_MAKE_TYPE("mp4a"), MP4_BOX_MAKE_TYPE("mp4a"), makeBox<MP4AudioSampleEntry>,                 false},
+    {MP4_BOX_MAKE_TYPE("avcC"), MP4_BOX_MAKE_TYPE("avcC"), makeBox<AVCConfigurationBox>,                 false},
+    {MP4_BOX_MAKE_TYPE("hvcC"), MP4_BOX_MAKE_TYPE("hvcC"), makeBox<HEVCConfigurationBox>,                false},
+    {MP4_BOX_MAKE_TYPE("esds"), MP4_BOX_MAKE_TYPE("esds"), makeBox<ESDBox>,                              false},
+    {MP4_BOX_MAKE_TYPE("btrt"), MP4_BOX_MAKE_TYPE("btrt"), makeBox<BitRateBox>,                          false},
+    {MP4_BOX_MAKE_TYPE("udta"), MP4_BOX_MAKE_TYPE("udta"), makeBox<UdtaBox>,                             false},
+    {MP4_BOX_MAKE_TYPE("uuid"), MP4_BOX_MAKE_TYPE("uuid"), makeBox<UuidBox>,                             false},
+};
+
+void registerBoxCallback(Mp4BoxType boxType, BoxParseFunc parseDataCallback, BoxDataFunc getDataCallback,
+                         void *userData)
+{
+    if (0 == boxType)
+    {
+        MP4_ERR("box type 0 can't be registered\n");
+        return;
+    }
+    gBoxRegistry.setUserCallback(boxType, {parseDataCallback, getDataCallback, userData});
+}
+
 std::string boxType2Str(uint32_t type)
 {
     char str[16];
@@ -184,19 +362,12 @@ std::string boxType2Str(uint32_t type)
 
 uint32_t getCompatibleBoxType(uint32_t type)
 {
-    auto it = compatible_box_types.find(type);
-    if (it == compatible_box_types.end())
-        return type;
-    else
-        return it->second;
+    return gBoxRegistry.getCompatibleType(type);
 }
 
 bool isSameBoxType(uint32_t type1, uint32_t type2)
 {
-    if (getCompatibleBoxType(type1) == getCompatibleBoxType(type2))
-        return true;
-    else
-        return false;
+    return type1 == type2 || gBoxRegistry.getCompatibleType(type1) == gBoxRegistry.getCompatibleType(type2);
 }
 
 bool hasSampleTable(uint32_t boxType)
@@ -298,6 +469,38 @@ int get_type_size(BinaryFileReader &reader, uint32_t &type, uint64_t &boxPos, ui
     return 0;
 }
 
+int peek_box_header(BinaryFileReader &reader, uint64_t boxPos, uint32_t &type, uint64_t &boxSize, uint64_t &headerSize)
+{
+    uint8_t  header[BOX_EXTENDED_HEADER_LENGTH];
+    uint64_t got = reader.peekAt(boxPos, header, BOX_EXTENDED_HEADER_LENGTH);
+    if (got < BOX_HEADER_LENGTH || !isTypeValid((signed char *)header + BOX_SIZE_LENGTH))
+        return -1;
+    const char *boxType = (const char *)header + BOX_SIZE_LENGTH;
+    type                = MP4_BOX_MAKE_TYPE(boxType);
+
+    uint32_t box_sz;
+    memcpy(&box_sz, header, BOX_SIZE_LENGTH);
+    box_sz     = bswap_32(box_sz);
+    headerSize = BOX_HEADER_LENGTH;
+    if (box_sz == 0)
+    {
+        boxSize = reader.getFileSize() - boxPos;
+    }
+    else if (box_sz == 1)
+    {
+        if (got < BOX_EXTENDED_HEADER_LENGTH)
+            return -1;
+        memcpy(&boxSize, header + BOX_HEADER_LENGTH, BOX_LARGE_SIZE_LENGTH);
+        boxSize    = bswap_64(boxSize);
+        headerSize = BOX_EXTENDED_HEADER_LENGTH;
+    }
+    else
+    {
+        boxSize = box_sz;
+    }
+    return boxSize < headerSize ? -1 : 0;
+}
+
 int read_fullbox_version_flags(BinaryFileReader &reader, uint8_t *version, uint32_t *flags)
 {
     uint8_t buffer[4] = {0};
@@ -1125,6 +1328,41 @@ int UuidBox::parse(BinaryFileReader &reader, uint64_t boxPosition, uint64_t boxS
     return parseRes;
 }
 
+void MP4ParserImpl::countParsedBox(const CommonBoxPtr &box)
+{
+    mStats.boxCount[box->mBoxType]++;
+    if (auto table = dynamic_cast<const SampleTableBox *>(box.get()))
+        mStats.tableEntries += table->getDecodedEntryCount();
+}
+
+CommonBoxPtr MP4ParserImpl::parseTopLevelBox(bool &parseErr)
+{
+    uint64_t boxPos = mFileReader.getCursorPos();
+    updateParseProgress();
+
+    // only the payload boxes are taken from the header, a box cut short by the end of file is left to parseBox
+    uint32_t type;
+    uint64_t boxSize, headerSize;
+    if (peek_box_header(mFileReader, boxPos, type, boxSize, headerSize) < 0 || boxPos + boxSize > mFileReader.getFileSize()
+        || (MP4_BOX_MAKE_TYPE("mdat") != type && MP4_BOX_MAKE_TYPE("free") != type && MP4_BOX_MAKE_TYPE("skip") != type)
+        || gBoxRegistry.getUserCallback(type) != nullptr)
+        return parseBox(mFileReader, nullptr, parseErr);
+
+    MP4_INFO("get box %s offset %#" PRIx64 "(%" PRIu64 "), size %#" PRIx64 "(%" PRIu64 ")\n", boxType2Str(type).c_str(),
+             boxPos, boxPos, boxSize, boxSize);
+
+    // nothing to parse in the body, which may be most of the file
+    CommonBoxPtr curBox = newBox<CommonBox>(type);
+    curBox->mBoxOffset  = boxPos;
+    curBox->mBoxSize    = boxSize;
+    curBox->mBodyPos    = boxPos + headerSize;
+    curBox->mBodySize   = boxSize - headerSize;
+    countParsedBox(curBox);
+
+    mFileReader.setCursor(boxPos + boxSize);
+    return curBox;
+}
+
 CommonBoxPtr MP4ParserImpl::parseBox(BinaryFileReader &reader, CommonBoxPtr parentBox, bool &parseErr)
 {
     int ret;
@@ -1145,173 +1383,41 @@ CommonBoxPtr MP4ParserImpl::parseBox(BinaryFileReader &reader, CommonBoxPtr pare
 
     CommonBoxPtr curBox;
 
-    uint32_t compType = type;
+    const BoxRegistryEntry *entry    = gBoxRegistry.find(type);
+    uint32_t                compType = type;
+    bool                    deferred = mDeferSampleTables && entry != nullptr && entry->sampleTable;
 
-    auto userDefineCallback = gUserDefineBoxCallbacks.find(type);
-    if (userDefineCallback != gUserDefineBoxCallbacks.end())
+    if (nullptr == entry)
     {
-        curBox =
-            make_shared<UserDefineBox>(type, userDefineCallback->second.parseDataCallback,
-                                       userDefineCallback->second.getDataCallback, userDefineCallback->second.userData);
+        curBox = newBox<CommonBox>(type);
+    }
+    else if (entry->userCallback >= 0)
+    {
+        const userBoxCallback *callback = gBoxRegistry.getUserCallback(type);
+        curBox = newBox<UserDefineBox>(type, callback->parseDataCallback, callback->getDataCallback, callback->userData);
     }
     else
     {
-        compType = getCompatibleBoxType(type);
-
-        switch (compType)
-        {
-            default:
-                curBox = make_shared<CommonBox>(type);
-                break;
-            case MP4_BOX_MAKE_TYPE("edts"):
-            case MP4_BOX_MAKE_TYPE("stbl"):
-            case MP4_BOX_MAKE_TYPE("moov"):
-            case MP4_BOX_MAKE_TYPE("trak"):
-            case MP4_BOX_MAKE_TYPE("minf"):
-            case MP4_BOX_MAKE_TYPE("dinf"):
-            case MP4_BOX_MAKE_TYPE("mdia"):
-            case MP4_BOX_MAKE_TYPE("moof"):
-            case MP4_BOX_MAKE_TYPE("mvex"):
-            case MP4_BOX_MAKE_TYPE("traf"):
-            case MP4_BOX_MAKE_TYPE("mfra"):
-                curBox = make_shared<ContainBox>(type);
-                break;
-            case MP4_BOX_MAKE_TYPE("ftyp"):
-                curBox = make_shared<FileTypeBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("mvhd"):
-                curBox = make_shared<MovieHeaderBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("tkhd"):
-                curBox = make_shared<TrackHeaderBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("elst"):
-                curBox = make_shared<EditListBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("mdhd"):
-                curBox = make_shared<MediaHeaderBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("hdlr"):
-                curBox = make_shared<HandlerBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("vmhd"):
-                curBox = make_shared<VideoMediaHeaderBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("smhd"):
-                curBox = make_shared<SoundMediaHeaderBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("dref"):
-                curBox = make_shared<DataReferenceBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("url "):
-                curBox = make_shared<DataEntryUrlBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("urn "):
-                curBox = make_shared<DataEntryUrnBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("stts"):
-                curBox = make_shared<TimeToSampleBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("ctts"):
-                curBox = make_shared<CompositionOffsetBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("stsc"):
-                curBox = make_shared<SampleToChunkBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("stsz"):
-                curBox = make_shared<SampleSizeBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("stz2"):
-                curBox = make_shared<CompactSampleSizeBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("sdtp"):
-                curBox = make_shared<SampleDependencyTypeBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("stco"):
-                curBox = make_shared<ChunkOffsetBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("co64"):
-                curBox = make_shared<ChunkLargeOffsetBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("stss"):
-                curBox = make_shared<SyncSampleBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("sgpd"):
-                curBox = make_shared<SampleGroupDescriptionBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("sbgp"):
-                curBox = make_shared<SampleToGroupBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("stsd"):
-                curBox = make_shared<SampleDescriptionBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("skip"):
-            case MP4_BOX_MAKE_TYPE("mdat"):
-                curBox = make_shared<CommonBox>((type));
-                break;
-            case MP4_BOX_MAKE_TYPE("colr"):
-                curBox = make_shared<ColourInformationBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("mehd"):
-                curBox = make_shared<MovieExtendsHeaderBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("trex"):
-                curBox = make_shared<TrackExtendsBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("mfhd"):
-                curBox = make_shared<MovieFragmentHeaderBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("tfhd"):
-                curBox = make_shared<TrackFragmentHeaderBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("tfdt"):
-                curBox = make_shared<TrackFragmentBaseMediaDecodeTimeBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("trun"):
-                curBox = make_shared<TrackRunBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("tfra"):
-                curBox = make_shared<TrackFragmentRandomAccessBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("mfro"):
-                curBox = make_shared<MovieFragmentRandomAccessOffsetBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("hvc1"):
-                curBox = make_shared<HEVCSampleEntry>((type));
-                break;
-            case MP4_BOX_MAKE_TYPE("avc1"):
-                curBox = make_shared<AVCSampleEntry>((type));
-                break;
-            case MP4_BOX_MAKE_TYPE("mp4v"):
-                curBox = make_shared<MP4VisualSampleEntry>();
-                break;
-            case MP4_BOX_MAKE_TYPE("mp4a"):
-                curBox = make_shared<MP4AudioSampleEntry>();
-                break;
-            case MP4_BOX_MAKE_TYPE("avcC"):
-                curBox = make_shared<AVCConfigurationBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("hvcC"):
-                curBox = make_shared<HEVCConfigurationBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("esds"):
-                curBox = make_shared<ESDBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("btrt"):
-                curBox = make_shared<BitRateBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("udta"):
-                curBox = make_shared<UdtaBox>();
-                break;
-            case MP4_BOX_MAKE_TYPE("uuid"):
-                curBox = make_shared<UuidBox>();
-                break;
-        }
+        compType = entry->compatibleType;
+        curBox   = entry->factory(*this, type);
     }
 
     curBox->mParentBox = parentBox;
 
+    if (deferred)
+    {
+        // keep the position only, parsed by loadSampleTables
+        curBox->mBoxOffset = boxPos;
+        curBox->mBoxSize   = boxSize;
+        curBox->mBodyPos   = reader.getCursorPos();
+        curBox->mBodySize  = bodySize;
+        reader.setCursor(curBox->mBodyPos + bodySize);
+        mDeferredBoxes.push_back(curBox);
+        return curBox;
+    }
+
     ret = curBox->parse(reader, boxPos, boxSize, bodySize);
+    countParsedBox(curBox);
 
     if (ret < 0)
     {
@@ -1369,7 +1475,7 @@ CommonBoxPtr MP4ParserImpl::parseBox(BinaryFileReader &reader, CommonBoxPtr pare
         reader.setCursor(curBox->mBodyPos + curBox->mBodySize);
     }
 
-    if (!curBox->mContainBoxes.empty())
+    if (!curBox->mContainBoxes.empty() && MP4_LOG_ENABLED(MP4_LOG_LEVEL_INFO))
     {
         MP4_INFO("parse sub boxes for %s done\n", boxType2Str(curBox->mBoxType).c_str());
 
@@ -1381,44 +1487,49 @@ CommonBoxPtr MP4ParserImpl::parseBox(BinaryFileReader &reader, CommonBoxPtr pare
     }
 
     // check if there's sdtp to parse
-    if (MP4_BOX_MAKE_TYPE("stbl") == compType)
+    if (MP4_BOX_MAKE_TYPE("stbl") == compType && !mDeferSampleTables)
+        parseSdtp(reader, curBox);
+
+    return curBox;
+}
+
+// sdtp has no entry count of its own, it's parsed again once the sample count is known
+void MP4ParserImpl::parseSdtp(BinaryFileReader &reader, CommonBoxPtr stbl)
+{
+    SampleDependencyTypeBoxPtr sdtp = dynamic_pointer_cast<SampleDependencyTypeBox>(stbl->getSubBox("sdtp"));
+    SampleSizeBoxPtr           stsz = dynamic_pointer_cast<SampleSizeBox>(stbl->getSubBox("stsz"));
+    CompactSampleSizeBoxPtr    stz2 = dynamic_pointer_cast<CompactSampleSizeBox>(stbl->getSubBox("stz2"));
+
+    if (stsz != nullptr && stz2 != nullptr)
     {
-        SampleDependencyTypeBoxPtr sdtp = dynamic_pointer_cast<SampleDependencyTypeBox>(curBox->getSubBox("sdtp"));
-        SampleSizeBoxPtr           stsz = dynamic_pointer_cast<SampleSizeBox>(curBox->getSubBox("stsz"));
-        CompactSampleSizeBoxPtr    stz2 = dynamic_pointer_cast<CompactSampleSizeBox>(curBox->getSubBox("stz2"));
+        MP4_WARN("!!!stsz stz2 both exist!!!\n");
+    }
 
-        if (stsz != nullptr && stz2 != nullptr)
+    if (sdtp != nullptr)
+    {
+        if (stsz == nullptr && stz2 == nullptr)
         {
-            MP4_WARN("!!!stsz stz2 both exist!!!\n");
+            MP4_PARSE_ERR("!!!stsz/stz2 neither found!!!\n");
         }
-
-        if (sdtp != nullptr)
+        else
         {
-            if (stsz == nullptr && stz2 == nullptr)
-            {
-                MP4_PARSE_ERR("!!!stsz/stz2 neither found!!!\n");
-            }
+            MP4_INFO("back to parse sdtp\n");
+            uint32_t entryCount;
+            uint64_t oldPos = reader.getCursorPos();
+            reader.setCursor(sdtp->mBodyPos);
+            if (stsz != nullptr)
+                entryCount = stsz->entryCount;
             else
-            {
-                MP4_INFO("back to parse sdtp\n");
-                uint32_t entryCount;
-                uint64_t oldPos = reader.getCursorPos();
-                reader.setCursor(sdtp->mBodyPos);
-                if (stsz != nullptr)
-                    entryCount = stsz->entryCount;
-                else
-                    entryCount = stz2->entryCount;
+                entryCount = stz2->entryCount;
 
-                sdtp->entryCount = entryCount;
+            sdtp->entryCount = entryCount;
 
-                sdtp->parse(reader, sdtp->mBoxOffset, sdtp->mBoxSize, sdtp->mBodySize);
+            sdtp->parse(reader, sdtp->mBoxOffset, sdtp->mBoxSize, sdtp->mBodySize);
+            mStats.tableEntries += sdtp->getDecodedEntryCount();
 
-                reader.setCursor(oldPos);
-            }
+            reader.setCursor(oldPos);
         }
     }
-
-    return curBox;
 }
 
 std::shared_ptr<Mp4BoxData> UuidBox::getData(std::shared_ptr<Mp4BoxData> src) const
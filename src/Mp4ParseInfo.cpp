@@ -316,6 +316,8 @@ H26X_FRAME_TYPE_E MP4ParserImpl::getH265FrameType(int naluType, BinaryData &data
 
 H26X_FRAME_TYPE_E MP4ParserImpl::parseVideoNaluType(uint32_t trackIdx, uint64_t sampleIdx)
 {
+    auto tableLock = lockTablesShared();
+
     if (trackIdx >= tracksInfo.size())
         return H26X_FRAME_Unknown;
 
@@ -334,26 +336,38 @@ H26X_FRAME_TYPE_E MP4ParserImpl::parseVideoNaluType(uint32_t trackIdx, uint64_t
 
     uint16_t naluLenSize = it->second;
 
-    std::unique_lock<std::mutex> locker(mFileMutex);
+    Mp4SampleItem curSample;
+    if (getSampleItem(trackIdx, sampleIdx, curSample) < 0)
+        return H26X_FRAME_Unknown;
+
+    uint64_t naluPos = curSample.sampleOffset;
+    uint64_t last    = curSample.sampleOffset + curSample.sampleSize;
 
-    Mp4SampleItem *curSample = &mp4TrackInfo->mediaInfo->samplesInfo[sampleIdx];
-    uint64_t       oldPos    = mFileReader.getCursorPos();
-    mFileReader.setCursor(curSample->sampleOffset);
-    uint64_t last = curSample->sampleOffset + curSample->sampleSize;
+    // only the head of each nalu is needed: length, nalu header and the first bytes of the slice header
+    uint8_t naluHead[32];
 
-    curSample->frameType     = H26X_FRAME_Unknown;
-    BinaryFileReader &reader = mFileReader;
-    while (reader.getCursorPos() < last)
+    while (naluPos < last)
     {
-        uint32_t naluSize = (uint32_t)reader.readUnsigned(naluLenSize, true);
+        memset(naluHead, 0, sizeof(naluHead));
+        uint64_t headSize = mFileReader.readAt(naluPos, naluHead, MIN((uint64_t)sizeof(naluHead), last - naluPos));
+        if (headSize <= naluLenSize)
+        {
+            MP4_ERR("read nalu head at 0x%" PRIx64 " fail\n", naluPos);
+            break;
+        }
+
+        uint32_t naluSize = 0;
+        for (uint16_t i = 0; i < naluLenSize; i++)
+        {
+            naluSize = (naluSize << 8) | naluHead[i];
+        }
         if (0 == naluSize)
         {
             MP4_ERR("nalu size = 0\n");
             break;
         }
-        uint64_t naluLast = mFileReader.getCursorPos() + naluSize;
-        uint8_t  naluType;
-        mFileReader.read(&naluType, 1);
+        uint64_t   naluLast = naluPos + naluLenSize + naluSize;
+        uint8_t    naluType = naluHead[naluLenSize];
         BitsReader bitsReader(&naluType, sizeof(naluType));
         BinaryData data;
         // nalu type only tell if it is an I frame, parsing nalu data to tell if it's a P or B frame
@@ -368,18 +382,18 @@ H26X_FRAME_TYPE_E MP4ParserImpl::parseVideoNaluType(uint32_t trackIdx, uint64_t
                     MP4_ERR("H264 Nalu Unkown Type %d\n", naluType);
                     break;
                 }
-                curSample->naluTypes.push_back(naluType);
+                curSample.naluTypes.push_back(naluType);
                 if (H264_NALU_SLICE_IDR == naluType)
                 {
-                    curSample->frameType = H26X_FRAME_I;
+                    curSample.frameType = H26X_FRAME_I;
                     break;
                 }
-                if (H26X_FRAME_Unknown != curSample->frameType)
+                if (H26X_FRAME_Unknown != curSample.frameType)
                     break;
                 if (H264_NALU_SLICE == naluType)
                 {
                     data.create(8);
-                    reader.read(data.ptr(), data.length);
+                    memcpy(data.ptr(), naluHead + naluLenSize + 1, data.length);
                     H26X_FRAME_TYPE_E type;
                     type = getH264FrameType(data);
                     if (type == H26X_FRAME_Unknown)
@@ -390,11 +404,11 @@ H26X_FRAME_TYPE_E MP4ParserImpl::parseVideoNaluType(uint32_t trackIdx, uint64_t
                     {
                         MP4_ERR("H264 frame %" PRIu64 " type I, not matching Nalu Type %d\n", sampleIdx, naluType);
                     }
-                    curSample->frameType = type;
-                    if (H26X_FRAME_I == curSample->frameType && 0 == curSample->isKeyFrame)
+                    curSample.frameType = type;
+                    if (H26X_FRAME_I == curSample.frameType && 0 == curSample.isKeyFrame)
                     {
                         MP4_ERR("H264 frame %" PRIu64 " is I frame, but not marked as key frame by stts\n", sampleIdx);
-                        curSample->isKeyFrame = 2;
+                        curSample.isKeyFrame = 2;
                     }
                 }
                 break;
@@ -406,14 +420,14 @@ H26X_FRAME_TYPE_E MP4ParserImpl::parseVideoNaluType(uint32_t trackIdx, uint64_t
                     MP4_ERR("H265 Nalu Unkown Type %d\n", naluType);
                     break;
                 }
-                curSample->naluTypes.push_back(naluType);
+                curSample.naluTypes.push_back(naluType);
                 if (H265_NALU_IDR_W == naluType || H265_NALU_IDR_N == naluType)
                 {
-                    curSample->frameType = H26X_FRAME_I;
+                    curSample.frameType = H26X_FRAME_I;
                     break;
                 }
 
-                if (H26X_FRAME_Unknown != curSample->frameType)
+                if (H26X_FRAME_Unknown != curSample.frameType)
                     break;
                 if (H265_NALU_TRAIL_N == naluType || H265_NALU_TRAIL_R == naluType || H265_NALU_TSA_N == naluType
                     || H265_NALU_TSA_R == naluType || H265_NALU_STSA_N == naluType || H265_NALU_STSA_R == naluType
@@ -421,9 +435,8 @@ H26X_FRAME_TYPE_E MP4ParserImpl::parseVideoNaluType(uint32_t trackIdx, uint64_t
                     || H265_NALU_RASL_R == naluType || H265_NALU_BLA_W_LP == naluType || H265_NALU_BLA_W_RADL == naluType
                     || H265_NALU_BLA_N_LP == naluType || H265_NALU_CRA_NUT == naluType) // a picture slice
                 {
-                    mFileReader.read(nullptr, 1); // H265 Nalu Header is 2 bytes
                     data.create(16);
-                    reader.read(data.ptr(), data.length);
+                    memcpy(data.ptr(), naluHead + naluLenSize + 2, data.length); // H265 Nalu Header is 2 bytes
                     H26X_FRAME_TYPE_E type;
                     type = getH265FrameType(naluType, data);
                     if (type == H26X_FRAME_Unknown)
@@ -432,22 +445,50 @@ H26X_FRAME_TYPE_E MP4ParserImpl::parseVideoNaluType(uint32_t trackIdx, uint64_t
                     if (H26X_FRAME_I == type)
                         MP4_ERR("H265 frame %" PRIu64 " type I, not matching Nalu Type %d\n", sampleIdx, naluType);
 
-                    curSample->frameType = type;
-                    if (H26X_FRAME_I == curSample->frameType && 0 == curSample->isKeyFrame)
+                    curSample.frameType = type;
+                    if (H26X_FRAME_I == curSample.frameType && 0 == curSample.isKeyFrame)
                     {
                         MP4_ERR("H265 frame %" PRIu64 " is I frame, but not marked as key frame by stts\n", sampleIdx);
-                        curSample->isKeyFrame = 2;
+                        curSample.isKeyFrame = 2;
                     }
                 }
                 break;
         }
 
-        mFileReader.setCursor(naluLast);
+        naluPos = naluLast;
     }
 
-    mFileReader.setCursor(oldPos);
+    // in lazy mode the result is only returned, there's no samplesInfo to keep it
+    if (trackIdx >= mSampleLocators.size() || nullptr == mSampleLocators[trackIdx])
+    {
+        std::lock_guard<std::mutex> lock(mNaluInfoMutex);
+        Mp4SampleIndex             &samplesInfo = mp4TrackInfo->mediaInfo->samplesInfo;
+        samplesInfo.setFrameType(sampleIdx, curSample.frameType);
+        samplesInfo.setNaluTypes(sampleIdx, curSample.naluTypes);
+        if (2 == curSample.isKeyFrame)
+            samplesInfo.setKeyFrame(sampleIdx, curSample.isKeyFrame);
+    }
 
-    return curSample->frameType;
+    return curSample.frameType;
+}
+
+int MP4ParserImpl::generateSampleTable(uint32_t trackIdx)
+{
+    if (mOptions.lazySampleTable)
+    {
+        ScopedTimer timer(mStats.sampleLocatorUs);
+        return generateSampleLocator(trackIdx);
+    }
+    else if (MP4_TYPE_ISO == mMp4Type)
+    {
+        ScopedTimer timer(mStats.isoTableUs);
+        return generateIsoSamplesInfoTable(tracksInfo[trackIdx]->trakIndex);
+    }
+    else
+    {
+        ScopedTimer timer(mStats.fragmentTableUs);
+        return generateFragmentSamplesInfoTable(tracksInfo[trackIdx]->trakIndex);
+    }
 }
 
 int MP4ParserImpl::generateInfoTable(uint32_t trackIdx)
@@ -496,14 +537,8 @@ int MP4ParserImpl::generateInfoTable(uint32_t trackIdx)
         return -1;
     }
 
-    if (MP4_TYPE_ISO == mMp4Type)
-    {
-        CHECK_RET(generateIsoSamplesInfoTable(mp4TrackInfo->trakIndex));
-    }
-    else
-    {
-        CHECK_RET(generateFragmentSamplesInfoTable(mp4TrackInfo->trakIndex));
-    }
+    if (!mDeferSampleTables && !mSampleIndexFromCache)
+        CHECK_RET(generateSampleTable(trackIdx));
 
     if (mp4TrackInfo->mediaInfo != nullptr)
         mp4TrackInfo->mediaInfo->getInfoFromTrack(pTrakBox, mp4TrackInfo);
@@ -514,6 +549,8 @@ int MP4ParserImpl::generateInfoTable(uint32_t trackIdx)
         return 0;
     }
 
+    std::lock_guard<std::mutex> codecInfoLock(mCodecInfoMutex);
+
     BinaryData pps, sps;
     if (MP4_CODEC_HEVC == codecType)
     {
@@ -585,6 +622,107 @@ int MP4ParserImpl::generateInfoTable(uint32_t trackIdx)
     return 0;
 }
 
+int MP4ParserImpl::generateSampleLocator(uint32_t trackIdx)
+{
+    CommonBoxPtr pMoovBox = getSubBox("moov");
+    if (pMoovBox == nullptr)
+    {
+        MP4_ERR("moov box missing\n");
+        return -1;
+    }
+    vector<CommonBoxPtr> pTrakBoxes = pMoovBox->getSubBoxes("trak");
+    if (trackIdx >= pTrakBoxes.size())
+    {
+        MP4_ERR("trak Index Too Big %u %zu\n", trackIdx, pTrakBoxes.size());
+        return -1;
+    }
+    MediaHeaderBoxPtr pMdhdBox = pTrakBoxes[trackIdx]->getSubBoxRecursive<MediaHeaderBox>("mdhd", 2);
+    if (pMdhdBox == nullptr)
+    {
+        MP4_ERR("Get mdhd fail\n");
+        return -1;
+    }
+
+    Mp4MediaInfo    *trackMediaInfo = tracksInfo[trackIdx]->mediaInfo.get();
+    SampleLocatorPtr locator;
+
+    if (MP4_TYPE_ISO == mMp4Type)
+    {
+        CommonBoxPtr stbl = pTrakBoxes[trackIdx]->getSubBoxRecursive("stbl", 3);
+        if (stbl == nullptr)
+        {
+            MP4_ERR("%u stbl not parsed\n", trackIdx);
+            return -1;
+        }
+        auto isoLocator = std::make_shared<IsoSampleLocator>();
+        CHECK_RET(isoLocator->build(stbl, (uint32_t)pMdhdBox->timescale));
+
+        SyncSampleBoxPtr stss = stbl->getSubBox<SyncSampleBox>("stss");
+        if (stss != nullptr)
+        {
+            trackMediaInfo->syncSampleTable.reserve(stss->entryCount);
+            for (uint32_t i = 0; i < stss->entryCount; i++)
+            {
+                uint64_t syncIdx = (uint64_t)stss->entries[i].sampleNumber - 1;
+                if (syncIdx < isoLocator->sampleCount)
+                    trackMediaInfo->syncSampleTable.push_back(syncIdx);
+            }
+        }
+        locator = isoLocator;
+    }
+    else
+    {
+        CommonBoxPtr pMvexBox = getSubBoxRecursive("mvex", 2);
+        if (pMvexBox == nullptr)
+        {
+            MP4_ERR("Get mvex fail\n");
+            return -1;
+        }
+        TrackExtendsBoxPtr pTrexBox = nullptr;
+        for (auto &trex : pMvexBox->getSubBoxes<TrackExtendsBox>("trex"))
+        {
+            if (trex->trackId == (uint32_t)tracksInfo[trackIdx]->trackId)
+            {
+                pTrexBox = trex;
+                break;
+            }
+        }
+        if (pTrexBox == nullptr)
+        {
+            MP4_ERR("No trex for track id %u\n", tracksInfo[trackIdx]->trackId);
+            return -1;
+        }
+        // on refresh the existing locator already walked the appended moof boxes, see refresh()
+        auto fragLocator = trackIdx < mSampleLocators.size()
+                               ? std::dynamic_pointer_cast<FragmentSampleLocator>(mSampleLocators[trackIdx])
+                               : nullptr;
+        if (fragLocator != nullptr)
+        {
+            fragLocator->commit();
+        }
+        else
+        {
+            fragLocator = std::make_shared<FragmentSampleLocator>();
+            CHECK_RET(fragLocator->build(mNewMoofBoxes, pTrexBox, tracksInfo[trackIdx]->trackId, (uint32_t)pMdhdBox->timescale));
+        }
+        locator = fragLocator;
+    }
+
+    // what Mp4MediaInfo::getInfoFromTrack would get from samplesInfo/chunksInfo
+    Mp4SampleItem firstSample;
+    trackMediaInfo->sampleCount = locator->sampleCount;
+    trackMediaInfo->totalSize   = locator->totalSize;
+    trackMediaInfo->durationMs  = locator->totalDurationMs;
+    if (locator->getSampleItem(0, firstSample) == 0)
+        trackMediaInfo->durationMs -= firstSample.dtsDeltaMs;
+
+    if (mSampleLocators.size() < tracksInfo.size())
+        mSampleLocators.resize(tracksInfo.size());
+    mSampleLocators[trackIdx] = locator;
+
+    return 0;
+}
+
 int MP4ParserImpl::generateIsoSamplesInfoTable(uint64_t trackIdx)
 {
     uint32_t     chunkCount;
@@ -628,14 +766,14 @@ int MP4ParserImpl::generateIsoSamplesInfoTable(uint64_t trackIdx)
     }
 
     SampleDescriptionBoxPtr stsd = stbl->getSubBox<SampleDescriptionBox>("stsd");
-    SampleTableBoxPtr       stss = stbl->getSubBox<SampleTableBox>("stss");
+    SyncSampleBoxPtr        stss = stbl->getSubBox<SyncSampleBox>("stss");
     SampleSizeBoxPtr        stsz = stbl->getSubBox<SampleSizeBox>("stsz");
-    SampleTableBoxPtr       stz2 = stbl->getSubBox<SampleTableBox>("stz2");
-    SampleTableBoxPtr       stco = stbl->getSubBox<SampleTableBox>("stco");
-    SampleTableBoxPtr       co64 = stbl->getSubBox<SampleTableBox>("co64");
-    SampleTableBoxPtr       stts = stbl->getSubBox<SampleTableBox>("stts");
-    SampleTableBoxPtr       stsc = stbl->getSubBox<SampleTableBox>("stsc");
-    SampleTableBoxPtr       ctts = stbl->getSubBox<SampleTableBox>("ctts");
+    CompactSampleSizeBoxPtr stz2 = stbl->getSubBox<CompactSampleSizeBox>("stz2");
+    ChunkOffsetBoxPtr       stco = stbl->getSubBox<ChunkOffsetBox>("stco");
+    ChunkLargeOffsetBoxPtr  co64 = stbl->getSubBox<ChunkLargeOffsetBox>("co64");
+    TimeToSampleBoxPtr      stts = stbl->getSubBox<TimeToSampleBox>("stts");
+    SampleToChunkBoxPtr     stsc = stbl->getSubBox<SampleToChunkBox>("stsc");
+    CompositionOffsetBoxPtr ctts = stbl->getSubBox<CompositionOffsetBox>("ctts");
 
     MP4_CODEC_TYPE_E codeType;
 
@@ -691,17 +829,17 @@ int MP4ParserImpl::generateIsoSamplesInfoTable(uint64_t trackIdx)
         Mp4ChunkItem curChunk;
         curChunk.chunkIdx = chunkIdx;
         if (stco != nullptr)
-            curChunk.chunkOffset = stco->getEntry<stcoItem>(chunkIdx)->chunkOffset;
+            curChunk.chunkOffset = stco->entries[chunkIdx].chunkOffset;
         else
-            curChunk.chunkOffset = co64->getEntry<co64Item>(chunkIdx)->chunkOffset;
+            curChunk.chunkOffset = co64->entries[chunkIdx].chunkOffset;
         for (unsigned int j = stscItemIdx, jm = stscEntryCount; j < jm; j++)
         {
-            if (chunkIdx + 1 >= stsc->getEntry<stscItem>(j)->firstChunk
-                && (j == jm - 1 || chunkIdx + 1 < stsc->getEntry<stscItem>(j + 1)->firstChunk))
+            if (chunkIdx + 1 >= stsc->entries[j].firstChunk
+                && (j == jm - 1 || chunkIdx + 1 < stsc->entries[j + 1].firstChunk))
             {
-                stscItem *stscEntry             = stsc->getEntry<stscItem>(j);
-                curChunk.sampleCount            = stscEntry->sampleCount;
-                curChunk.sampleDescriptionIndex = stscEntry->sampleDescIdx;
+                const stscItem &stscEntry       = stsc->entries[j];
+                curChunk.sampleCount            = stscEntry.sampleCount;
+                curChunk.sampleDescriptionIndex = stscEntry.sampleDescIdx;
                 curChunk.sampleStartIdx         = chunkStart;
                 chunkStart += curChunk.sampleCount;
                 stscItemIdx = j;
@@ -715,22 +853,23 @@ int MP4ParserImpl::generateIsoSamplesInfoTable(uint64_t trackIdx)
     if (chunkCount == 0)
         return 0;
 
-    sampleCount           = (stsz ? stsz : stz2)->entryCount;
+    sampleCount           = stsz ? stsz->entryCount : stz2->entryCount;
     uint32_t curChunkIdx  = 0;
     uint64_t sampleOffset = trackMediaInfo->chunksInfo[curChunkIdx].chunkOffset;
     uint32_t stssIdx      = 0;
     uint32_t sttsIdx      = 0;
-    uint32_t sttsCount    = stts->getEntry<sttsItem>(sttsIdx)->sampleCount;
+    uint32_t sttsCount    = stts->entries[sttsIdx].sampleCount;
     uint32_t cttsIdx      = 0;
     uint32_t cttsCount    = 0;
     if (ctts != nullptr)
-        cttsCount = ctts->getEntry<cttsItem>(cttsIdx)->sampleCount;
+        cttsCount = ctts->entries[cttsIdx].sampleCount;
     uint64_t curDts        = 0;
     uint64_t nextIframeIdx = 0;
 
     if (stss != nullptr)
-        nextIframeIdx = stss->getEntry<stssItem>(stssIdx)->sampleNumber - 1;
+        nextIframeIdx = (uint64_t)stss->entries[stssIdx].sampleNumber - 1;
 
+    trackMediaInfo->samplesInfo.reserve(sampleCount);
     for (unsigned int i = 0; i < sampleCount; ++i)
     {
         if (i >= trackMediaInfo->chunksInfo[curChunkIdx].sampleStartIdx + trackMediaInfo->chunksInfo[curChunkIdx].sampleCount)
@@ -750,7 +889,7 @@ int MP4ParserImpl::generateIsoSamplesInfoTable(uint64_t trackIdx)
                 stssIdx++;
                 if (stssIdx < stss->entryCount)
                 {
-                    nextIframeIdx = stss->getEntry<stssItem>(stssIdx)->sampleNumber - 1;
+                    nextIframeIdx = (uint64_t)stss->entries[stssIdx].sampleNumber - 1;
                 }
             }
             else
@@ -766,10 +905,10 @@ int MP4ParserImpl::generateIsoSamplesInfoTable(uint64_t trackIdx)
         if (i >= sttsCount)
         {
             sttsIdx++;
-            sttsCount += stts->getEntry<sttsItem>(sttsIdx)->sampleCount;
+            sttsCount += stts->entries[sttsIdx].sampleCount;
         }
 
-        curSample.dtsDeltaMs = stts->getEntry<sttsItem>(sttsIdx)->delta;
+        curSample.dtsDeltaMs = stts->entries[sttsIdx].delta;
         curSample.dtsDeltaMs = curSample.dtsDeltaMs * 1000 / mdhd->timescale;
         curSample.dtsMs      = curDts;
         curDts += curSample.dtsDeltaMs;
@@ -781,11 +920,11 @@ int MP4ParserImpl::generateIsoSamplesInfoTable(uint64_t trackIdx)
             if (i >= cttsCount)
             {
                 cttsIdx++;
-                cttsCount += ctts->getEntry<cttsItem>(cttsIdx)->sampleCount;
+                cttsCount += ctts->entries[cttsIdx].sampleCount;
                 ;
             }
 
-            deltaTs = ctts->getEntry<cttsItem>(cttsIdx)->sampleOffset;
+            deltaTs = ctts->entries[cttsIdx].sampleOffset;
             deltaTs = deltaTs * 1000 / mdhd->timescale;
         }
         curSample.ptsMs = curSample.dtsMs + deltaTs;
@@ -797,9 +936,9 @@ int MP4ParserImpl::generateIsoSamplesInfoTable(uint64_t trackIdx)
         else
         {
             if (stsz)
-                curSample.sampleSize = stsz->getEntry<stszItem>(i)->sampleSize;
+                curSample.sampleSize = stsz->entries[i].sampleSize;
             else
-                curSample.sampleSize = stz2->getEntry<stz2Item>(i)->sampleSize;
+                curSample.sampleSize = stz2->entries[i].sampleSize;
         }
 
         curSample.sampleOffset = sampleOffset;
@@ -812,12 +951,13 @@ int MP4ParserImpl::generateIsoSamplesInfoTable(uint64_t trackIdx)
 
     for (unsigned int i = 0; i < trackMediaInfo->chunksInfo.size(); ++i)
     {
-        Mp4ChunkItem  &curChunk    = trackMediaInfo->chunksInfo[i];
-        Mp4SampleItem &startSample = trackMediaInfo->samplesInfo[curChunk.sampleStartIdx];
-        Mp4SampleItem &endSample   = trackMediaInfo->samplesInfo[curChunk.sampleStartIdx + curChunk.sampleCount - 1];
-        curChunk.startPtsMs        = startSample.dtsMs;
-        curChunk.durationMs        = endSample.dtsMs + endSample.dtsDeltaMs - curChunk.startPtsMs;
-        curChunk.avgBitrateBps     = (double)curChunk.chunkSize * 8 * 1000 / curChunk.durationMs;
+        Mp4ChunkItem         &curChunk    = trackMediaInfo->chunksInfo[i];
+        const Mp4SampleIndex &samplesInfo = trackMediaInfo->samplesInfo;
+        uint64_t              endIdx      = curChunk.sampleStartIdx + curChunk.sampleCount - 1;
+        curChunk.startPtsMs               = samplesInfo.getDtsMs(curChunk.sampleStartIdx);
+        curChunk.durationMs               = samplesInfo.getDtsMs(endIdx) + samplesInfo.getDtsDeltaMs(endIdx)
+                                          - curChunk.startPtsMs;
+        curChunk.avgBitrateBps            = (double)curChunk.chunkSize * 8 * 1000 / curChunk.durationMs;
     }
 
     return 0;
@@ -832,7 +972,7 @@ uint32_t MP4ParserImpl::fragmentGetSampleFlags(TrackExtendsBoxPtr pTrexBox, Trac
         return 0;
 
     if (pTrunBox->mFullboxFlags & MP4_TRUN_FLAG_SAMPLE_FLAGS_PRESENT)
-        return pTrunBox->getEntry<trunItem>(sampleIdx)->flags;
+        return pTrunBox->entries[sampleIdx].flags;
     else if (pTrunBox->mFullboxFlags & MP4_TRUN_FLAG_FIRST_SAMPLE_FLAGS_PRESENT && 0 == sampleIdx)
         return pTrunBox->firstSampleFlags;
     else if (pTfhdBox->mFullboxFlags & MP4_TFHD_FLAG_DEFAULT_SAMPLE_FLAGS_PRESENT)
@@ -840,7 +980,6 @@ uint32_t MP4ParserImpl::fragmentGetSampleFlags(TrackExtendsBoxPtr pTrexBox, Trac
     else
         return pTrexBox->defaultSampleFlags;
 }
-#define FRAG_IS_IFRAME(sample_flags) (((sample_flags) & FRAG_SAMPLE_FLAG_IS_NON_SYNC) == 0x00000000)
 
 uint32_t MP4ParserImpl::fragmentGetSampleSize(TrackExtendsBoxPtr pTrexBox, TrackFragmentHeaderBoxPtr pTfhdBox,
                                               TrackRunBoxPtr pTrunBox, uint64_t sampleIdx)
@@ -850,7 +989,7 @@ uint32_t MP4ParserImpl::fragmentGetSampleSize(TrackExtendsBoxPtr pTrexBox, Track
 
     if (pTrunBox->mFullboxFlags & MP4_TRUN_FLAG_SAMPLE_SIZE_PRESENT)
     {
-        return pTrunBox->getEntry<trunItem>(sampleIdx)->size;
+        return pTrunBox->entries[sampleIdx].size;
     }
     else if (pTfhdBox->mFullboxFlags & MP4_TFHD_FLAG_DEFAULT_SAMPLE_SIZE_PRESENT)
     {
@@ -870,7 +1009,7 @@ uint32_t MP4ParserImpl::fragmentGetSampleDuration(TrackExtendsBoxPtr pTrexBox, T
 
     if (pTrunBox->mFullboxFlags & MP4_TRUN_FLAG_SAMPLE_DURATION_PRESENT)
     {
-        return pTrunBox->getEntry<trunItem>(sampleIdx)->duration;
+        return pTrunBox->entries[sampleIdx].duration;
     }
     else if (pTfhdBox->mFullboxFlags & MP4_TFHD_FLAG_DEFAULT_SAMPLE_DURATION_PRESENT)
     {
@@ -889,7 +1028,7 @@ uint32_t MP4ParserImpl::fragmentGetSampleCompositionOffset(TrackRunBoxPtr pTrunB
 
     if (pTrunBox->mFullboxFlags & MP4_TRUN_FLAG_SAMPLE_COMPOSITION_TIME_OFFSETS_PRESENT)
     {
-        return pTrunBox->getEntry<trunItem>(sampleIdx)->composOffset;
+        return pTrunBox->entries[sampleIdx].composOffset;
     }
     else
     {
@@ -897,118 +1036,72 @@ uint32_t MP4ParserImpl::fragmentGetSampleCompositionOffset(TrackRunBoxPtr pTrunB
     }
 }
 
-int MP4ParserImpl::generateFragmentSamplesInfoTable(uint64_t trackIdx)
+// trafs of all tracks in moofBoxes[firstMoof, lastMoof), trackRanges is indexed like trackTrex;
+// trun entry counts are summed first so every track's samples are allocated once
+int MP4ParserImpl::walkFragmentRange(const vector<CommonBoxPtr> &moofBoxes, size_t firstMoof, size_t lastMoof,
+                                     const vector<TrackExtendsBoxPtr> &trackTrex, vector<FragmentRangeSamples> &trackRanges) const
 {
-    CommonBoxPtr               pMvexBox;
-    CommonBoxPtr               pMoovBox;
-    vector<CommonBoxPtr>       pTrakBoxes;
-    MediaHeaderBoxPtr          pMdhdBox;
-    vector<TrackExtendsBoxPtr> pTrexBoxes;
-    vector<CommonBoxPtr>       pMoofBoxes;
-    vector<CommonBoxPtr>       pTrafBoxes;
-    TrackExtendsBoxPtr         pTrexBox;
-    TrackFragmentHeaderBoxPtr  pTfhdBox;
-
-    pMoovBox = getSubBox("moov");
-    if (pMoovBox == nullptr)
+    struct TrafRef
     {
-        MP4_ERR("Get moov fail\n");
-        return -1;
-    }
+        CommonBoxPtr              moof;
+        CommonBoxPtr              traf;
+        TrackFragmentHeaderBoxPtr tfhd;
+        size_t                    trackIdx;
+    };
+    vector<TrafRef>  trafRefs;
+    vector<uint64_t> sampleCounts(trackTrex.size(), 0);
+    vector<bool>     trackInMoof(trackTrex.size(), false);
 
-    pTrakBoxes = pMoovBox->getSubBoxes("trak");
-    if (pTrakBoxes.size() == 0)
+    for (size_t moofIdx = firstMoof; moofIdx < lastMoof; ++moofIdx)
     {
-        MP4_ERR("Get trex fail\n");
-        return -1;
-    }
-    if (trackIdx >= pTrakBoxes.size())
-    {
-        MP4_ERR("Num of trex err %" PRIu64 " %zu\n", trackIdx, pTrakBoxes.size());
-        return -1;
-    }
-
-    pMdhdBox = pTrakBoxes[trackIdx]->getSubBoxRecursive<MediaHeaderBox>("mdhd", 2);
-    if (pMdhdBox == nullptr)
-    {
-        MP4_ERR("Get mdhd fail\n");
-        return -1;
-    }
-
-    pMvexBox = getSubBoxRecursive("mvex", 2);
-    if (pMvexBox == nullptr)
-    {
-        MP4_ERR("Get mvex fail\n");
-        return -1;
-    }
-
-    pTrexBoxes = pMvexBox->getSubBoxes<TrackExtendsBox>("trex");
-    if (pTrexBoxes.size() == 0)
-    {
-        MP4_ERR("Get trex fail\n");
-        return -1;
-    }
-
-    const uint32_t targetTrackId = tracksInfo[trackIdx]->trackId;
-    pTrexBox                     = nullptr;
-    for (auto &trex : pTrexBoxes)
-    {
-        if (trex->trackId == targetTrackId)
-        {
-            pTrexBox = trex;
-            break;
-        }
-    }
-    if (pTrexBox == nullptr)
-    {
-        MP4_ERR("No trex for track id %u\n", targetTrackId);
-        return -1;
-    }
-
-    pMoofBoxes = getSubBoxes("moof");
-    if (pMoofBoxes.size() == 0)
-    {
-        MP4_ERR("Get moof fail\n");
-        return -1;
-    }
-
-    uint64_t               totalSampleCount = 0;
-    uint64_t               nextMediaDts     = 0; // media timescale; used if a fragment has no tfdt
-    vector<Mp4SampleItem> &sampleList       = tracksInfo[trackIdx]->mediaInfo->samplesInfo;
-
-    for (uint64_t moofIdx = 0, moofCount = pMoofBoxes.size(); moofIdx < moofCount; ++moofIdx)
-    {
-        pTrafBoxes = pMoofBoxes[moofIdx]->getSubBoxes("traf");
+        vector<CommonBoxPtr> pTrafBoxes = moofBoxes[moofIdx]->getSubBoxes("traf");
         if (pTrafBoxes.size() == 0)
         {
             MP4_ERR("Get traf fail\n");
             return -1;
         }
 
-        CommonBoxPtr pTrafBox;
+        std::fill(trackInMoof.begin(), trackInMoof.end(), false);
         for (auto &traf : pTrafBoxes)
         {
-            auto tfhdTry = traf->getSubBox<TrackFragmentHeaderBox>("tfhd");
-            if (tfhdTry != nullptr && tfhdTry->trackId == targetTrackId)
-            {
-                pTrafBox = traf;
-                pTfhdBox = tfhdTry;
-                break;
-            }
+            auto tfhd = traf->getSubBox<TrackFragmentHeaderBox>("tfhd");
+            if (tfhd == nullptr)
+                continue;
+
+            size_t trackIdx = 0;
+            while (trackIdx < tracksInfo.size() && (uint32_t)tracksInfo[trackIdx]->trackId != tfhd->trackId)
+                trackIdx++;
+            // only the first traf of a track in a moof is used
+            if (trackIdx >= tracksInfo.size() || trackInMoof[trackIdx] || trackTrex[trackIdx] == nullptr)
+                continue;
+            trackInMoof[trackIdx] = true;
+
+            for (auto &trun : traf->getSubBoxes<TrackRunBox>("trun"))
+                sampleCounts[trackIdx] += trun->entryCount;
+            trafRefs.push_back({moofBoxes[moofIdx], traf, tfhd, trackIdx});
         }
-        if (pTrafBox == nullptr)
-        {
+    }
+
+    for (size_t trackIdx = 0; trackIdx < trackRanges.size(); ++trackIdx)
+        trackRanges[trackIdx].samples.reserve(sampleCounts[trackIdx]);
+
+    for (auto &trafRef : trafRefs)
+    {
+        FragmentRangeSamples     &range    = trackRanges[trafRef.trackIdx];
+        TrackExtendsBoxPtr        pTrexBox = trackTrex[trafRef.trackIdx];
+        TrackFragmentHeaderBoxPtr pTfhdBox = trafRef.tfhd;
+        if (range.ret < 0)
             continue;
-        }
 
-        vector<TrackRunBoxPtr> pTrunBoxes = pTrafBox->getSubBoxes<TrackRunBox>("trun");
+        vector<TrackRunBoxPtr> pTrunBoxes = trafRef.traf->getSubBoxes<TrackRunBox>("trun");
         if (pTrunBoxes.empty())
         {
-            MP4_ERR("Get trun fail (track id %u)\n", targetTrackId);
-            return -1;
+            MP4_ERR("Get trun fail (track id %u)\n", pTfhdBox->trackId);
+            range.ret = -1;
+            continue;
         }
 
-        CommonBoxPtr pMoofBox = pMoofBoxes[moofIdx];
+        CommonBoxPtr pMoofBox = trafRef.moof;
 
         uint64_t fragBase;
         if (pTfhdBox->mFullboxFlags & MP4_TFHD_FLAG_BASE_DATA_OFFSET_PRESENT)
@@ -1019,10 +1112,9 @@ int MP4ParserImpl::generateFragmentSamplesInfoTable(uint64_t trackIdx)
             fragBase = pMoofBox->mBoxOffset + pMoofBox->mBoxSize;
 
         TrackFragmentBaseMediaDecodeTimeBoxPtr pTfdt =
-            pTrafBox->getSubBox<TrackFragmentBaseMediaDecodeTimeBox>("tfdt");
-        uint64_t curMediaDts = nextMediaDts;
+            trafRef.traf->getSubBox<TrackFragmentBaseMediaDecodeTimeBox>("tfdt");
         if (pTfdt != nullptr)
-            curMediaDts = pTfdt->baseDecTime;
+            range.baseDts.emplace_back(range.samples.size(), pTfdt->baseDecTime);
 
         uint64_t sampleDataCursor = fragBase;
         bool     firstTrunInTraf  = true;
@@ -1037,66 +1129,231 @@ int MP4ParserImpl::generateFragmentSamplesInfoTable(uint64_t trackIdx)
 
             firstTrunInTraf = false;
 
-            uint64_t fragTotalSampleSize = 0;
-
             for (uint64_t sampleIdx = 0, sampleCount = pTrunBox->entryCount; sampleIdx < sampleCount; ++sampleIdx)
             {
-                Mp4SampleItem curSample;
-                uint32_t      flags = fragmentGetSampleFlags(pTrexBox, pTfhdBox, pTrunBox, sampleIdx);
-
-                curSample.sampleIdx    = totalSampleCount;
-                curSample.sampleOffset = sampleDataCursor + fragTotalSampleSize;
-                curSample.sampleSize   = fragmentGetSampleSize(pTrexBox, pTfhdBox, pTrunBox, sampleIdx);
-                fragTotalSampleSize += curSample.sampleSize;
-                curSample.isKeyFrame = FRAG_IS_IFRAME(flags);
-
-                uint32_t durTs =
-                    fragmentGetSampleDuration(pTrexBox, pTfhdBox, pTrunBox, sampleIdx);
-                curSample.dtsMs      = curMediaDts * 1000 / pMdhdBox->timescale;
-                curSample.dtsDeltaMs = durTs * 1000 / pMdhdBox->timescale;
-                curMediaDts += durTs;
-
-                curSample.ptsMs =
-                    curSample.dtsMs + fragmentGetSampleCompositionOffset(pTrunBox, sampleIdx) * 1000 / pMdhdBox->timescale;
-                sampleList.push_back(curSample);
-
-                totalSampleCount++;
+                FragmentSample fragSample;
+                uint32_t       flags = fragmentGetSampleFlags(pTrexBox, pTfhdBox, pTrunBox, sampleIdx);
+
+                fragSample.offset            = sampleDataCursor;
+                fragSample.size              = fragmentGetSampleSize(pTrexBox, pTfhdBox, pTrunBox, sampleIdx);
+                fragSample.duration          = fragmentGetSampleDuration(pTrexBox, pTfhdBox, pTrunBox, sampleIdx);
+                fragSample.compositionOffset = fragmentGetSampleCompositionOffset(pTrunBox, sampleIdx);
+                fragSample.isKeyFrame        = FRAG_IS_IFRAME(flags);
+                sampleDataCursor += fragSample.size;
+
+                range.samples.push_back(fragSample);
             }
+        }
+    }
 
-            sampleDataCursor += fragTotalSampleSize;
+    return 0;
+}
+
+int MP4ParserImpl::getTrackTrex(vector<TrackExtendsBoxPtr> &trackTrex) const
+{
+    CommonBoxPtr pMvexBox = getSubBoxRecursive("mvex", 2);
+    if (pMvexBox == nullptr)
+    {
+        MP4_ERR("Get mvex fail\n");
+        return -1;
+    }
+
+    vector<TrackExtendsBoxPtr> pTrexBoxes = pMvexBox->getSubBoxes<TrackExtendsBox>("trex");
+    if (pTrexBoxes.size() == 0)
+    {
+        MP4_ERR("Get trex fail\n");
+        return -1;
+    }
+
+    trackTrex.assign(tracksInfo.size(), nullptr);
+    for (size_t trackIdx = 0; trackIdx < tracksInfo.size(); ++trackIdx)
+    {
+        for (auto &trex : pTrexBoxes)
+        {
+            if (trex->trackId == (uint32_t)tracksInfo[trackIdx]->trackId)
+            {
+                trackTrex[trackIdx] = trex;
+                break;
+            }
         }
+        if (trackTrex[trackIdx] == nullptr)
+            MP4_ERR("No trex for track id %u\n", tracksInfo[trackIdx]->trackId);
+    }
+
+    return 0;
+}
+
+void MP4ParserImpl::fragmentSampleTimes(const FragmentSample &fragSample, uint64_t mediaDts, uint64_t timescale,
+                                        Mp4SampleItem &item)
+{
+    uint32_t durTs  = fragSample.duration;
+    item.dtsMs      = mediaDts * 1000 / timescale;
+    item.dtsDeltaMs = durTs * 1000 / timescale;
+    item.ptsMs      = item.dtsMs + fragSample.compositionOffset * 1000 / timescale;
+}
+
+int MP4ParserImpl::collectFragmentSamples()
+{
+    ScopedTimer timer(mStats.fragmentCollectUs);
+
+    mFragmentRanges.clear();
+    mFragmentNextDts.resize(tracksInfo.size(), 0);
+
+    // a file or stream that has no fragment yet
+    const vector<CommonBoxPtr> &pMoofBoxes = mNewMoofBoxes;
+    if (pMoofBoxes.empty())
+        return 0;
+
+    vector<TrackExtendsBoxPtr> trackTrex;
+    CHECK_RET(getTrackTrex(trackTrex));
+
+    // moof ranges are walked separately, possibly in parallel, and merged in order by each track
+    size_t                               moofsPerTask = mOptions.moofsPerTask > 0 ? mOptions.moofsPerTask : pMoofBoxes.size();
+    size_t                               rangeCount   = (pMoofBoxes.size() + moofsPerTask - 1) / moofsPerTask;
+    vector<vector<FragmentRangeSamples>> ranges(rangeCount, vector<FragmentRangeSamples>(tracksInfo.size()));
+    vector<int>                          rangeRets(rangeCount, 0);
+    runTasks(mOptions.moofsPerTask > 0 ? mOptions.threadCount : 1, rangeCount, [&](size_t rangeIdx) {
+        size_t firstMoof    = rangeIdx * moofsPerTask;
+        rangeRets[rangeIdx] = walkFragmentRange(pMoofBoxes, firstMoof, MIN(firstMoof + moofsPerTask, pMoofBoxes.size()),
+                                                trackTrex, ranges[rangeIdx]);
+    });
 
-        nextMediaDts = curMediaDts;
+    for (size_t rangeIdx = 0; rangeIdx < rangeCount; ++rangeIdx)
+    {
+        if (rangeRets[rangeIdx] < 0)
+            return rangeRets[rangeIdx];
+    }
+    for (size_t trackIdx = 0; trackIdx < tracksInfo.size(); ++trackIdx)
+    {
+        if (trackTrex[trackIdx] == nullptr)
+            ranges[0][trackIdx].ret = -1;
+    }
+
+    mFragmentRanges = std::move(ranges);
+    return 0;
+}
+
+int MP4ParserImpl::generateFragmentSamplesInfoTable(uint64_t trackIdx)
+{
+    CommonBoxPtr         pMoovBox;
+    vector<CommonBoxPtr> pTrakBoxes;
+    MediaHeaderBoxPtr    pMdhdBox;
+
+    pMoovBox = getSubBox("moov");
+    if (pMoovBox == nullptr)
+    {
+        MP4_ERR("Get moov fail\n");
+        return -1;
     }
 
+    pTrakBoxes = pMoovBox->getSubBoxes("trak");
+    if (pTrakBoxes.size() == 0)
+    {
+        MP4_ERR("Get trex fail\n");
+        return -1;
+    }
+    if (trackIdx >= pTrakBoxes.size())
+    {
+        MP4_ERR("Num of trex err %" PRIu64 " %zu\n", trackIdx, pTrakBoxes.size());
+        return -1;
+    }
+
+    pMdhdBox = pTrakBoxes[trackIdx]->getSubBoxRecursive<MediaHeaderBox>("mdhd", 2);
+    if (pMdhdBox == nullptr)
+    {
+        MP4_ERR("Get mdhd fail\n");
+        return -1;
+    }
+
+    if (mNewMoofBoxes.empty())
+        return 0;
+    if (mFragmentRanges.empty())
+    {
+        MP4_ERR("fragment samples not collected\n");
+        return -1;
+    }
+
+    uint64_t totalSampleCount = 0;
+    for (auto &trackRanges : mFragmentRanges)
+    {
+        if (trackIdx >= trackRanges.size() || trackRanges[trackIdx].ret < 0)
+            return -1;
+        totalSampleCount += trackRanges[trackIdx].samples.size();
+    }
+
+    // on refresh the samples are appended to the ones from the moof boxes before,
+    // growing by push_back so a refresh doesn't copy the whole table
+    Mp4SampleIndex &sampleList      = tracksInfo[trackIdx]->mediaInfo->samplesInfo;
+    uint64_t        prevSampleCount = sampleList.size();
+    if (sampleList.empty())
+        sampleList.reserve(totalSampleCount);
+
+    uint64_t curMediaDts = mFragmentNextDts[trackIdx]; // media timescale; carried over fragments without tfdt
+    for (auto &trackRanges : mFragmentRanges)
+    {
+        FragmentRangeSamples &range      = trackRanges[trackIdx];
+        size_t                baseDtsIdx = 0;
+        for (uint64_t i = 0; i < range.samples.size(); ++i)
+        {
+            while (baseDtsIdx < range.baseDts.size() && range.baseDts[baseDtsIdx].first == i)
+                curMediaDts = range.baseDts[baseDtsIdx++].second;
+
+            FragmentSample &fragSample = range.samples[i];
+            Mp4SampleItem   curSample;
+
+            curSample.sampleIdx    = sampleList.size();
+            curSample.sampleOffset = fragSample.offset;
+            curSample.sampleSize   = fragSample.size;
+            curSample.isKeyFrame   = fragSample.isKeyFrame;
+
+            fragmentSampleTimes(fragSample, curMediaDts, pMdhdBox->timescale, curSample);
+            curMediaDts += fragSample.duration;
+
+            sampleList.push_back(curSample);
+            if (curSample.isKeyFrame)
+                tracksInfo[trackIdx]->mediaInfo->syncSampleTable.push_back(curSample.sampleIdx);
+        }
+        range = FragmentRangeSamples();
+    }
+    mFragmentNextDts[trackIdx] = curMediaDts;
+
     totalSampleCount = sampleList.size();
 
-    uint64_t     gopCount = 0;
+    // the last gop may go on in the new samples, build it again
+    vector<Mp4ChunkItem> &gopList     = tracksInfo[trackIdx]->mediaInfo->chunksInfo;
+    uint64_t              firstSample = 0;
+    if (!gopList.empty())
+    {
+        firstSample = prevSampleCount - gopList.back().sampleCount;
+        gopList.pop_back();
+    }
+
+    uint64_t     gopCount = gopList.size();
     Mp4ChunkItem curGop;
 
-    for (uint64_t sampleIdx = 0; sampleIdx < totalSampleCount; ++sampleIdx)
+    for (uint64_t sampleIdx = firstSample; sampleIdx < totalSampleCount; ++sampleIdx)
     {
         if (0 == curGop.chunkOffset)
         {
-            curGop.chunkOffset = sampleList[sampleIdx].sampleOffset;
+            curGop.chunkOffset = sampleList.getSampleOffset(sampleIdx);
         }
 
         if (0 == curGop.sampleStartIdx)
         {
-            curGop.sampleStartIdx = sampleList[sampleIdx].sampleIdx;
-            curGop.startPtsMs     = sampleList[sampleIdx].ptsMs;
+            curGop.sampleStartIdx = sampleIdx;
+            curGop.startPtsMs     = sampleList.getPtsMs(sampleIdx);
         }
 
-        curGop.chunkSize += sampleList[sampleIdx].sampleSize;
-        curGop.durationMs += sampleList[sampleIdx].dtsDeltaMs;
+        curGop.chunkSize += sampleList.getSampleSize(sampleIdx);
+        curGop.durationMs += sampleList.getDtsDeltaMs(sampleIdx);
         curGop.sampleCount++;
 
-        if (sampleIdx == totalSampleCount - 1 || sampleList[sampleIdx + 1].isKeyFrame)
+        if (sampleIdx == totalSampleCount - 1 || sampleList.getKeyFrame(sampleIdx + 1))
         {
             gopCount++;
             curGop.chunkIdx      = gopCount;
             curGop.avgBitrateBps = (double)curGop.chunkSize * 8 * 1000 / curGop.durationMs;
-            tracksInfo[trackIdx]->mediaInfo->chunksInfo.push_back(curGop);
+            gopList.push_back(curGop);
             curGop = Mp4ChunkItem();
         }
     }
@@ -1127,7 +1384,7 @@ int Mp4MediaInfo::getInfoFromTrack(Mp4BoxPtr trakBox, TrackInfoPtr track)
     {
         durationMs = tkhd->duration * 1000 / mvhd->timescale;
     }
-    else
+    else if (!track->mediaInfo->chunksInfo.empty())
     {
         durationMs = 0;
         for (auto &chunkInfo : track->mediaInfo->chunksInfo)
@@ -1135,18 +1392,23 @@ int Mp4MediaInfo::getInfoFromTrack(Mp4BoxPtr trakBox, TrackInfoPtr track)
             durationMs += chunkInfo.durationMs;
         }
         if (track->mediaInfo->samplesInfo.size() >= 1)
-            durationMs -= track->mediaInfo->samplesInfo[0].dtsDeltaMs;
+            durationMs -= track->mediaInfo->samplesInfo.getDtsDeltaMs(0);
     }
+    // otherwise durationMs/totalSize/sampleCount are already filled from the lazy sample table
 
-    totalSize = 0;
-    for (auto &chunkInfo : track->mediaInfo->chunksInfo)
+    if (!track->mediaInfo->chunksInfo.empty())
     {
-        totalSize += chunkInfo.chunkSize;
+        totalSize = 0;
+        for (auto &chunkInfo : track->mediaInfo->chunksInfo)
+        {
+            totalSize += chunkInfo.chunkSize;
+        }
     }
 
     avgBitrate = (double)totalSize * 8. * 1000. / durationMs;
 
-    sampleCount = track->mediaInfo->samplesInfo.size();
+    if (!track->mediaInfo->samplesInfo.empty())
+        sampleCount = track->mediaInfo->samplesInfo.size();
 
     codecCode = getCodecFromStsd(stsd);
 
@@ -4,16 +4,20 @@
 #include <map>
 #include <mutex>
 #include <queue>
+#include <shared_mutex>
 #include <inttypes.h>
 #include "Mp4SampleTableTypes.h"
 #include "Mp4Types.h"
 #include "Mp4BoxTypes.h"
 #include "Mp4Parse.h"
+#include "Mp4SampleLocator.h"
 
 #define set_zero_ar(ar) memset(ar, 0, sizeof(ar))
 #define set_zero_st(st) memset(&st, 0, sizeof(st))
 #define ARRAY_SIZE(ar)  (sizeof(ar) / sizeof(*(ar)))
 
+#define FRAG_IS_IFRAME(sample_flags) (((sample_flags) & FRAG_SAMPLE_FLAG_IS_NON_SYNC) == 0x00000000)
+
 #define BOX_PARSE_BEGIN()                                                                                                     \
     mBoxOffset    = boxPosition;                                                                                              \
     mBoxSize      = boxSize;                                                                                                  \
@@ -70,26 +74,53 @@
     } while (0)
 
 std::string  boxType2Str(uint32_t type);
+int          get_type_size(BinaryFileReader &reader, uint32_t &type, uint64_t &boxPos, uint64_t &boxSize, uint64_t &bodySize);
+// type and size of the box at boxPos from its 8/16 header bytes, the cursor doesn't move; -1 if there's no valid header
+int          peek_box_header(BinaryFileReader &reader, uint64_t boxPos, uint32_t &type, uint64_t &boxSize, uint64_t &headerSize);
 int          read_fullbox_version_flags(BinaryFileReader &reader, uint8_t *version, uint32_t *flags);
 CommonBoxPtr parseBox(BinaryFileReader &reader, bool *parse_err);
 uint32_t     getCompatibleBoxType(uint32_t type);
 std::string  getProfileString(unsigned int profile_idc);
 
+// samples of one track found in a range of moof boxes;
+// the dts is only known once the ranges before are merged, unless the traf has a tfdt
+struct FragmentSample
+{
+    uint64_t offset            = 0;
+    uint32_t size              = 0;
+    uint32_t duration          = 0; // media timescale
+    uint32_t compositionOffset = 0; // media timescale
+    bool     isKeyFrame        = false;
+};
+
+struct FragmentRangeSamples
+{
+    int                                        ret = 0;
+    std::vector<FragmentSample>                samples;
+    std::vector<std::pair<uint64_t, uint64_t>> baseDts; // index in samples of a traf with tfdt, and its baseDecTime
+};
+
 class MP4ParserImpl : public Mp4Parser, public CommonBox, public std::enable_shared_from_this<MP4ParserImpl>
 {
+    friend class Mp4StreamParserImpl;
 
 public:
     MP4ParserImpl() : CommonBox("file") {}
     virtual std::string getBoxTypeStr() const override { return mFileReader.getFileName(); }
     virtual int         parse(std::string file_path) override;
+    virtual int         parse(std::string file_path, const Mp4ParseOptions &options) override;
+    virtual int         parse(Mp4ByteSourcePtr source, const Mp4ParseOptions &options) override;
     virtual void        clear() override;
+    virtual int         loadSampleTables() override;
+    virtual int         refresh() override;
 
     virtual bool        isParseSuccess() const override { return mAvailable; }
     virtual std::string getErrorMessage() override;
 
-    virtual MP4_TYPE_E  getMp4Type() const override { return mMp4Type; }
-    virtual std::string getFilePath() const override { return mFileReader.getFileFullPath(); }
-    virtual float       getParseProgress() override;
+    virtual MP4_TYPE_E    getMp4Type() const override { return mMp4Type; }
+    virtual std::string   getFilePath() const override { return mFileReader.getFileFullPath(); }
+    virtual float         getParseProgress() override;
+    virtual Mp4ParseStats getStats() override;
 
     const std::vector<Mp4BoxPtr> getBoxes() const override;
 
@@ -97,9 +128,30 @@ public:
 
     virtual bool isTrackHasProperty(uint32_t trackIdx, MP4_TRACK_PROPERTY_E prop) const override;
 
-    virtual int getAudioSample(uint32_t trackIdx, uint32_t sampleIdx, Mp4AudioFrame &frm) override;
-    virtual int getVideoSample(uint32_t trackIdx, uint32_t sampleIdx, Mp4VideoFrame &frm) override;
-    virtual int getSample(uint32_t trackIdx, uint32_t sampleIdx, Mp4RawSample &outFrame) override;
+    virtual int getAudioSample(uint32_t trackIdx, uint32_t sampleIdx, Mp4AudioFrame &frm) override
+    {
+        return getAudioSample(trackIdx, sampleIdx, frm, nullptr, 0);
+    }
+    virtual int getVideoSample(uint32_t trackIdx, uint32_t sampleIdx, Mp4VideoFrame &frm) override
+    {
+        return getVideoSample(trackIdx, sampleIdx, frm, nullptr, 0);
+    }
+    virtual int getSample(uint32_t trackIdx, uint32_t sampleIdx, Mp4RawSample &outFrame) override
+    {
+        return getSample(trackIdx, sampleIdx, outFrame, nullptr, 0);
+    }
+    virtual int getAudioSample(uint32_t trackIdx, uint32_t sampleIdx, Mp4AudioFrame &frm, uint8_t *buf,
+                               uint64_t bufSize) override;
+    virtual int getVideoSample(uint32_t trackIdx, uint32_t sampleIdx, Mp4VideoFrame &frm, uint8_t *buf,
+                               uint64_t bufSize) override;
+    virtual int getSample(uint32_t trackIdx, uint32_t sampleIdx, Mp4RawSample &outFrame, uint8_t *buf,
+                          uint64_t bufSize) override;
+    virtual int getSampleView(uint32_t trackIdx, uint64_t sampleIdx, Mp4SampleView &view) const override;
+    virtual int getSamples(uint32_t trackIdx, uint64_t firstIdx, uint64_t count,
+                           std::vector<Mp4RawSample> &outSamples) override;
+    virtual int getSampleInfo(uint32_t trackIdx, uint64_t sampleIdx, Mp4SampleItem &sampleInfo) const override;
+
+    virtual int64_t findSampleByTime(uint32_t trackIdx, uint64_t timeMs, MP4_SEEK_MODE_E mode) const override;
 
     Mp4BoxPtr           asBox() const override { return shared_from_this(); }
     virtual std::string getBasicInfoString() const override;
@@ -115,37 +167,151 @@ public:
         return 0;
     }
 
+    static uint32_t fragmentGetSampleFlags(TrackExtendsBoxPtr pTrexBox, TrackFragmentHeaderBoxPtr pTfhdBox,
+                                           TrackRunBoxPtr pTrunBox, uint64_t sampleIdx);
+    static uint32_t fragmentGetSampleSize(TrackExtendsBoxPtr pTrexBox, TrackFragmentHeaderBoxPtr pTfhdBox,
+                                          TrackRunBoxPtr pTrunBox, uint64_t sampleIdx);
+    static uint32_t fragmentGetSampleDuration(TrackExtendsBoxPtr pTrexBox, TrackFragmentHeaderBoxPtr pTfhdBox,
+                                              TrackRunBoxPtr pTrunBox, uint64_t sampleIdx);
+    static uint32_t fragmentGetSampleCompositionOffset(TrackRunBoxPtr pTrunBox, uint64_t sampleIdx);
+    // dtsMs/dtsDeltaMs/ptsMs of a fragment sample decoded at mediaDts
+    static void     fragmentSampleTimes(const FragmentSample &fragSample, uint64_t mediaDts, uint64_t timescale,
+                                        Mp4SampleItem &item);
+
+    // from the box arena of this parse, also used by the box factories of the type registry
+    template <typename T, typename... Args>
+    std::shared_ptr<T> newBox(Args &&...args)
+    {
+        return std::allocate_shared<T>(ArenaAllocator<T>(mBoxArena), std::forward<Args>(args)...);
+    }
+
 private:
+    int          parseOpened();
     CommonBoxPtr parseBox(BinaryFileReader &reader, CommonBoxPtr parentBox, bool &parseErr);
-    uint32_t     fragmentGetSampleFlags(TrackExtendsBoxPtr pTrexBox, TrackFragmentHeaderBoxPtr pTfhdBox, TrackRunBoxPtr pTrunBox,
-                                        uint64_t sampleIdx);
-    uint32_t     fragmentGetSampleSize(TrackExtendsBoxPtr pTrexBox, TrackFragmentHeaderBoxPtr pTfhdBox, TrackRunBoxPtr pTrunBox,
-                                       uint64_t sampleIdx);
-    uint32_t fragmentGetSampleDuration(TrackExtendsBoxPtr pTrexBox, TrackFragmentHeaderBoxPtr pTfhdBox, TrackRunBoxPtr pTrunBox,
-                                       uint64_t sampleIdx);
-    uint32_t fragmentGetSampleCompositionOffset(TrackRunBoxPtr pTrunBox, uint64_t sampleIdx);
+    void         parseTopLevelBoxes(std::vector<CommonBoxPtr> &boxes); // from mScanEndPos, appended to boxes
+    // the top-level box at the cursor; mdat/free/skip are made from their header and jumped over unread
+    CommonBoxPtr parseTopLevelBox(bool &parseErr);
+    void         updateParseProgress(); // from the cursor
+    void         countParsedBox(const CommonBoxPtr &box);
+    int          generateTracks();
+    void         parseSdtp(BinaryFileReader &reader, CommonBoxPtr stbl);
+
+    std::unique_lock<std::mutex>        lockFile(); // mFileMutex, the wait is added to the stats
+    // mTableMutex; no reader takes it while a writer waits for it
+    std::shared_lock<std::shared_mutex> lockTablesShared() const;
+    std::unique_lock<std::shared_mutex> lockTablesExclusive();
+
+    // getSample with mTableMutex already held by the caller
+    int     readSample(uint32_t trackIdx, uint32_t sampleIdx, Mp4RawSample &outSample, uint8_t *buf, uint64_t bufSize);
+    // from samplesInfo, or from the track's SampleLocator in lazy mode; frameType/naluTypes are left empty
+    int     getSampleItem(uint32_t trackIdx, uint64_t sampleIdx, Mp4SampleItem &item) const;
+    // walk from sampleIdx to the nearest key frame, for generated tables without a sync sample table
+    int64_t scanKeyFrame(uint32_t trackIdx, int64_t sampleIdx, bool forward) const;
+
+    // Mp4ParseOptions::sampleIndexCacheDir, in Mp4SampleIndexCache.cpp: the key is taken when the file is opened;
+    // load fills chunksInfo/syncSampleTable/samplesInfo of every track, negative if there's no usable cache
+    void setSampleIndexKey(const std::string &filePath);
+    int  loadSampleIndexCache();
+    void saveSampleIndexCache();
 
     int generateInfoTable(uint32_t trackIdx);
+    int generateSampleTable(uint32_t trackIdx);
+    int generateSampleLocator(uint32_t trackIdx);
     int generateIsoSamplesInfoTable(uint64_t trackIdx);
     int generateFragmentSamplesInfoTable(uint64_t trackIdx);
-    int getH26xFrame(uint32_t trackIdx, uint32_t sampleIdx, Mp4VideoFrame &frm);
+    int collectFragmentSamples();
+    int prepareSampleLocators(); // refresh() in lazy mode: the locators walk mNewMoofBoxes aside
+
+    // moof boxes of the top-level boxes whose next box (their mdat) is complete too; a moof whose mdat is cut short
+    // by the end of file moves mScanEndPos back to it, refresh() takes it once the rest is written
+    std::vector<CommonBoxPtr> takeCompleteMoofBoxes(const std::vector<CommonBoxPtr> &boxes);
+
+    int getTrackTrex(std::vector<TrackExtendsBoxPtr> &trackTrex) const; // by track index, nullptr if missing
+    int walkFragmentRange(const std::vector<CommonBoxPtr> &moofBoxes, size_t firstMoof, size_t lastMoof,
+                          const std::vector<TrackExtendsBoxPtr> &trackTrex, std::vector<FragmentRangeSamples> &trackRanges) const;
+    int getH26xFrame(uint32_t trackIdx, uint32_t sampleIdx, Mp4VideoFrame &frm, uint8_t *buf, uint64_t bufSize);
 
     H26X_FRAME_TYPE_E getH264FrameType(BinaryData &data);
     H26X_FRAME_TYPE_E getH265FrameType(int nalu_type, BinaryData &data);
 
+    void pushError(const std::string &err);
+
 private:
-    BinaryFileReader mFileReader;
-    std::mutex       mFileMutex;
+    Mp4ParseOptions           mOptions;
+    BinaryFileReader          mFileReader;
+    std::mutex                mFileMutex;
+    // the top-level boxes, the sample tables and the file size seen by the sample getters: they hold it shared,
+    // refresh() and loadSampleTables() hold it exclusive while they change them; taken after mFileMutex
+    mutable std::shared_mutex mTableMutex;
+    std::atomic<bool>         mTableWriterWaiting{false};
+
+    // Mp4ParseStats but the read counters kept by mFileReader; the timers and lock counters are updated from
+    // several threads, the box counters only under mFileMutex
+    struct StatCounters
+    {
+        std::atomic<uint64_t> totalUs{0};
+        std::atomic<uint64_t> boxParseUs{0};
+        std::atomic<uint64_t> fragmentCollectUs{0};
+        std::atomic<uint64_t> isoTableUs{0};
+        std::atomic<uint64_t> fragmentTableUs{0};
+        std::atomic<uint64_t> sampleLocatorUs{0};
+        std::atomic<uint64_t> sampleIndexCacheUs{0};
+        std::atomic<uint64_t> fileLockCount{0};
+        std::atomic<uint64_t> fileLockContended{0};
+        std::atomic<uint64_t> fileLockWaitUs{0};
+
+        std::map<Mp4BoxType, uint64_t> boxCount;
+        uint64_t                       tableEntries = 0;
 
+        void reset();
+    } mStats;
+
+    // the box tree of a parse is allocated from here, a new arena is started by clear()
+    std::shared_ptr<MonotonicArena> mBoxArena = std::make_shared<MonotonicArena>();
+
+    // sample fetches run without mFileMutex, errors from them may come from several threads
+    std::mutex              mErrorMutex;
     std::queue<std::string> mErrors;
 
+    // Mp4ParseOptions::headerOnly: sample table boxes created but not parsed yet,
+    // top-level boxes skipped before moov, and where the top-level scan stopped;
+    // a trailing box cut short by the end of file starts at mScanEndPos, refresh() parses it again
+    bool                      mDeferSampleTables = false;
+    std::vector<CommonBoxPtr> mDeferredBoxes;
+    std::vector<uint64_t>     mSkippedBoxPos;
+    uint64_t                  mScanEndPos = 0;
+
+    // the file as it was opened, an empty path when the sample index cache isn't used
+    struct SampleIndexKey
+    {
+        std::string path;
+        uint64_t    fileSize   = 0;
+        int64_t     modifyTime = 0;
+    } mSampleIndexKey;
+    bool mSampleIndexFromCache = false; // the sample tables were loaded, not generated
+
+    // getParseProgress() reads it without mFileMutex, the parse moves it at every top-level box
+    std::atomic<float> mParseProgress{1.f};
+
     bool       mAvailable = false;
     MP4_TYPE_E mMp4Type   = MP4_TYPE_BUTT;
 
     uint64_t mCreationTime     = 0;
     uint64_t mModificationTime = 0;
 
-    std::vector<TrackInfoPtr> tracksInfo;
+    std::vector<TrackInfoPtr>     tracksInfo;
+    std::vector<SampleLocatorPtr> mSampleLocators; // by track index, only filled in lazy mode
+
+    // samples of every fragmented track by [moof range][track index], from one walk over the moof boxes;
+    // each track merges its own column in generateFragmentSamplesInfoTable
+    std::vector<std::vector<FragmentRangeSamples>> mFragmentRanges;
+    // moof boxes not added to the sample tables yet, all of them on parse, the appended ones on refresh
+    std::vector<CommonBoxPtr>                      mNewMoofBoxes;
+    // per track media dts after the last fragment sample, for a following traf without tfdt
+    std::vector<uint64_t>                          mFragmentNextDts;
+
+    // guards the frameType/naluTypes columns of samplesInfo, written by parseVideoNaluType
+    mutable std::mutex mNaluInfoMutex;
 
     struct pps_info
     {
@@ -163,6 +329,8 @@ private:
         uint32_t picHeightInLumaSamples            = 0;
     } mHevcSPSInfo;
 
+    // tracks may be generated in parallel, the codec info below is shared by them
+    std::mutex                                              mCodecInfoMutex;
     std::map<int /* track index, start from 0 */, uint16_t> mNaluLengthSize;
 };
 
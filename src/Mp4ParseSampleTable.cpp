@@ -2,71 +2,53 @@
 #include "Mp4ParseInternal.h"
 #include "Mp4SampleTableTypes.h"
 
-#define READ_ENTRIES_BEGIN(entry_type)            \
-    entryCount = reader.readU32(true);            \
-    entries.reserve(entryCount);                  \
-    for (unsigned int i = 0; i < entryCount; i++) \
-    {                                             \
-        auto entry = make_shared<entry_type>();
+// entryCount comes from the file, the reserve is bounded by what the box body can hold
+#define READ_ENTRIES_BEGIN(entry_type)                                        \
+    entryCount = reader.readU32(true);                                        \
+    entries.reserve(MIN((uint64_t)entryCount, last - reader.getCursorPos())); \
+    for (unsigned int i = 0; i < entryCount; i++)                             \
+    {                                                                         \
+        entry_type &entry = entries.emplace_back();
 
-#define READ_ENTRIES_ITEM(field, data_type) entry->field = reader.read##data_type(true);
+#define READ_ENTRIES_ITEM(field, data_type) entry.field = reader.read##data_type(true);
 
 #define READ_ENTRIES_ITEM_CASE(field, case, data_type1, data_type2) \
     if (case)                                                       \
     {                                                               \
-        entry->field = reader.read##data_type1(true);               \
+        entry.field = reader.read##data_type1(true);                \
     }                                                               \
     else                                                            \
     {                                                               \
-        entry->field = reader.read##data_type2(true);               \
+        entry.field = reader.read##data_type2(true);                \
     }
 
-#define READ_ENTRIES_ITEM_UNSIGNED(field, len) entry->field = reader.readUnsigned(len, true);
+#define READ_ENTRIES_ITEM_UNSIGNED(field, len) entry.field = reader.readUnsigned(len, true);
 
-#define READ_ENTRIES_END()    \
-    entries.push_back(entry); \
-    }
+#define READ_ENTRIES_END() }
 
-using std::make_shared;
+// entries made only of value_type fields, in file order, are read and byte swapped in one go;
+// entries running past the body would fail BOX_PARSE_END anyway, so that's checked before allocating them
+#define READ_ENTRIES_ARRAY(entry_type, value_type, data_type)                                                     \
+    static_assert(sizeof(entry_type) % sizeof(value_type) == 0, #entry_type " is not made of " #value_type);      \
+    if (reader.getCursorPos() > last || (uint64_t)entryCount * sizeof(entry_type) > last - reader.getCursorPos()) \
+    {                                                                                                             \
+        MP4_ERR("%s %u entries run past the box end\n", getBoxTypeStr().c_str(), entryCount);                     \
+        reader.setCursor(last);                                                                                   \
+        return -1;                                                                                                \
+    }                                                                                                             \
+    entries.resize(entryCount);                                                                                   \
+    reader.read##data_type##Array((value_type *)entries.data(),                                                   \
+                                  (uint64_t)entryCount * (sizeof(entry_type) / sizeof(value_type)));
 
 // static uint64_t g_reserve8;
 
 std::shared_ptr<Mp4BoxData> SampleTableBox::getData(std::shared_ptr<Mp4BoxData> src) const
 {
-    std::string                 tableName = "Entry";
-    std::shared_ptr<Mp4BoxData> item      = src;
+    std::shared_ptr<Mp4BoxData> item = src;
     if (nullptr == item)
         item = Mp4BoxData::createKeyValuePairsData();
 
-    item->kvAddPair(tableName + " Count", entryCount);
-
-    // check if there's no entry table, for example, stsz could only use default size but no entry
-    if (entries.empty())
-        return item;
-
-    std::shared_ptr<Mp4BoxData> entryTable = item->kvAddKey(tableName + "s", MP4_BOX_DATA_TYPE_TABLE);
-
-    entries[0]->setColumnsName(entryTable);
-    entryTable->tableSetCallbacks(
-        [](const void *userData)
-        {
-            std::vector<std::shared_ptr<BasicSampleItem>> *pEntries =
-                (std::vector<std::shared_ptr<BasicSampleItem>> *)userData;
-            return pEntries->size();
-        },
-        [](const void *userData, uint64_t rowIdx)
-        {
-            std::vector<std::shared_ptr<BasicSampleItem>> *pEntries =
-                (std::vector<std::shared_ptr<BasicSampleItem>> *)userData;
-            return (*pEntries)[rowIdx]->getData();
-        },
-        [](const void *userData, uint64_t rowIdx, uint64_t colIdx)
-        {
-            std::vector<std::shared_ptr<BasicSampleItem>> *pEntries =
-                (std::vector<std::shared_ptr<BasicSampleItem>> *)userData;
-            return (*pEntries)[rowIdx]->getData(colIdx);
-        },
-        &entries);
+    item->kvAddPair("Entry Count", entryCount);
     return item;
 }
 
@@ -74,10 +56,8 @@ int TimeToSampleBox::parse(BinaryFileReader &reader, uint64_t boxPosition, uint6
 {
     BOX_PARSE_BEGIN();
 
-    READ_ENTRIES_BEGIN(sttsItem)
-    READ_ENTRIES_ITEM(sampleCount, U32)
-    READ_ENTRIES_ITEM(delta, U32)
-    READ_ENTRIES_END()
+    entryCount = reader.readU32(true);
+    READ_ENTRIES_ARRAY(sttsItem, uint32_t, U32)
 
     BOX_PARSE_END();
 
@@ -102,11 +82,8 @@ int SampleToChunkBox::parse(BinaryFileReader &reader, uint64_t boxPosition, uint
 {
     BOX_PARSE_BEGIN();
 
-    READ_ENTRIES_BEGIN(stscItem)
-    READ_ENTRIES_ITEM(firstChunk, U32)
-    READ_ENTRIES_ITEM(sampleCount, U32)
-    READ_ENTRIES_ITEM(sampleDescIdx, U32)
-    READ_ENTRIES_END()
+    entryCount = reader.readU32(true);
+    READ_ENTRIES_ARRAY(stscItem, uint32_t, U32)
 
     BOX_PARSE_END();
 
@@ -123,13 +100,7 @@ int SampleSizeBox::parse(BinaryFileReader &reader, uint64_t boxPosition, uint64_
 
     if (0 == defaultSampleSize)
     {
-        entries.reserve(entryCount);
-        for (unsigned int i = 0; i < entryCount; ++i)
-        {
-            auto stsz_entry        = make_shared<stszItem>();
-            stsz_entry->sampleSize = reader.readU32(true);
-            entries.push_back(stsz_entry);
-        }
+        READ_ENTRIES_ARRAY(stszItem, uint32_t, U32)
     }
 
     BOX_PARSE_END();
@@ -143,7 +114,7 @@ std::shared_ptr<Mp4BoxData> SampleSizeBox::getData(std::shared_ptr<Mp4BoxData> s
         item = Mp4BoxData::createKeyValuePairsData();
 
     item->kvAddPair("Default Sample Size", defaultSampleSize);
-    SampleTableBox::getData(item);
+    EntryTableBox::getData(item);
     return item;
 }
 
@@ -164,10 +135,9 @@ int CompactSampleSizeBox::parse(BinaryFileReader &reader, uint64_t boxPosition,
     }
 
     entryCount = reader.readU32(true);
-    entries.reserve(entryCount);
+    entries.reserve(MIN((uint64_t)entryCount, (last - reader.getCursorPos()) * 2));
     for (unsigned int i = 0; i < entryCount; ++i)
     {
-        auto     stz2Entry = make_shared<stz2Item>();
         uint16_t sampleSize;
         uint8_t  twoEntry = 0;
         if (4 == fieldSize)
@@ -180,15 +150,11 @@ int CompactSampleSizeBox::parse(BinaryFileReader &reader, uint64_t boxPosition,
             sampleSize = static_cast<uint16_t>(reader.readUnsigned(fieldSize / 8, true));
         }
 
-        stz2Entry->sampleSize = sampleSize;
-        entries.push_back(stz2Entry);
+        entries.emplace_back().sampleSize = sampleSize;
 
         if (4 == fieldSize && i + 1 < entryCount)
         {
-            sampleSize            = (twoEntry & 0x0f);
-            stz2Entry             = make_shared<stz2Item>();
-            stz2Entry->sampleSize = sampleSize;
-            entries.push_back(stz2Entry);
+            entries.emplace_back().sampleSize = (twoEntry & 0x0f);
             ++i;
         }
     }
@@ -205,7 +171,7 @@ std::shared_ptr<Mp4BoxData> CompactSampleSizeBox::getData(std::shared_ptr<Mp4Box
         item = Mp4BoxData::createKeyValuePairsData();
 
     item->kvAddPair("Field Size", fieldSize);
-    SampleTableBox::getData(item);
+    EntryTableBox::getData(item);
     return item;
 }
 
@@ -221,20 +187,18 @@ int SampleDependencyTypeBox::parse(BinaryFileReader &reader, uint64_t boxPositio
         return 0;
     }
 
-    entries.reserve(entryCount);
+    entries.reserve(MIN((uint64_t)entryCount, last - reader.getCursorPos()));
     for (unsigned int i = 0; i < entryCount; ++i)
     {
-        uint8_t compact1;
-        auto    sdtpEntry = make_shared<sdtpItem>();
+        uint8_t   compact1;
+        sdtpItem &sdtpEntry = entries.emplace_back();
         reader.read(&compact1, 1);
 
         BitsReader bitsReader(&compact1, 1);
-        sdtpEntry->isLeading           = (uint8_t)bitsReader.readBit(2);
-        sdtpEntry->sampleDependsOn     = (uint8_t)bitsReader.readBit(2);
-        sdtpEntry->sampleDependedOn    = (uint8_t)bitsReader.readBit(2);
-        sdtpEntry->sampleHasRedundancy = (uint8_t)bitsReader.readBit(2);
-
-        entries.push_back(sdtpEntry);
+        sdtpEntry.isLeading           = (uint8_t)bitsReader.readBit(2);
+        sdtpEntry.sampleDependsOn     = (uint8_t)bitsReader.readBit(2);
+        sdtpEntry.sampleDependedOn    = (uint8_t)bitsReader.readBit(2);
+        sdtpEntry.sampleHasRedundancy = (uint8_t)bitsReader.readBit(2);
     }
 
     BOX_PARSE_END();
@@ -246,9 +210,8 @@ int ChunkOffsetBox::parse(BinaryFileReader &reader, uint64_t boxPosition, uint64
 {
     BOX_PARSE_BEGIN();
 
-    READ_ENTRIES_BEGIN(stcoItem)
-    READ_ENTRIES_ITEM(chunkOffset, U32)
-    READ_ENTRIES_END()
+    entryCount = reader.readU32(true);
+    READ_ENTRIES_ARRAY(stcoItem, uint32_t, U32)
 
     BOX_PARSE_END();
 
@@ -259,9 +222,8 @@ int ChunkLargeOffsetBox::parse(BinaryFileReader &reader, uint64_t boxPosition, u
 {
     BOX_PARSE_BEGIN();
 
-    READ_ENTRIES_BEGIN(co64Item)
-    READ_ENTRIES_ITEM(chunkOffset, U64)
-    READ_ENTRIES_END()
+    entryCount = reader.readU32(true);
+    READ_ENTRIES_ARRAY(co64Item, uint64_t, U64)
 
     BOX_PARSE_END();
 
@@ -272,9 +234,8 @@ int SyncSampleBox::parse(BinaryFileReader &reader, uint64_t boxPosition, uint64_
 {
     BOX_PARSE_BEGIN();
 
-    READ_ENTRIES_BEGIN(stssItem)
-    READ_ENTRIES_ITEM(sampleNumber, U32)
-    READ_ENTRIES_END()
+    entryCount = reader.readU32(true);
+    READ_ENTRIES_ARRAY(stssItem, uint32_t, U32)
 
     BOX_PARSE_END();
     return 0;
@@ -305,26 +266,24 @@ int SampleGroupDescriptionBox::parse(BinaryFileReader &reader, uint64_t boxPosit
     }
 
     entryCount = reader.readU32(true);
-    entries.reserve(entryCount);
+    entries.reserve(MIN((uint64_t)entryCount, last - reader.getCursorPos()));
     for (unsigned int i = 0; i < entryCount; i++)
     {
-        auto entry = make_shared<sgpdEntry>();
+        sgpdEntry &entry = entries.emplace_back();
 
         uint32_t length;
         if (mFullboxVersion == 1 && defaultLength == 0)
         {
-            length                   = reader.readU32(true);
-            entry->descriptionLength = length;
+            length                  = reader.readU32(true);
+            entry.descriptionLength = length;
         }
         else
         {
             length = defaultLength;
         }
 
-        entry->description.create(length);
-        reader.read(entry->description.ptr(), length);
-
-        entries.push_back(entry);
+        entry.description.create(length);
+        reader.read(entry.description.ptr(), length);
     }
 
     BOX_PARSE_END();
@@ -344,7 +303,7 @@ std::shared_ptr<Mp4BoxData> SampleGroupDescriptionBox::getData(std::shared_ptr<M
     if (mFullboxVersion >= 2)
         item->kvAddPair("Default Sample Description Index", defaultSampleDescIdx);
 
-    SampleTableBox::getData(item);
+    EntryTableBox::getData(item);
 
     return item;
 }
@@ -380,7 +339,7 @@ std::shared_ptr<Mp4BoxData> SampleToGroupBox::getData(std::shared_ptr<Mp4BoxData
     if (1 == mFullboxVersion)
         item->kvAddPair("Grouping Type Parameter", groupingTypePar);
 
-    SampleTableBox::getData(item);
+    EntryTableBox::getData(item);
 
     return item;
 }
@@ -419,36 +378,36 @@ int TrackRunBox::parse(BinaryFileReader &reader, uint64_t boxPosition, uint64_t
         firstSampleFlags = reader.readU32(true);
     }
 
+    entries.reserve(MIN((uint64_t)entryCount, last - reader.getCursorPos()));
     for (unsigned int i = 0; i < entryCount; ++i)
     {
-        auto trun_sample = std::make_shared<trunItem>();
+        trunItem &trun_sample = entries.emplace_back();
 
-        trun_sample->boxFlags = mFullboxFlags;
+        trun_sample.boxFlags = mFullboxFlags;
 
         if (mFullboxFlags & MP4_TRUN_FLAG_SAMPLE_DURATION_PRESENT)
         {
-            trun_sample->duration = reader.readU32(true);
+            trun_sample.duration = reader.readU32(true);
         }
         if (mFullboxFlags & MP4_TRUN_FLAG_SAMPLE_SIZE_PRESENT)
         {
-            trun_sample->size = reader.readU32(true);
+            trun_sample.size = reader.readU32(true);
         }
         if (mFullboxFlags & MP4_TRUN_FLAG_SAMPLE_FLAGS_PRESENT)
         {
-            trun_sample->flags = reader.readU32(true);
+            trun_sample.flags = reader.readU32(true);
         }
         if (mFullboxFlags & MP4_TRUN_FLAG_SAMPLE_COMPOSITION_TIME_OFFSETS_PRESENT)
         {
             if (1 == mFullboxVersion)
             {
-                trun_sample->composOffset = reader.readS32(true);
+                trun_sample.composOffset = reader.readS32(true);
             }
             else
             {
-                trun_sample->composOffset = reader.readU32(true);
+                trun_sample.composOffset = reader.readU32(true);
             }
         }
-        entries.push_back(trun_sample);
     }
 
     BOX_PARSE_END();
@@ -468,7 +427,7 @@ std::shared_ptr<Mp4BoxData> TrackRunBox::getData(std::shared_ptr<Mp4BoxData> src
     if (mFullboxFlags & MP4_TRUN_FLAG_FIRST_SAMPLE_FLAGS_PRESENT)
         item->kvAddPair("First Sample Flags", firstSampleFlags);
 
-    SampleTableBox::getData(item);
+    EntryTableBox::getData(item);
 
     return item;
 }
@@ -514,7 +473,7 @@ std::shared_ptr<Mp4BoxData> TrackFragmentRandomAccessBox::getData(std::shared_pt
         ->kvAddPair("Length Size of Trun Number", lenSzTrunNum)
         ->kvAddPair("Length Size of Sample Number", lenSzSampleNum);
 
-    SampleTableBox::getData(item);
+    EntryTableBox::getData(item);
 
     return item;
 }
@@ -5,6 +5,26 @@
 #include <inttypes.h>
 #include <string>
 #include <filesystem>
+#include <atomic>
+#include <algorithm>
+#include <thread>
+#if defined(WIN32) || defined(_WIN32)
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+    #include <io.h>
+#else
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+    #define MP4_SWAP_X86
+    #include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #define MP4_SWAP_NEON
+    #include <arm_neon.h>
+#endif
 #include "Mp4ParseTools.h"
 #include "Mp4Parse.h"
 
@@ -80,11 +100,13 @@ using file_stat64_t = struct stat;
 #endif
 
 std::function<void(MP4_LOG_LEVEL_E, const char *)> gLogCallback = defaultLogCallback;
+std::atomic<int>                                   gLogLevel(MP4_LOG_LEVEL_ALL);
+
 void setMp4ParseLogCallback(std::function<void(MP4_LOG_LEVEL_E, const char *)> logCallback)
 {
     if (nullptr == logCallback)
     {
-        logCallback = defaultLogCallback;
+        gLogCallback = defaultLogCallback;
     }
     else
     {
@@ -92,6 +114,144 @@ void setMp4ParseLogCallback(std::function<void(MP4_LOG_LEVEL_E, const char *)> l
     }
 }
 
+void setMp4ParseLogLevel(MP4_LOG_LEVEL_E maxLevel)
+{
+    gLogLevel.store(maxLevel, std::memory_order_relaxed);
+}
+
+MP4_LOG_LEVEL_E getMp4ParseLogLevel()
+{
+    return (MP4_LOG_LEVEL_E)gLogLevel.load(std::memory_order_relaxed);
+}
+
+void runTasks(uint32_t threadCount, size_t taskCount, const std::function<void(size_t)> &task)
+{
+    if (0 == threadCount)
+        threadCount = MAX(1u, std::thread::hardware_concurrency());
+    if (threadCount > taskCount)
+        threadCount = (uint32_t)taskCount;
+
+    if (threadCount <= 1)
+    {
+        for (size_t i = 0; i < taskCount; i++)
+            task(i);
+        return;
+    }
+
+    std::atomic<size_t>      nextTask(0);
+    std::vector<std::thread> workers;
+    for (uint32_t i = 0; i < threadCount; i++)
+    {
+        workers.emplace_back([&]() {
+            for (size_t taskIdx = nextTask++; taskIdx < taskCount; taskIdx = nextTask++)
+                task(taskIdx);
+        });
+    }
+    for (auto &worker : workers)
+        worker.join();
+}
+
+#ifdef MP4_SWAP_X86
+// each returns how many values it swapped, the tail is left to the scalar loop
+__attribute__((target("avx2"))) static uint64_t swapBytes32Avx2(uint32_t *data, uint64_t count)
+{
+    const __m256i mask = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12, //
+                                          3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    uint64_t      i    = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+        _mm256_storeu_si256((__m256i *)(data + i), _mm256_shuffle_epi8(v, mask));
+    }
+    return i;
+}
+
+__attribute__((target("avx2"))) static uint64_t swapBytes64Avx2(uint64_t *data, uint64_t count)
+{
+    const __m256i mask = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8, //
+                                          7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    uint64_t      i    = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+        _mm256_storeu_si256((__m256i *)(data + i), _mm256_shuffle_epi8(v, mask));
+    }
+    return i;
+}
+
+__attribute__((target("ssse3"))) static uint64_t swapBytes32Ssse3(uint32_t *data, uint64_t count)
+{
+    const __m128i mask = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    uint64_t      i    = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        _mm_storeu_si128((__m128i *)(data + i), _mm_shuffle_epi8(v, mask));
+    }
+    return i;
+}
+
+__attribute__((target("ssse3"))) static uint64_t swapBytes64Ssse3(uint64_t *data, uint64_t count)
+{
+    const __m128i mask = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    uint64_t      i    = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        _mm_storeu_si128((__m128i *)(data + i), _mm_shuffle_epi8(v, mask));
+    }
+    return i;
+}
+
+// 2 for AVX2, 1 for SSSE3, 0 for neither; checked once
+static int x86SimdLevel()
+{
+    static const int level = []() {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return 2;
+        if (__builtin_cpu_supports("ssse3"))
+            return 1;
+        return 0;
+    }();
+    return level;
+}
+#endif
+
+void swapBytes32(uint32_t *data, uint64_t count)
+{
+    uint64_t i = 0;
+#if defined(MP4_SWAP_X86)
+    int level = x86SimdLevel();
+    if (level >= 2)
+        i = swapBytes32Avx2(data, count);
+    else if (level >= 1)
+        i = swapBytes32Ssse3(data, count);
+#elif defined(MP4_SWAP_NEON)
+    for (; i + 4 <= count; i += 4)
+        vst1q_u8((uint8_t *)(data + i), vrev32q_u8(vld1q_u8((const uint8_t *)(data + i))));
+#endif
+    for (; i < count; i++)
+        data[i] = bswap_32(data[i]);
+}
+
+void swapBytes64(uint64_t *data, uint64_t count)
+{
+    uint64_t i = 0;
+#if defined(MP4_SWAP_X86)
+    int level = x86SimdLevel();
+    if (level >= 2)
+        i = swapBytes64Avx2(data, count);
+    else if (level >= 1)
+        i = swapBytes64Ssse3(data, count);
+#elif defined(MP4_SWAP_NEON)
+    for (; i + 2 <= count; i += 2)
+        vst1q_u8((uint8_t *)(data + i), vrev64q_u8(vld1q_u8((const uint8_t *)(data + i))));
+#endif
+    for (; i < count; i++)
+        data[i] = bswap_64(data[i]);
+}
+
 string hexString(uint32_t val)
 {
     std::stringstream ss;
@@ -99,41 +259,227 @@ string hexString(uint32_t val)
     return ss.str();
 }
 
-BinaryFileReader::BinaryFileReader()
+void *MonotonicArena::allocate(size_t size, size_t align)
+{
+    size_t pad = (align - (uintptr_t)mCur % align) % align;
+    if (nullptr == mCur || pad + size > mLeft)
+    {
+        // a large object gets a block of its own, the current one keeps serving the small ones
+        if (size + align > mBlockSize / 4)
+        {
+            mBlocks.push_back(std::make_unique<uint8_t[]>(size + align));
+            uint8_t *block = mBlocks.back().get();
+            return block + (align - (uintptr_t)block % align) % align;
+        }
+        mBlocks.push_back(std::make_unique<uint8_t[]>(mBlockSize));
+        mCur  = mBlocks.back().get();
+        mLeft = mBlockSize;
+        pad   = (align - (uintptr_t)mCur % align) % align;
+    }
+
+    void *ptr = mCur + pad;
+    mCur += pad + size;
+    mLeft -= pad + size;
+    return ptr;
+}
+
+BinaryFileReader::BinaryFileReader() {}
+
+void BinaryFileReader::setCacheConfig(uint32_t blockSize, uint32_t blockCount, uint32_t readaheadBlocks)
 {
-    mReadBuffer = std::make_unique<uint8_t[]>(mBufferSize);
+    mBlockSize    = MAX(blockSize, 512U);
+    mBlockCount   = blockCount;
+    mMaxReadahead = MIN(MAX(readaheadBlocks, 1U), MAX(blockCount, 1U));
+
+    mBlocks.clear();
+    mReadaheadBuffer.reset();
+    invalidateCache();
 }
 
-int BinaryFileReader::checkBuffer(uint64_t readPos, uint64_t readSize)
+void BinaryFileReader::invalidateCache()
 {
-    if (readPos >= fileSize)
+    for (auto &block : mBlocks)
     {
-        return -1;
+        block.start   = UINT64_MAX;
+        block.size    = 0;
+        block.lastUse = 0;
     }
+    mLastBlock     = 0;
+    mNextMissStart = UINT64_MAX;
+    mReadahead     = 1;
+}
 
-    uint64_t canReadSize = MIN(readSize, fileSize - readPos);
+const BinaryFileReader::CacheBlock *BinaryFileReader::getBlock(uint64_t pos)
+{
+    uint64_t blockStart = pos - pos % mBlockSize;
 
-    if (mBufferStartOffset > readPos || readPos + canReadSize > mBufferStartOffset + mBufferContainSize)
+    if (mLastBlock < mBlocks.size() && mBlocks[mLastBlock].start == blockStart)
     {
-        mBufferContainSize = MIN(fileSize - readPos, mBufferSize);
-        if (fseek64(mFileHandle, readPos, SEEK_SET) < 0)
+        mCacheHits++;
+        return &mBlocks[mLastBlock];
+    }
+
+    for (size_t i = 0; i < mBlocks.size(); i++)
+    {
+        if (mBlocks[i].start == blockStart)
         {
-            MP4_ERR("seek to 0x%" PRIx64 " fail %s\n", readPos, strerror(errno));
-            return -1;
+            mBlocks[i].lastUse = ++mUseCounter;
+            mLastBlock         = i;
+            mCacheHits++;
+            return &mBlocks[i];
         }
-        if (fread(mReadBuffer.get(), 1, mBufferContainSize, mFileHandle) != mBufferContainSize)
+    }
+    mCacheMisses++;
+
+    if (mBlocks.empty())
+    {
+        mBlocks.resize(mBlockCount);
+        for (auto &block : mBlocks)
+            block.data = std::make_unique<uint8_t[]>(mBlockSize);
+    }
+
+    // grow the window while the misses stay sequential, back to one block on a jump
+    mReadahead     = blockStart == mNextMissStart ? MIN(mReadahead * 2, mMaxReadahead) : 1;
+    uint64_t count = MIN((uint64_t)mReadahead, (fileSize - blockStart + mBlockSize - 1) / mBlockSize);
+    for (uint64_t i = 1; i < count; i++)
+    {
+        uint64_t nextStart = blockStart + i * mBlockSize;
+        if (std::any_of(mBlocks.begin(), mBlocks.end(),
+                        [nextStart](const CacheBlock &block) { return block.start == nextStart; }))
+            count = i;
+    }
+
+    uint8_t *readBuf;
+    uint64_t readSize = MIN(count * mBlockSize, fileSize - blockStart);
+    if (count > 1)
+    {
+        if (!mReadaheadBuffer)
+            mReadaheadBuffer = std::make_unique<uint8_t[]>(mMaxReadahead * mBlockSize);
+        readBuf = mReadaheadBuffer.get();
+    }
+    else
+    {
+        // read straight into the block that is replaced
+        size_t victim = 0;
+        for (size_t i = 1; i < mBlocks.size(); i++)
         {
-            MP4_ERR("read %s fail(%s), pos 0x%" PRIx64 ", size 0x%" PRIx64 "\n", mFileFullPath.c_str(), strerror(errno), readPos,
-                    mBufferContainSize);
-            return -1;
+            if (mBlocks[i].lastUse < mBlocks[victim].lastUse)
+                victim = i;
         }
-        mBufferStartOffset = readPos;
-        MP4_DBG("update buffer, pos=0x%" PRIx64 ", size=0x%" PRIx64 "\n", mBufferStartOffset, mBufferContainSize);
+        mBlocks[victim].start = UINT64_MAX;
+        readBuf               = mBlocks[victim].data.get();
+    }
+
+    uint64_t gotSize = readSource(blockStart, readBuf, readSize);
+    if (gotSize != readSize)
+    {
+        MP4_ERR("read %s fail(%s), pos 0x%" PRIx64 ", size 0x%" PRIx64 "\n", mFileFullPath.c_str(), strerror(errno), blockStart,
+                readSize);
+        if (0 == gotSize)
+            return nullptr;
+    }
+    MP4_DBG("cache miss, pos=0x%" PRIx64 ", size=0x%" PRIx64 "\n", blockStart, gotSize);
+
+    mNextMissStart = blockStart + count * mBlockSize;
+
+    CacheBlock *first = nullptr;
+    for (uint64_t i = 0; i < count && i * mBlockSize < gotSize; i++)
+    {
+        size_t victim = 0;
+        for (size_t j = 1; j < mBlocks.size(); j++)
+        {
+            if (mBlocks[j].lastUse < mBlocks[victim].lastUse)
+                victim = j;
+        }
+
+        CacheBlock &block = mBlocks[victim];
+        block.start       = blockStart + i * mBlockSize;
+        block.size        = MIN(mBlockSize, gotSize - i * mBlockSize);
+        block.lastUse     = ++mUseCounter;
+        if (readBuf != block.data.get())
+            memcpy(block.data.get(), readBuf + i * mBlockSize, block.size);
+
+        if (!first)
+        {
+            first      = &block;
+            mLastBlock = victim;
+        }
+    }
+
+    return first;
+}
+
+uint64_t BinaryFileReader::readSource(uint64_t pos, void *buf, uint64_t len)
+{
+    uint64_t readSize;
+
+    mSourceReads++;
+    if (mSource)
+    {
+        readSize = mSource->readAt(pos, buf, len);
+    }
+    else
+    {
+        mSeeks++;
+        if (fseek64(mFileHandle, pos, SEEK_SET) < 0)
+        {
+            MP4_ERR("seek to 0x%" PRIx64 " fail %s\n", pos, strerror(errno));
+            return 0;
+        }
+        readSize = fread(buf, 1, len, mFileHandle);
+    }
+    mSourceBytes += readSize;
+    return readSize;
+}
+
+void BinaryFileReader::getIoStats(Mp4ParseStats &stats) const
+{
+    stats.sourceReads     = mSourceReads;
+    stats.sourceBytes     = mSourceBytes;
+    stats.seeks           = mSeeks;
+    stats.cacheHits       = mCacheHits;
+    stats.cacheMisses     = mCacheMisses;
+    stats.positionalReads = mPositionalReads.load(std::memory_order_relaxed);
+    stats.positionalBytes = mPositionalBytes.load(std::memory_order_relaxed);
+}
+
+int BinaryFileReader::mapFile()
+{
+#if defined(WIN32) || defined(_WIN32)
+    MP4_WARN("mmap not supported on this platform, use stdio\n");
+    return -1;
+#else
+    if (0 == fileSize)
+        return -1;
+
+    uint64_t mapSize = fileSize;
+    void    *addr    = mmap(nullptr, mapSize, PROT_READ, MAP_PRIVATE, fileno(mFileHandle), 0);
+    if (MAP_FAILED == addr)
+    {
+        MP4_WARN("mmap %s fail(%s), use stdio\n", mFileFullPath.c_str(), strerror(errno));
+        return -1;
     }
+    mMapData.reset((uint8_t *)addr, [mapSize](uint8_t *p) { munmap(p, mapSize); });
     return 0;
+#endif
 }
 
-int BinaryFileReader::open(std::string &newFileName)
+std::shared_ptr<const uint8_t> BinaryFileReader::getMappedData(uint64_t pos, uint64_t len) const
+{
+    std::shared_ptr<uint8_t> mapData;
+    uint64_t                 size;
+    {
+        std::shared_lock<std::shared_mutex> locker(mMapMutex);
+        mapData = mMapData;
+        size    = fileSize;
+    }
+    if (!mapData || pos < mMapStart || pos > size || len > size - pos)
+        return nullptr;
+
+    return std::shared_ptr<const uint8_t>(mapData, mapData.get() + (pos - mMapStart));
+}
+
+int BinaryFileReader::open(std::string &newFileName, MP4_READ_MODE_E mode)
 {
     int   ret = -1;
     FILE *tmpFp;
@@ -169,6 +515,7 @@ int BinaryFileReader::open(std::string &newFileName)
 
     mFileHandle = tmpFp;
     fileSize    = file.file_size(errCode);
+    mMapStart   = 0;
 
     mReadPos = 0;
 
@@ -179,24 +526,120 @@ int BinaryFileReader::open(std::string &newFileName)
     mBaseName     = file.path().stem().string();
     mExtension    = file.path().extension().string();
 
-    if (mReadBuffer)
+    invalidateCache();
+    if (MP4_READ_MODE_MMAP == mode)
+        mapFile();
+    ret = 0;
+
+exit:
+    return ret;
+}
+
+int BinaryFileReader::open(std::shared_ptr<Mp4ByteSource> source)
+{
+    if (nullptr == source)
+        return -1;
+
+    close();
+
+    mSource   = source;
+    fileSize  = source->getSize();
+    mReadPos  = 0;
+    mMapStart = 0;
+
+    mFileFullPath = source->getName();
+    mFileName     = mFileFullPath;
+    mBaseName     = mFileFullPath;
+    mDrive.clear();
+    mDir.clear();
+    mExtension.clear();
+
+    // in memory already, the source keeps it alive
+    if (source->getData() != nullptr)
+        mMapData = std::shared_ptr<uint8_t>(source, const_cast<uint8_t *>(source->getData()));
+
+    invalidateCache();
+
+    return 0;
+}
+
+int BinaryFileReader::openMemory(const uint8_t *data, uint64_t size, uint64_t startPos)
+{
+    if (nullptr == data || 0 == size)
+        return -1;
+
+    close();
+
+    // not owned, released by the caller
+    mMapData.reset(const_cast<uint8_t *>(data), [](uint8_t *) {});
+    mMapStart = startPos;
+    fileSize  = startPos + size;
+    mReadPos  = startPos;
+
+    invalidateCache();
+
+    return 0;
+}
+
+int BinaryFileReader::updateFileSize()
+{
+    uint64_t newSize;
+    if (mSource)
     {
-        mBufferContainSize = MIN(fileSize, mBufferSize);
-        size_t readSize    = fread(mReadBuffer.get(), 1, mBufferContainSize, mFileHandle);
-        if (readSize != mBufferContainSize)
+        newSize = mSource->getSize();
+    }
+    else if (mFileHandle)
+    {
+        std::error_code errCode;
+        newSize = fs::file_size(mFileFullPath, errCode);
+        if (errCode)
         {
-            MP4_ERR("read err %zu != 0x%" PRIx64 "\n", readSize, mBufferContainSize);
+            MP4_ERR("Get file size %s fail %s\n", mFileFullPath.c_str(), errCode.message().c_str());
+            return -1;
         }
-        mBufferStartOffset = 0;
     }
-    ret = 0;
+    else
+    {
+        return -1;
+    }
 
-exit:
-    return ret;
+    std::unique_lock<std::shared_mutex> locker(mMapMutex);
+    if (newSize <= fileSize)
+        return 0;
+
+    fileSize = newSize;
+
+    // the last block may have been cut short at the old end of file
+    invalidateCache();
+
+    // views into the old mapping keep it alive until they're released
+    if (mSource)
+    {
+        mMapData.reset();
+        if (mSource->getData() != nullptr)
+            mMapData = std::shared_ptr<uint8_t>(mSource, const_cast<uint8_t *>(mSource->getData()));
+    }
+    else if (mMapData && mapFile() < 0)
+    {
+        mMapData.reset();
+    }
+
+    return 1;
 }
 
 int BinaryFileReader::close()
 {
+    mMapData.reset();
+    mSource.reset();
+
+    mSourceReads = 0;
+    mSourceBytes = 0;
+    mSeeks       = 0;
+    mCacheHits   = 0;
+    mCacheMisses = 0;
+    mPositionalReads.store(0, std::memory_order_relaxed);
+    mPositionalBytes.store(0, std::memory_order_relaxed);
+
     if (!mFileHandle)
         return 0;
 
@@ -224,37 +667,145 @@ uint64_t BinaryFileReader::read(void *buf, uint64_t len)
     return rdSize;
 }
 
-uint64_t BinaryFileReader::readAt(uint64_t pos, void *buf, uint64_t len)
+uint64_t BinaryFileReader::readAt(uint64_t pos, void *buf, uint64_t len) const
 {
-    setFileCursor(pos);
-    uint64_t ret = fread(buf, 1, len, mFileHandle);
+    // the copy keeps the mapping alive if updateFileSize() replaces it meanwhile
+    std::shared_ptr<uint8_t> mapData;
+    uint64_t                 size;
+    {
+        std::shared_lock<std::shared_mutex> locker(mMapMutex);
+        mapData = mMapData;
+        size    = fileSize;
+    }
 
-    return ret;
+    if (pos >= size)
+        return 0;
+
+    len = MIN(len, size - pos);
+
+    if (mapData)
+    {
+        if (pos < mMapStart)
+            return 0;
+        memcpy(buf, mapData.get() + (pos - mMapStart), len);
+        return len;
+    }
+
+    if (!mSource && !mFileHandle)
+        return 0;
+
+    mPositionalReads.fetch_add(1, std::memory_order_relaxed);
+    if (mSource)
+    {
+        uint64_t readSize = mSource->readAt(pos, buf, len);
+        mPositionalBytes.fetch_add(readSize, std::memory_order_relaxed);
+        return readSize;
+    }
+
+    uint64_t readSize = 0;
+#if defined(WIN32) || defined(_WIN32)
+    HANDLE hFile = (HANDLE)_get_osfhandle(_fileno(mFileHandle));
+    while (readSize < len)
+    {
+        OVERLAPPED overlapped = {0};
+        uint64_t   curPos     = pos + readSize;
+        DWORD      curSize    = (DWORD)MIN(len - readSize, (uint64_t)0x40000000);
+        DWORD      doneSize   = 0;
+
+        overlapped.Offset     = (DWORD)(curPos & 0xffffffff);
+        overlapped.OffsetHigh = (DWORD)(curPos >> 32);
+        if (!ReadFile(hFile, (uint8_t *)buf + readSize, curSize, &doneSize, &overlapped))
+        {
+            MP4_ERR("read %s fail(%lu), pos 0x%" PRIx64 "\n", mFileFullPath.c_str(), GetLastError(), curPos);
+            break;
+        }
+        if (0 == doneSize)
+            break;
+        readSize += doneSize;
+    }
+#else
+    int fd = fileno(mFileHandle);
+    while (readSize < len)
+    {
+    #ifdef __linux
+        ssize_t ret = pread64(fd, (uint8_t *)buf + readSize, len - readSize, pos + readSize);
+    #else
+        ssize_t ret = pread(fd, (uint8_t *)buf + readSize, len - readSize, pos + readSize);
+    #endif
+        if (ret < 0)
+        {
+            if (EINTR == errno)
+                continue;
+            MP4_ERR("read %s fail(%s), pos 0x%" PRIx64 "\n", mFileFullPath.c_str(), strerror(errno), pos + readSize);
+            break;
+        }
+        if (0 == ret)
+            break;
+        readSize += (uint64_t)ret;
+    }
+#endif
+
+    mPositionalBytes.fetch_add(readSize, std::memory_order_relaxed);
+    return readSize;
 }
 
 uint64_t BinaryFileReader::readStill(void *buf, uint64_t len)
 {
     uint64_t readSize;
 
-    if (len <= mBufferSize)
+    if (mMapData)
     {
-        if (checkBuffer(mReadPos, len) < 0)
-        {
+        if (mReadPos >= fileSize || mReadPos < mMapStart)
             return 0;
-        }
+        readSize = MIN(len, fileSize - mReadPos);
+        memcpy(buf, mMapData.get() + (mReadPos - mMapStart), readSize);
+    }
+    else if (mBlockCount > 0 && len <= mBlockSize * mBlockCount / 2)
+    {
+        // copy block by block, larger reads would only evict what is cached
+        readSize = 0;
+        while (readSize < len && mReadPos + readSize < fileSize)
+        {
+            uint64_t          pos   = mReadPos + readSize;
+            const CacheBlock *block = getBlock(pos);
+            if (!block || pos - block->start >= block->size)
+                break;
 
-        readSize = MIN(len, mBufferContainSize - (mReadPos - mBufferStartOffset));
-        memcpy(buf, mReadBuffer.get() + (mReadPos - mBufferStartOffset), len);
+            uint64_t copySize = MIN(len - readSize, block->size - (pos - block->start));
+            memcpy((uint8_t *)buf + readSize, block->data.get() + (pos - block->start), copySize);
+            readSize += copySize;
+        }
     }
     else
     {
-        fseek64(mFileHandle, mReadPos, SEEK_SET);
-        readSize = fread(buf, 1, len, mFileHandle);
+        readSize = readSource(mReadPos, buf, len);
     }
 
     return readSize;
 }
 
+uint64_t BinaryFileReader::peekAt(uint64_t pos, void *buf, uint64_t len)
+{
+    if (pos >= fileSize)
+        return 0;
+    len = MIN(len, fileSize - pos);
+
+    if (mMapData)
+        return readAt(pos, buf, len);
+
+    uint64_t blockStart = pos - pos % mBlockSize;
+    for (auto &block : mBlocks)
+    {
+        if (block.start == blockStart && pos + len <= block.start + block.size)
+        {
+            mCacheHits++;
+            memcpy(buf, block.data.get() + (pos - blockStart), len);
+            return len;
+        }
+    }
+    return readSource(pos, buf, len);
+}
+
 string BinaryFileReader::readStr(uint64_t maxLen)
 {
     string resStr;
@@ -340,6 +891,24 @@ uint16_t BinaryFileReader::readU16(bool reverse)
     return res;
 }
 
+uint64_t BinaryFileReader::readU32Array(uint32_t *buf, uint64_t count)
+{
+    uint64_t rdSize = read(buf, count * 4);
+    if (rdSize < count * 4)
+        memset((uint8_t *)buf + rdSize, 0, count * 4 - rdSize);
+    swapBytes32(buf, count);
+    return rdSize / 4;
+}
+
+uint64_t BinaryFileReader::readU64Array(uint64_t *buf, uint64_t count)
+{
+    uint64_t rdSize = read(buf, count * 8);
+    if (rdSize < count * 8)
+        memset((uint8_t *)buf + rdSize, 0, count * 8 - rdSize);
+    swapBytes64(buf, count);
+    return rdSize / 8;
+}
+
 int16_t BinaryFileReader::readS16(bool reverse)
 {
     int16_t res = 0;
@@ -1,10 +1,18 @@
 #ifndef _MP4_PARSE_TOOLS_H_
 #define _MP4_PARSE_TOOLS_H_
 
+#include <atomic>
+#include <chrono>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <string>
+#include <vector>
 #include "Mp4Types.h"
 
+class Mp4ByteSource;
+
 #ifdef __linux
     #include <byteswap.h>
 #else
@@ -19,12 +27,23 @@
 
 #endif
 
-#define MP4_LOG(loglevel, fmt, ...)                                                                 \
-    do                                                                                              \
-    {                                                                                               \
-        char logBuffer[1024] = {0};                                                                 \
-        snprintf(logBuffer, sizeof(logBuffer), "[%s:%d]: " fmt, __func__, __LINE__, ##__VA_ARGS__); \
-        gLogCallback(loglevel, logBuffer);                                                          \
+// messages above MP4_LOG_COMPILE_LEVEL (0 error ... 3 debug) are compiled out,
+// the ones above the level set by setMp4ParseLogLevel are dropped before anything is formatted
+#ifndef MP4_LOG_COMPILE_LEVEL
+    #define MP4_LOG_COMPILE_LEVEL 3
+#endif
+#define MP4_LOG_ENABLED(loglevel) \
+    ((loglevel) <= MP4_LOG_COMPILE_LEVEL && (loglevel) <= gLogLevel.load(std::memory_order_relaxed))
+
+#define MP4_LOG(loglevel, fmt, ...)                                                                     \
+    do                                                                                                  \
+    {                                                                                                   \
+        if (MP4_LOG_ENABLED(loglevel))                                                                  \
+        {                                                                                               \
+            char logBuffer[1024];                                                                       \
+            snprintf(logBuffer, sizeof(logBuffer), "[%s:%d]: " fmt, __func__, __LINE__, ##__VA_ARGS__); \
+            gLogCallback(loglevel, logBuffer);                                                          \
+        }                                                                                               \
     } while (0)
 
 #define MP4_ERR(fmt, ...)                               \
@@ -57,7 +76,7 @@
         MP4_ERR(fmt, ##__VA_ARGS__);                                \
         char logBuffer[1024] = {0};                                 \
         snprintf(logBuffer, sizeof(logBuffer), fmt, ##__VA_ARGS__); \
-        mErrors.push(logBuffer);                                    \
+        pushError(logBuffer);                                       \
     } while (0)
 
 #define CHECK_RET(func)                               \
@@ -91,8 +110,35 @@ std::string data2hex(const BinaryData &data, int truncateLen = 16);
 std::string data2hex(const void *buffer, uint64_t bufferSize, int truncateLen = 16);
 
 extern std::function<void(MP4_LOG_LEVEL_E, const char *)> gLogCallback;
+extern std::atomic<int>                                   gLogLevel;
 std::string hexString(uint32_t val);
 
+// call task(0) ... task(taskCount - 1) on up to threadCount threads and wait for all of them;
+// threadCount 0 uses std::thread::hardware_concurrency
+void runTasks(uint32_t threadCount, size_t taskCount, const std::function<void(size_t)> &task);
+
+inline uint64_t steadyClockUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// adds the microseconds from construction to destruction to total
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(std::atomic<uint64_t> &total) : mTotal(total), mStart(steadyClockUs()) {}
+    ~ScopedTimer() { mTotal += steadyClockUs() - mStart; }
+
+private:
+    std::atomic<uint64_t> &mTotal;
+    uint64_t               mStart;
+};
+
+// byte swap count values in place, big endian from the file to host order;
+// uses AVX2/SSSE3 (picked at run time) on x86, NEON on ARM, plain bswap elsewhere
+void swapBytes32(uint32_t *data, uint64_t count);
+void swapBytes64(uint64_t *data, uint64_t count);
+
 struct BinaryFileReader
 {
 public:
@@ -102,9 +148,19 @@ public:
 
     ~BinaryFileReader() { close(); }
 
-    int  open(std::string &fn);
+    int  open(std::string &fn, MP4_READ_MODE_E mode = MP4_READ_MODE_STDIO);
+    // read data[0, size) as bytes [startPos, startPos + size) of a stream, data must stay valid until close()
+    int  openMemory(const uint8_t *data, uint64_t size, uint64_t startPos = 0);
+    // read through a user source, the read buffer works as for a file
+    int  open(std::shared_ptr<Mp4ByteSource> source);
     int  close();
-    bool isOpened() const { return mFileHandle != nullptr; }
+    bool isOpened() const { return mFileHandle != nullptr || mSource != nullptr; }
+
+    MP4_READ_MODE_E getReadMode() const { return mMapData ? MP4_READ_MODE_MMAP : MP4_READ_MODE_STDIO; }
+
+    // pointer to [pos, pos + len) inside the mapping, nullptr if not mapped or out of range;
+    // the mapping stays valid while the pointer is held, even after close() or a remap
+    std::shared_ptr<const uint8_t> getMappedData(uint64_t pos, uint64_t len) const;
 
     const std::string &getFileFullPath() const { return mFileFullPath; };
     const std::string &getFileName() const { return mFileName; }
@@ -113,13 +169,23 @@ public:
     uint64_t           getCursorPos() const { return mReadPos; };
     uint64_t           getFileSize() const { return fileSize; }
 
+    // re-read the size of a file that's still being written, the mapping is rebuilt in MP4_READ_MODE_MMAP;
+    // safe against readAt/getMappedData in other threads, they keep the old mapping until they're done with it;
+    // return 1 if the file grew, 0 if not, negative on failure
+    int updateFileSize();
+
     uint64_t read(void *buf, uint64_t len);
 
-    uint64_t readAt(uint64_t pos, void *buf,
-                    uint64_t len); // read len bytes from pos, then back to the readPos before
+    // positional read of len bytes from pos, the cursor and the read buffer are untouched,
+    // so it can be called from multiple threads at the same time
+    uint64_t readAt(uint64_t pos, void *buf, uint64_t len) const;
 
     uint64_t readStill(void *buf, uint64_t len); // read len bytes, but not changing readPos
 
+    // len bytes at pos without moving the cursor: from memory or a cached block holding them, otherwise one small
+    // read that doesn't load a block; for the headers of boxes whose body is jumped over
+    uint64_t peekAt(uint64_t pos, void *buf, uint64_t len);
+
     std::string readStr(uint64_t max_len);
 
     uint64_t readData(void *buf, uint16_t bufLen, uint16_t dataLen, bool reverse);
@@ -133,14 +199,38 @@ public:
     uint64_t readU64(bool reverse);
     int64_t  readS64(bool reverse);
 
+    // read count big endian values into buf in host order, values past the end of file are 0;
+    // return the number of values fully read
+    uint64_t readU32Array(uint32_t *buf, uint64_t count);
+    uint64_t readU64Array(uint64_t *buf, uint64_t count);
+
     uint64_t readUnsigned(uint16_t bytes, bool reverse);
     int64_t  readSigned(uint16_t bytes, bool reverse);
     uint64_t setCursor(uint64_t pos);
     uint64_t skip(uint64_t len);
 
+    // cursor reads not from memory go through blockCount blocks of blockSize bytes, the least recently used one is
+    // replaced on a miss; a miss right after the previous one reads ahead up to readaheadBlocks blocks at once.
+    // blockCount 0 reads straight from the file
+    void setCacheConfig(uint32_t blockSize, uint32_t blockCount, uint32_t readaheadBlocks);
+
+    // the read counters of Mp4ParseStats since the last close()
+    void getIoStats(Mp4ParseStats &stats) const;
+
 private:
-    uint64_t setFileCursor(uint64_t absolutePos);
-    int      checkBuffer(uint64_t readPos, uint64_t readSize);
+    struct CacheBlock
+    {
+        uint64_t                   start   = UINT64_MAX; // file offset, multiple of mBlockSize
+        uint64_t                   size    = 0;          // valid bytes, less than mBlockSize at end of file
+        uint64_t                   lastUse = 0;
+        std::unique_ptr<uint8_t[]> data;
+    };
+
+    uint64_t          setFileCursor(uint64_t absolutePos);
+    const CacheBlock *getBlock(uint64_t pos); // block containing pos, loaded on a miss
+    void              invalidateCache();
+    uint64_t          readSource(uint64_t pos, void *buf, uint64_t len); // from mSource or the file, no buffering
+    int               mapFile();
 
 private:
     std::string mFileFullPath;
@@ -159,13 +249,82 @@ private:
 
     FILE *mFileHandle = NULL;
 
+    std::shared_ptr<Mp4ByteSource> mSource;
+
     uint64_t fileSize = 0;
     uint64_t mReadPos = 0;
 
-    static const uint64_t      mBufferSize = 1024 * 1024;
-    std::unique_ptr<uint8_t[]> mReadBuffer;
-    uint64_t                   mBufferStartOffset = 0;
-    uint64_t                   mBufferContainSize = 0;
+    uint64_t                   mBlockSize    = 64 * 1024;
+    uint32_t                   mBlockCount   = 16;
+    uint32_t                   mMaxReadahead = 8;
+    std::vector<CacheBlock>    mBlocks;          // allocated on the first miss
+    std::unique_ptr<uint8_t[]> mReadaheadBuffer; // one read for all the blocks of a readahead
+    size_t                     mLastBlock     = 0; // index of the last hit, checked first
+    uint64_t                   mUseCounter    = 0;
+    uint64_t                   mNextMissStart = UINT64_MAX; // block after the last miss, a miss there is sequential
+    uint32_t                   mReadahead     = 1;          // blocks read on the next sequential miss
+
+    // the cursor ones are only touched by the thread owning the cursor, readAt runs on any thread
+    uint64_t                      mSourceReads = 0;
+    uint64_t                      mSourceBytes = 0;
+    uint64_t                      mSeeks       = 0;
+    uint64_t                      mCacheHits   = 0;
+    uint64_t                      mCacheMisses = 0;
+    mutable std::atomic<uint64_t> mPositionalReads{0};
+    mutable std::atomic<uint64_t> mPositionalBytes{0};
+
+    // whole file mapped read-only in MP4_READ_MODE_MMAP, unmapped when the last reference is released;
+    // or the caller's buffer of openMemory(), starting at mMapStart
+    std::shared_ptr<uint8_t>  mMapData;
+    uint64_t                  mMapStart = 0;
+    // updateFileSize() swaps mMapData and fileSize under it, readAt/getMappedData take a copy of both under it
+    mutable std::shared_mutex mMapMutex;
+};
+
+// bump allocator for objects living as long as a parse: memory is cut from large blocks and released all at once
+// when the arena goes, deallocation does nothing; not thread safe
+class MonotonicArena
+{
+public:
+    explicit MonotonicArena(size_t blockSize = 64 * 1024) : mBlockSize(blockSize) {}
+
+    void *allocate(size_t size, size_t align);
+
+private:
+    size_t                                  mBlockSize;
+    std::vector<std::unique_ptr<uint8_t[]>> mBlocks;
+    uint8_t                                *mCur  = nullptr;
+    size_t                                  mLeft = 0;
+};
+
+// for std::allocate_shared, every object keeps the arena alive through the allocator copy in its control block,
+// so a box held by the caller stays valid after the parser dropped the arena
+template <typename T>
+struct ArenaAllocator
+{
+    using value_type = T;
+
+    std::shared_ptr<MonotonicArena> arena;
+
+    explicit ArenaAllocator(std::shared_ptr<MonotonicArena> arenaPtr) : arena(std::move(arenaPtr)) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena)
+    {
+    }
+
+    T   *allocate(size_t n) { return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T *, size_t) {}
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U> &other) const
+    {
+        return arena == other.arena;
+    }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U> &other) const
+    {
+        return arena != other.arena;
+    }
 };
 
 struct BitsReader
@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <string.h>
+
+#include "Mp4Types.h"
+
+void Mp4SampleIndex::reserve(size_t count)
+{
+    mSampleOffset.reserve(count);
+    mSampleSize.reserve(count);
+    mDtsBaseMs.reserve((count + MP4_SAMPLE_INDEX_DTS_BLOCK - 1) / MP4_SAMPLE_INDEX_DTS_BLOCK);
+    mDtsOffsetMs.reserve(count);
+    mDtsDeltaMs.reserve(count);
+    mPtsOffsetMs.reserve(count);
+    mKeyFrame.reserve(count);
+    mSampleDescriptionIndex.reserve(count);
+}
+
+void Mp4SampleIndex::clear()
+{
+    mSampleOffset.clear();
+    mSampleSize.clear();
+    mDtsBaseMs.clear();
+    mDtsOffsetMs.clear();
+    mDtsDeltaMs.clear();
+    mPtsOffsetMs.clear();
+    mKeyFrame.clear();
+    mSampleDescriptionIndex.clear();
+    mFrameType.clear();
+    mNaluTypes.clear();
+}
+
+void Mp4SampleIndex::push_back(const Mp4SampleItem &item)
+{
+    mSampleOffset.push_back(item.sampleOffset);
+    mSampleSize.push_back(item.sampleSize);
+    if (mSampleOffset.size() % MP4_SAMPLE_INDEX_DTS_BLOCK == 1)
+        mDtsBaseMs.push_back(item.dtsMs);
+    mDtsOffsetMs.push_back(item.dtsMs - mDtsBaseMs.back());
+    mDtsDeltaMs.push_back(item.dtsDeltaMs);
+    mPtsOffsetMs.push_back((int64_t)(item.ptsMs - item.dtsMs));
+    mKeyFrame.push_back((int8_t)item.isKeyFrame);
+    mSampleDescriptionIndex.push_back(item.sampleDescriptionIndex);
+
+    if (!mFrameType.empty() || H26X_FRAME_Unknown != item.frameType)
+        setFrameType(size() - 1, item.frameType);
+    if (!mNaluTypes.empty() || !item.naluTypes.empty())
+        setNaluTypes(size() - 1, item.naluTypes);
+}
+
+int64_t Mp4SampleIndex::findByDts(uint64_t dtsMs) const
+{
+    // the block first, then the samples inside it
+    auto it = std::upper_bound(mDtsBaseMs.begin(), mDtsBaseMs.end(), dtsMs);
+    if (it == mDtsBaseMs.begin())
+        return -1;
+
+    size_t low  = (size_t)(it - mDtsBaseMs.begin() - 1) * MP4_SAMPLE_INDEX_DTS_BLOCK;
+    size_t high = std::min(low + MP4_SAMPLE_INDEX_DTS_BLOCK, size());
+    while (high - low > 1)
+    {
+        size_t mid = low + (high - low) / 2;
+        if (getDtsMs(mid) <= dtsMs)
+            low = mid;
+        else
+            high = mid;
+    }
+    return (int64_t)low;
+}
+
+const Mp4SampleItem Mp4SampleIndex::operator[](size_t idx) const
+{
+    Mp4SampleItem item;
+    getItem(idx, item);
+    return item;
+}
+
+void Mp4SampleIndex::getItem(size_t idx, Mp4SampleItem &item, bool withNaluInfo) const
+{
+    item.sampleIdx              = (int64_t)idx;
+    item.sampleOffset           = mSampleOffset[idx];
+    item.sampleSize             = mSampleSize[idx];
+    item.isKeyFrame             = mKeyFrame[idx];
+    item.sampleDescriptionIndex = mSampleDescriptionIndex[idx];
+    item.dtsMs                  = getDtsMs(idx);
+    item.dtsDeltaMs             = mDtsDeltaMs[idx];
+    item.ptsMs                  = getPtsMs(idx);
+
+    item.frameType = withNaluInfo ? getFrameType(idx) : H26X_FRAME_Unknown;
+    item.naluTypes.clear();
+    if (withNaluInfo && idx < mNaluTypes.size())
+        item.naluTypes = mNaluTypes[idx];
+}
+
+H26X_FRAME_TYPE_E Mp4SampleIndex::getFrameType(size_t idx) const
+{
+    if (idx >= mFrameType.size())
+        return H26X_FRAME_Unknown;
+    return (H26X_FRAME_TYPE_E)mFrameType[idx];
+}
+
+void Mp4SampleIndex::setFrameType(size_t idx, H26X_FRAME_TYPE_E frameType)
+{
+    if (mFrameType.size() < size())
+        mFrameType.resize(size(), (int8_t)H26X_FRAME_Unknown);
+    mFrameType[idx] = (int8_t)frameType;
+}
+
+void Mp4SampleIndex::setNaluTypes(size_t idx, const std::vector<int> &naluTypes)
+{
+    if (mNaluTypes.size() < size())
+        mNaluTypes.resize(size());
+    mNaluTypes[idx] = naluTypes;
+}
+
+static void appendBytes(std::vector<uint8_t> &out, const void *data, size_t len)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    out.insert(out.end(), bytes, bytes + len);
+}
+
+template <typename T>
+static void appendVector(std::vector<uint8_t> &out, const std::vector<T> &column)
+{
+    appendBytes(out, column.data(), column.size() * sizeof(T));
+}
+
+template <typename NarrowT, typename WideT>
+static void appendColumn(std::vector<uint8_t> &out, const Mp4PackedColumn<NarrowT, WideT> &column)
+{
+    uint8_t wide = column.isWide() ? 1 : 0;
+    appendBytes(out, &wide, 1);
+    appendBytes(out, column.rawData(), column.size() * (wide ? sizeof(WideT) : sizeof(NarrowT)));
+}
+
+template <typename T>
+static int readVector(const uint8_t *data, uint64_t size, uint64_t &pos, uint64_t count, std::vector<T> &column)
+{
+    if (pos > size || count > (size - pos) / sizeof(T))
+        return -1;
+    column.resize(count);
+    memcpy(column.data(), data + pos, count * sizeof(T));
+    pos += count * sizeof(T);
+    return 0;
+}
+
+template <typename NarrowT, typename WideT>
+static int readColumn(const uint8_t *data, uint64_t size, uint64_t &pos, uint64_t count, Mp4PackedColumn<NarrowT, WideT> &column)
+{
+    if (pos >= size)
+        return -1;
+    bool     wide     = data[pos++] != 0;
+    uint64_t itemSize = wide ? sizeof(WideT) : sizeof(NarrowT);
+    if (count > (size - pos) / itemSize)
+        return -1;
+    column.assignRaw(wide, data + pos, count);
+    pos += count * itemSize;
+    return 0;
+}
+
+void Mp4SampleIndex::appendTo(std::vector<uint8_t> &out) const
+{
+    uint64_t count = size();
+    appendBytes(out, &count, sizeof(count));
+    appendVector(out, mSampleOffset);
+    appendColumn(out, mSampleSize);
+    appendVector(out, mDtsBaseMs);
+    appendColumn(out, mDtsOffsetMs);
+    appendColumn(out, mDtsDeltaMs);
+    appendColumn(out, mPtsOffsetMs);
+    appendVector(out, mKeyFrame);
+    appendColumn(out, mSampleDescriptionIndex);
+}
+
+int Mp4SampleIndex::readFrom(const uint8_t *data, uint64_t size, uint64_t &pos)
+{
+    clear();
+
+    uint64_t count = 0;
+    if (pos > size || size - pos < sizeof(count))
+        return -1;
+    memcpy(&count, data + pos, sizeof(count));
+    pos += sizeof(count);
+
+    if (readVector(data, size, pos, count, mSampleOffset) < 0 || readColumn(data, size, pos, count, mSampleSize) < 0
+        || readVector(data, size, pos, (count + MP4_SAMPLE_INDEX_DTS_BLOCK - 1) / MP4_SAMPLE_INDEX_DTS_BLOCK, mDtsBaseMs) < 0
+        || readColumn(data, size, pos, count, mDtsOffsetMs) < 0 || readColumn(data, size, pos, count, mDtsDeltaMs) < 0
+        || readColumn(data, size, pos, count, mPtsOffsetMs) < 0 || readVector(data, size, pos, count, mKeyFrame) < 0
+        || readColumn(data, size, pos, count, mSampleDescriptionIndex) < 0)
+    {
+        clear();
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <filesystem>
+#include <type_traits>
+
+#include "Mp4ParseInternal.h"
+
+namespace fs = std::filesystem;
+
+// sidecar of Mp4ParseOptions::sampleIndexCacheDir, in host byte order:
+// SampleIndexCacheHeader, the file path, then per track SampleIndexCacheTrack, its chunksInfo, syncSampleTable and samplesInfo
+#define SAMPLE_INDEX_CACHE_MAGIC      "MP4SIDX"
+#define SAMPLE_INDEX_CACHE_VERSION    3
+#define SAMPLE_INDEX_CACHE_BYTE_ORDER 0x01020304
+#define SAMPLE_INDEX_CACHE_EXTENSION  ".mp4idx"
+
+struct SampleIndexCacheHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t byteOrder; // a cache written on a host of the other byte order is not used
+    uint64_t fileSize;
+    int64_t  modifyTime; // fs::last_write_time ticks
+    uint32_t pathLength;
+    uint32_t mp4Type;
+    uint32_t trackCount;
+    uint32_t reserved;
+};
+
+struct SampleIndexCacheTrack
+{
+    int32_t  trackId;
+    uint32_t trackType;
+    uint64_t nextFragmentDts; // mFragmentNextDts, refresh() goes on from it
+    uint64_t chunkCount;
+    uint64_t syncSampleCount;
+};
+
+static_assert(std::is_trivially_copyable<Mp4ChunkItem>::value, "chunksInfo is stored as it is in memory");
+
+// FNV-1a, names the sidecar of a path; the path itself is checked from the header
+static uint64_t hashPath(const std::string &path)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : path)
+    {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static std::string sampleIndexCachePath(const std::string &cacheDir, const std::string &filePath)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016" PRIx64 SAMPLE_INDEX_CACHE_EXTENSION, hashPath(filePath));
+    return (fs::path(cacheDir) / name).string();
+}
+
+static bool readCacheBytes(const uint8_t *data, uint64_t size, uint64_t &pos, void *dst, uint64_t len)
+{
+    if (pos > size || len > size - pos)
+        return false;
+    memcpy(dst, data + pos, len);
+    pos += len;
+    return true;
+}
+
+static void appendCacheBytes(std::vector<uint8_t> &out, const void *data, uint64_t len)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    out.insert(out.end(), bytes, bytes + len);
+}
+
+void MP4ParserImpl::setSampleIndexKey(const std::string &filePath)
+{
+    mSampleIndexKey = SampleIndexKey();
+    if (mOptions.sampleIndexCacheDir.empty() || mOptions.lazySampleTable)
+        return;
+
+    std::error_code errCode;
+    fs::path        path = fs::absolute(filePath, errCode);
+    if (errCode)
+        return;
+    auto modifyTime = fs::last_write_time(path, errCode);
+    if (errCode)
+        return;
+
+    mSampleIndexKey.path       = path.lexically_normal().string();
+    mSampleIndexKey.fileSize   = mFileReader.getFileSize();
+    mSampleIndexKey.modifyTime = (int64_t)modifyTime.time_since_epoch().count();
+}
+
+int MP4ParserImpl::loadSampleIndexCache()
+{
+    if (mSampleIndexKey.path.empty())
+        return -1;
+
+    ScopedTimer timer(mStats.sampleIndexCacheUs);
+
+    std::string     cachePath = sampleIndexCachePath(mOptions.sampleIndexCacheDir, mSampleIndexKey.path);
+    std::error_code errCode;
+    uint64_t        size = fs::file_size(cachePath, errCode);
+    if (errCode)
+        return -1;
+
+    // read whole, every column is copied into its own vector anyway
+    std::vector<uint8_t> content(size);
+    FILE                *fp = fopen(cachePath.c_str(), "rb");
+    if (nullptr == fp)
+        return -1;
+    bool read = fread(content.data(), 1, size, fp) == size;
+    fclose(fp);
+    if (!read)
+        return -1;
+    const uint8_t *data = content.data();
+    uint64_t       pos  = 0;
+
+    SampleIndexCacheHeader header;
+    if (!readCacheBytes(data, size, pos, &header, sizeof(header)) || memcmp(header.magic, SAMPLE_INDEX_CACHE_MAGIC, 8) != 0
+        || header.version != SAMPLE_INDEX_CACHE_VERSION || header.byteOrder != SAMPLE_INDEX_CACHE_BYTE_ORDER)
+    {
+        MP4_WARN("%s is not a sample index cache\n", cachePath.c_str());
+        return -1;
+    }
+
+    std::string path(header.pathLength, '\0');
+    if (!readCacheBytes(data, size, pos, &path[0], header.pathLength))
+        return -1;
+    if (path != mSampleIndexKey.path || header.fileSize != mSampleIndexKey.fileSize
+        || header.modifyTime != mSampleIndexKey.modifyTime)
+    {
+        MP4_DBG("sample index cache %s is stale\n", cachePath.c_str());
+        return -1;
+    }
+    if (header.mp4Type != (uint32_t)mMp4Type || header.trackCount != tracksInfo.size())
+    {
+        MP4_WARN("sample index cache %s doesn't match the tracks\n", cachePath.c_str());
+        return -1;
+    }
+
+    // read every track before touching tracksInfo, a broken cache leaves them as they were
+    std::vector<Mp4MediaInfo> loaded(tracksInfo.size());
+    std::vector<uint64_t>     nextDts(tracksInfo.size(), 0);
+    for (size_t trackIdx = 0; trackIdx < tracksInfo.size(); ++trackIdx)
+    {
+        SampleIndexCacheTrack track;
+        Mp4MediaInfo         &mediaInfo = loaded[trackIdx];
+        if (!readCacheBytes(data, size, pos, &track, sizeof(track)) || track.trackId != tracksInfo[trackIdx]->trackId
+            || track.trackType != (uint32_t)tracksInfo[trackIdx]->trackType
+            || track.chunkCount > (size - pos) / sizeof(Mp4ChunkItem))
+        {
+            MP4_WARN("sample index cache %s broken at track %zu\n", cachePath.c_str(), trackIdx);
+            return -1;
+        }
+
+        mediaInfo.chunksInfo.resize(track.chunkCount);
+        readCacheBytes(data, size, pos, mediaInfo.chunksInfo.data(), track.chunkCount * sizeof(Mp4ChunkItem));
+        if (track.syncSampleCount > (size - pos) / sizeof(uint64_t))
+        {
+            MP4_WARN("sample index cache %s broken at track %zu\n", cachePath.c_str(), trackIdx);
+            return -1;
+        }
+        mediaInfo.syncSampleTable.resize(track.syncSampleCount);
+        readCacheBytes(data, size, pos, mediaInfo.syncSampleTable.data(), track.syncSampleCount * sizeof(uint64_t));
+        if (mediaInfo.samplesInfo.readFrom(data, size, pos) < 0)
+        {
+            MP4_WARN("sample index cache %s broken at track %zu\n", cachePath.c_str(), trackIdx);
+            return -1;
+        }
+        nextDts[trackIdx] = track.nextFragmentDts;
+    }
+
+    for (size_t trackIdx = 0; trackIdx < tracksInfo.size(); ++trackIdx)
+    {
+        Mp4MediaInfo *mediaInfo    = tracksInfo[trackIdx]->mediaInfo.get();
+        mediaInfo->chunksInfo      = std::move(loaded[trackIdx].chunksInfo);
+        mediaInfo->syncSampleTable = std::move(loaded[trackIdx].syncSampleTable);
+        mediaInfo->samplesInfo     = std::move(loaded[trackIdx].samplesInfo);
+    }
+    if (MP4_TYPE_FRAGMENT == mMp4Type)
+        mFragmentNextDts = std::move(nextDts);
+
+    MP4_INFO("sample index of %s loaded from %s\n", mSampleIndexKey.path.c_str(), cachePath.c_str());
+    return 0;
+}
+
+void MP4ParserImpl::saveSampleIndexCache()
+{
+    if (mSampleIndexKey.path.empty())
+        return;
+
+    ScopedTimer timer(mStats.sampleIndexCacheUs);
+
+    SampleIndexCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SAMPLE_INDEX_CACHE_MAGIC, 8);
+    header.version    = SAMPLE_INDEX_CACHE_VERSION;
+    header.byteOrder  = SAMPLE_INDEX_CACHE_BYTE_ORDER;
+    header.fileSize   = mSampleIndexKey.fileSize;
+    header.modifyTime = mSampleIndexKey.modifyTime;
+    header.pathLength = (uint32_t)mSampleIndexKey.path.size();
+    header.mp4Type    = (uint32_t)mMp4Type;
+    header.trackCount = (uint32_t)tracksInfo.size();
+
+    std::vector<uint8_t> out;
+    appendCacheBytes(out, &header, sizeof(header));
+    appendCacheBytes(out, mSampleIndexKey.path.data(), mSampleIndexKey.path.size());
+    for (size_t trackIdx = 0; trackIdx < tracksInfo.size(); ++trackIdx)
+    {
+        const Mp4MediaInfo   *mediaInfo = tracksInfo[trackIdx]->mediaInfo.get();
+        SampleIndexCacheTrack track;
+        memset(&track, 0, sizeof(track));
+        track.trackId         = tracksInfo[trackIdx]->trackId;
+        track.trackType       = (uint32_t)tracksInfo[trackIdx]->trackType;
+        track.nextFragmentDts = trackIdx < mFragmentNextDts.size() ? mFragmentNextDts[trackIdx] : 0;
+        track.chunkCount      = mediaInfo->chunksInfo.size();
+        track.syncSampleCount = mediaInfo->syncSampleTable.size();
+        appendCacheBytes(out, &track, sizeof(track));
+        appendCacheBytes(out, mediaInfo->chunksInfo.data(), track.chunkCount * sizeof(Mp4ChunkItem));
+        appendCacheBytes(out, mediaInfo->syncSampleTable.data(), track.syncSampleCount * sizeof(uint64_t));
+        mediaInfo->samplesInfo.appendTo(out);
+    }
+
+    // written aside and renamed, a parse of the same file in another process never reads half a cache
+    std::error_code errCode;
+    fs::create_directories(mOptions.sampleIndexCacheDir, errCode);
+    std::string cachePath = sampleIndexCachePath(mOptions.sampleIndexCacheDir, mSampleIndexKey.path);
+    std::string tmpPath   = cachePath + "." + std::to_string(steadyClockUs()) + "." + std::to_string((uintptr_t)this) + ".tmp";
+
+    FILE *fp = fopen(tmpPath.c_str(), "wb");
+    if (nullptr == fp)
+    {
+        MP4_WARN("can't create sample index cache %s\n", tmpPath.c_str());
+        return;
+    }
+    bool written = fwrite(out.data(), 1, out.size(), fp) == out.size();
+    written      = (fclose(fp) == 0) && written;
+    if (written)
+        fs::rename(tmpPath, cachePath, errCode);
+    if (!written || errCode)
+    {
+        MP4_WARN("save sample index cache %s fail\n", cachePath.c_str());
+        fs::remove(tmpPath, errCode);
+        return;
+    }
+    MP4_DBG("sample index of %s saved to %s\n", mSampleIndexKey.path.c_str(), cachePath.c_str());
+}
@@ -0,0 +1,468 @@
+#include <algorithm>
+#include <inttypes.h>
+
+#include "Mp4SampleLocator.h"
+#include "Mp4ParseInternal.h"
+
+using std::vector;
+
+// index of the last run whose first sample is not after sampleIdx
+static uint64_t findRun(const vector<uint64_t> &firstSamples, uint64_t sampleIdx)
+{
+    auto it = std::upper_bound(firstSamples.begin(), firstSamples.end(), sampleIdx);
+    return (uint64_t)(it - firstSamples.begin()) - 1;
+}
+
+int IsoSampleLocator::build(CommonBoxPtr stbl, uint32_t timescale)
+{
+    mStts = stbl->getSubBox<TimeToSampleBox>("stts");
+    mCtts = stbl->getSubBox<CompositionOffsetBox>("ctts");
+    mStsc = stbl->getSubBox<SampleToChunkBox>("stsc");
+    mStco = stbl->getSubBox<ChunkOffsetBox>("stco");
+    mCo64 = stbl->getSubBox<ChunkLargeOffsetBox>("co64");
+    mStss = stbl->getSubBox<SyncSampleBox>("stss");
+    mStsz = stbl->getSubBox<SampleSizeBox>("stsz");
+    mStz2 = stbl->getSubBox<CompactSampleSizeBox>("stz2");
+
+    if ((mStsz == nullptr && mStz2 == nullptr) || (mStco == nullptr && mCo64 == nullptr) || mStts == nullptr
+        || mStsc == nullptr)
+    {
+        MP4_ERR("necessary box not parsed\n");
+        return -1;
+    }
+    if (0 == timescale)
+    {
+        MP4_ERR("timescale is 0\n");
+        return -1;
+    }
+    mTimescale  = timescale;
+    mChunkCount = mStco != nullptr ? mStco->entryCount : mCo64->entryCount;
+
+    if (0 == mChunkCount || 0 == mStts->entryCount || 0 == mStsc->entryCount)
+        return 0;
+
+    sampleCount = mStsz != nullptr ? mStsz->entryCount : mStz2->entryCount;
+
+    uint64_t firstSample = 0;
+    uint64_t firstDtsMs  = 0;
+    mSttsFirstSample.reserve(mStts->entryCount);
+    mSttsFirstDtsMs.reserve(mStts->entryCount);
+    for (uint32_t i = 0; i < mStts->entryCount; i++)
+    {
+        const sttsItem &entry = mStts->entries[i];
+        mSttsFirstSample.push_back(firstSample);
+        mSttsFirstDtsMs.push_back(firstDtsMs);
+        firstSample += entry.sampleCount;
+        firstDtsMs += entry.sampleCount * ((uint64_t)entry.delta * 1000 / mTimescale);
+    }
+
+    if (mCtts != nullptr)
+    {
+        firstSample = 0;
+        mCttsFirstSample.reserve(mCtts->entryCount);
+        for (uint32_t i = 0; i < mCtts->entryCount; i++)
+        {
+            mCttsFirstSample.push_back(firstSample);
+            firstSample += mCtts->entries[i].sampleCount;
+        }
+    }
+
+    firstSample = 0;
+    mStscFirstSample.reserve(mStsc->entryCount);
+    for (uint32_t i = 0; i < mStsc->entryCount; i++)
+    {
+        mStscFirstSample.push_back(firstSample);
+        if (i + 1 < mStsc->entryCount)
+        {
+            const stscItem &entry = mStsc->entries[i];
+            firstSample += (uint64_t)(mStsc->entries[i + 1].firstChunk - entry.firstChunk) * entry.sampleCount;
+        }
+    }
+
+    if (mStsz != nullptr && mStsz->defaultSampleSize != 0)
+    {
+        totalSize = sampleCount * mStsz->defaultSampleSize;
+    }
+    else
+    {
+        mSizeMarks.reserve(sampleCount / SAMPLE_LOCATOR_MARK_STEP + 1);
+        for (uint64_t i = 0; i < sampleCount; i++)
+        {
+            if (0 == i % SAMPLE_LOCATOR_MARK_STEP)
+                mSizeMarks.push_back(totalSize);
+            totalSize += getSampleSize(i);
+        }
+    }
+
+    Mp4SampleItem lastSample;
+    if (sampleCount > 0 && getSampleItem(sampleCount - 1, lastSample) == 0)
+        totalDurationMs = lastSample.dtsMs + lastSample.dtsDeltaMs;
+
+    return 0;
+}
+
+uint64_t IsoSampleLocator::getSampleSize(uint64_t sampleIdx) const
+{
+    if (mStsz != nullptr && mStsz->defaultSampleSize != 0)
+        return mStsz->defaultSampleSize;
+    else if (mStsz != nullptr)
+        return mStsz->entries[sampleIdx].sampleSize;
+    else
+        return mStz2->entries[sampleIdx].sampleSize;
+}
+
+uint64_t IsoSampleLocator::getSizeBefore(uint64_t sampleIdx) const
+{
+    if (mSizeMarks.empty())
+        return sampleIdx * getSampleSize(0);
+
+    uint64_t markIdx = sampleIdx / SAMPLE_LOCATOR_MARK_STEP;
+    uint64_t size    = mSizeMarks[markIdx];
+    for (uint64_t i = markIdx * SAMPLE_LOCATOR_MARK_STEP; i < sampleIdx; i++)
+        size += getSampleSize(i);
+    return size;
+}
+
+uint64_t IsoSampleLocator::getChunkOffset(uint64_t chunkIdx) const
+{
+    if (mStco != nullptr)
+        return mStco->entries[chunkIdx].chunkOffset;
+    else
+        return mCo64->entries[chunkIdx].chunkOffset;
+}
+
+int IsoSampleLocator::getSampleItem(uint64_t sampleIdx, Mp4SampleItem &item) const
+{
+    if (sampleIdx >= sampleCount)
+        return -1;
+
+    item           = Mp4SampleItem();
+    item.sampleIdx = sampleIdx;
+
+    uint64_t        stscIdx   = findRun(mStscFirstSample, sampleIdx);
+    const stscItem &stscEntry = mStsc->entries[stscIdx];
+    if (0 == stscEntry.sampleCount || 0 == stscEntry.firstChunk)
+    {
+        MP4_ERR("stsc entry %" PRIu64 " invalid\n", stscIdx);
+        return -1;
+    }
+    uint64_t chunkIdx = stscEntry.firstChunk - 1 + (sampleIdx - mStscFirstSample[stscIdx]) / stscEntry.sampleCount;
+    if (chunkIdx >= mChunkCount)
+    {
+        MP4_ERR("sample %" PRIu64 " out of chunk count %" PRIu64 "\n", sampleIdx, mChunkCount);
+        return -1;
+    }
+    uint64_t chunkFirstSample =
+        mStscFirstSample[stscIdx] + (chunkIdx - (stscEntry.firstChunk - 1)) * stscEntry.sampleCount;
+
+    item.sampleDescriptionIndex = stscEntry.sampleDescIdx;
+    item.sampleSize             = getSampleSize(sampleIdx);
+    item.sampleOffset           = getChunkOffset(chunkIdx) + getSizeBefore(sampleIdx) - getSizeBefore(chunkFirstSample);
+
+    if (mStss != nullptr)
+    {
+        uint32_t low = 0, high = mStss->entryCount;
+        while (low < high)
+        {
+            uint32_t mid = low + (high - low) / 2;
+            if (mStss->entries[mid].sampleNumber < sampleIdx + 1)
+                low = mid + 1;
+            else
+                high = mid;
+        }
+        item.isKeyFrame = (low < mStss->entryCount && mStss->entries[low].sampleNumber == sampleIdx + 1) ? 1 : 0;
+    }
+
+    uint64_t        sttsIdx   = findRun(mSttsFirstSample, sampleIdx);
+    const sttsItem &sttsEntry = mStts->entries[sttsIdx];
+    item.dtsDeltaMs           = (uint64_t)sttsEntry.delta * 1000 / mTimescale;
+    item.dtsMs                = mSttsFirstDtsMs[sttsIdx] + (sampleIdx - mSttsFirstSample[sttsIdx]) * item.dtsDeltaMs;
+
+    uint64_t deltaTs = 0;
+    if (!mCttsFirstSample.empty())
+    {
+        deltaTs = mCtts->entries[findRun(mCttsFirstSample, sampleIdx)].sampleOffset;
+        deltaTs = deltaTs * 1000 / mTimescale;
+    }
+    item.ptsMs = item.dtsMs + deltaTs;
+
+    return 0;
+}
+
+int64_t IsoSampleLocator::findSampleByDts(uint64_t dtsMs) const
+{
+    if (0 == sampleCount || mSttsFirstDtsMs.empty())
+        return -1;
+
+    auto it = std::upper_bound(mSttsFirstDtsMs.begin(), mSttsFirstDtsMs.end(), dtsMs);
+    if (it == mSttsFirstDtsMs.begin())
+        return -1;
+
+    // entries with no sample share the first dts of the next one, step back to one that has samples
+    uint64_t sttsIdx = (uint64_t)(it - mSttsFirstDtsMs.begin()) - 1;
+    while (sttsIdx > 0 && 0 == mStts->entries[sttsIdx].sampleCount)
+        sttsIdx--;
+
+    const sttsItem &sttsEntry = mStts->entries[sttsIdx];
+    if (0 == sttsEntry.sampleCount)
+        return -1;
+
+    uint64_t deltaMs = (uint64_t)sttsEntry.delta * 1000 / mTimescale;
+    uint64_t runIdx  = sttsEntry.sampleCount - 1;
+    if (deltaMs != 0)
+        runIdx = MIN(runIdx, (dtsMs - mSttsFirstDtsMs[sttsIdx]) / deltaMs);
+
+    return (int64_t)MIN(mSttsFirstSample[sttsIdx] + runIdx, sampleCount - 1);
+}
+
+int64_t IsoSampleLocator::findKeySample(uint64_t sampleIdx, bool forward) const
+{
+    if (sampleIdx >= sampleCount)
+        return -1;
+    // every sample is a sync sample without stss
+    if (nullptr == mStss)
+        return (int64_t)sampleIdx;
+
+    // stss numbers samples from 1
+    auto first = mStss->entries.begin();
+    auto last  = first + mStss->entryCount;
+    auto it    = std::lower_bound(first, last, sampleIdx + 1,
+                                  [](const stssItem &entry, uint64_t number) { return entry.sampleNumber < number; });
+    if (forward)
+        return (it == last || it->sampleNumber > sampleCount) ? -1 : (int64_t)it->sampleNumber - 1;
+    if (it != last && it->sampleNumber == sampleIdx + 1)
+        return (int64_t)sampleIdx;
+    return it == first ? -1 : (int64_t)(it - 1)->sampleNumber - 1;
+}
+
+int FragmentSampleLocator::build(const vector<CommonBoxPtr> &moofBoxes, TrackExtendsBoxPtr trex, uint32_t trackId,
+                                 uint32_t timescale)
+{
+    if (trex == nullptr || 0 == timescale)
+    {
+        MP4_ERR("trex missing or timescale is 0\n");
+        return -1;
+    }
+    mTrex      = trex;
+    mTrackId   = trackId;
+    mTimescale = timescale;
+
+    CHECK_RET(prepare(moofBoxes));
+    commit();
+    return 0;
+}
+
+int FragmentSampleLocator::prepare(const vector<CommonBoxPtr> &moofBoxes)
+{
+    // continues from the committed totals, the runs before stay as they are
+    PendingRuns pending;
+    pending.sampleCount     = sampleCount;
+    pending.totalSize       = totalSize;
+    pending.totalDurationMs = totalDurationMs;
+    pending.nextMediaDts    = mNextMediaDts;
+    mPending                = PendingRuns();
+
+    for (auto &pMoofBox : moofBoxes)
+    {
+        vector<CommonBoxPtr> pTrafBoxes = pMoofBox->getSubBoxes("traf");
+        if (pTrafBoxes.size() == 0)
+        {
+            MP4_ERR("Get traf fail\n");
+            return -1;
+        }
+
+        CommonBoxPtr              pTrafBox;
+        TrackFragmentHeaderBoxPtr pTfhdBox;
+        for (auto &traf : pTrafBoxes)
+        {
+            auto tfhdTry = traf->getSubBox<TrackFragmentHeaderBox>("tfhd");
+            if (tfhdTry != nullptr && tfhdTry->trackId == mTrackId)
+            {
+                pTrafBox = traf;
+                pTfhdBox = tfhdTry;
+                break;
+            }
+        }
+        if (pTrafBox == nullptr)
+            continue;
+
+        vector<TrackRunBoxPtr> pTrunBoxes = pTrafBox->getSubBoxes<TrackRunBox>("trun");
+        if (pTrunBoxes.empty())
+        {
+            MP4_ERR("Get trun fail (track id %u)\n", mTrackId);
+            return -1;
+        }
+
+        uint64_t fragBase;
+        if (pTfhdBox->mFullboxFlags & MP4_TFHD_FLAG_BASE_DATA_OFFSET_PRESENT)
+            fragBase = pTfhdBox->baseDataOffset;
+        else if (pTfhdBox->mFullboxFlags & MP4_TFHD_FLAG_DEFAULT_BASE_IS_MOOF)
+            fragBase = pMoofBox->mBoxOffset;
+        else
+            fragBase = pMoofBox->mBoxOffset + pMoofBox->mBoxSize;
+
+        auto     pTfdt       = pTrafBox->getSubBox<TrackFragmentBaseMediaDecodeTimeBox>("tfdt");
+        uint64_t curMediaDts = pTfdt != nullptr ? pTfdt->baseDecTime : pending.nextMediaDts;
+
+        uint64_t sampleDataCursor = fragBase;
+        bool     firstTrunInTraf  = true;
+
+        for (auto &pTrunBox : pTrunBoxes)
+        {
+            if (pTrunBox->mFullboxFlags & MP4_TRUN_FLAG_DATA_OFFSET_PRESENT)
+                sampleDataCursor = (uint64_t)((int64_t)fragBase + (int64_t)pTrunBox->dataOffset);
+            else if (firstTrunInTraf)
+                sampleDataCursor = fragBase;
+
+            firstTrunInTraf = false;
+
+            TrunRun run;
+            run.firstSample  = pending.sampleCount;
+            run.dataOffset   = sampleDataCursor;
+            run.baseMediaDts = curMediaDts;
+            run.firstDtsMs   = curMediaDts * 1000 / mTimescale;
+            run.tfhd         = pTfhdBox;
+            run.trun         = pTrunBox;
+            run.offsetMarks.reserve(pTrunBox->entryCount / SAMPLE_LOCATOR_MARK_STEP + 1);
+            run.dtsMarks.reserve(pTrunBox->entryCount / SAMPLE_LOCATOR_MARK_STEP + 1);
+
+            for (uint64_t i = 0; i < pTrunBox->entryCount; ++i)
+            {
+                if (0 == i % SAMPLE_LOCATOR_MARK_STEP)
+                {
+                    run.offsetMarks.push_back(sampleDataCursor);
+                    run.dtsMarks.push_back(curMediaDts);
+                }
+                if (FRAG_IS_IFRAME(MP4ParserImpl::fragmentGetSampleFlags(mTrex, pTfhdBox, pTrunBox, i)))
+                {
+                    uint64_t keySample = pending.sampleCount + i;
+                    if (!pending.keyRanges.empty() && pending.keyRanges.back().second == keySample)
+                        pending.keyRanges.back().second++;
+                    else
+                        pending.keyRanges.emplace_back(keySample, keySample + 1);
+                }
+
+                uint32_t durTs = MP4ParserImpl::fragmentGetSampleDuration(mTrex, pTfhdBox, pTrunBox, i);
+                sampleDataCursor += MP4ParserImpl::fragmentGetSampleSize(mTrex, pTfhdBox, pTrunBox, i);
+                pending.totalDurationMs += durTs * 1000 / mTimescale;
+                curMediaDts += durTs;
+            }
+
+            pending.totalSize += sampleDataCursor - run.dataOffset;
+            pending.sampleCount += pTrunBox->entryCount;
+            if (pTrunBox->entryCount > 0)
+                pending.runs.push_back(std::move(run));
+        }
+
+        pending.nextMediaDts = curMediaDts;
+    }
+
+    pending.ready = true;
+    mPending      = std::move(pending);
+    return 0;
+}
+
+void FragmentSampleLocator::commit()
+{
+    if (!mPending.ready)
+        return;
+
+    // a key range may go on from the last committed one
+    for (auto &range : mPending.keyRanges)
+    {
+        if (!mKeyRanges.empty() && mKeyRanges.back().second == range.first)
+            mKeyRanges.back().second = range.second;
+        else
+            mKeyRanges.push_back(range);
+    }
+    mRuns.insert(mRuns.end(), std::make_move_iterator(mPending.runs.begin()), std::make_move_iterator(mPending.runs.end()));
+
+    sampleCount     = mPending.sampleCount;
+    totalSize       = mPending.totalSize;
+    totalDurationMs = mPending.totalDurationMs;
+    mNextMediaDts   = mPending.nextMediaDts;
+    mPending        = PendingRuns();
+}
+
+int FragmentSampleLocator::getSampleItem(uint64_t sampleIdx, Mp4SampleItem &item) const
+{
+    if (sampleIdx >= sampleCount)
+        return -1;
+
+    auto it = std::upper_bound(mRuns.begin(), mRuns.end(), sampleIdx,
+                               [](uint64_t idx, const TrunRun &run) { return idx < run.firstSample; });
+    if (it == mRuns.begin())
+        return -1;
+    const TrunRun &run = *(it - 1);
+
+    uint64_t runSampleIdx = sampleIdx - run.firstSample;
+    uint64_t offset, mediaDts;
+    getRunSample(run, runSampleIdx, offset, mediaDts);
+
+    uint32_t flags = MP4ParserImpl::fragmentGetSampleFlags(mTrex, run.tfhd, run.trun, runSampleIdx);
+    uint32_t durTs = MP4ParserImpl::fragmentGetSampleDuration(mTrex, run.tfhd, run.trun, runSampleIdx);
+    uint32_t ctsTs = MP4ParserImpl::fragmentGetSampleCompositionOffset(run.trun, runSampleIdx);
+
+    item              = Mp4SampleItem();
+    item.sampleIdx    = sampleIdx;
+    item.sampleOffset = offset;
+    item.sampleSize   = MP4ParserImpl::fragmentGetSampleSize(mTrex, run.tfhd, run.trun, runSampleIdx);
+    item.isKeyFrame   = FRAG_IS_IFRAME(flags);
+    item.dtsMs        = mediaDts * 1000 / mTimescale;
+    item.dtsDeltaMs   = durTs * 1000 / mTimescale;
+    item.ptsMs        = item.dtsMs + ctsTs * 1000 / mTimescale;
+
+    return 0;
+}
+
+int64_t FragmentSampleLocator::findSampleByDts(uint64_t dtsMs) const
+{
+    auto it = std::upper_bound(mRuns.begin(), mRuns.end(), dtsMs,
+                               [](uint64_t ms, const TrunRun &run) { return ms < run.firstDtsMs; });
+    if (it == mRuns.begin())
+        return -1;
+    const TrunRun &run = *(it - 1);
+
+    // the first mark is the run's own first dts, not after dtsMs
+    auto markIt = std::upper_bound(run.dtsMarks.begin(), run.dtsMarks.end(), dtsMs,
+                                   [this](uint64_t ms, uint64_t mediaDts) { return ms < mediaDts * 1000 / mTimescale; });
+    uint64_t markIdx  = (uint64_t)(markIt - run.dtsMarks.begin()) - 1;
+    uint64_t runIdx   = markIdx * SAMPLE_LOCATOR_MARK_STEP;
+    uint64_t mediaDts = run.dtsMarks[markIdx];
+    uint64_t markEnd  = MIN(runIdx + SAMPLE_LOCATOR_MARK_STEP, (uint64_t)run.trun->entryCount);
+    for (uint64_t i = runIdx + 1; i < markEnd; i++)
+    {
+        mediaDts += MP4ParserImpl::fragmentGetSampleDuration(mTrex, run.tfhd, run.trun, i - 1);
+        if (mediaDts * 1000 / mTimescale > dtsMs)
+            break;
+        runIdx = i;
+    }
+
+    return (int64_t)(run.firstSample + runIdx);
+}
+
+int64_t FragmentSampleLocator::findKeySample(uint64_t sampleIdx, bool forward) const
+{
+    if (sampleIdx >= sampleCount)
+        return -1;
+
+    auto it = std::upper_bound(mKeyRanges.begin(), mKeyRanges.end(), sampleIdx,
+                               [](uint64_t idx, const std::pair<uint64_t, uint64_t> &range) { return idx < range.first; });
+    if (it != mKeyRanges.begin() && sampleIdx < (it - 1)->second)
+        return (int64_t)sampleIdx;
+    if (forward)
+        return it == mKeyRanges.end() ? -1 : (int64_t)it->first;
+    return it == mKeyRanges.begin() ? -1 : (int64_t)(it - 1)->second - 1;
+}
+
+void FragmentSampleLocator::getRunSample(const TrunRun &run, uint64_t runSampleIdx, uint64_t &offset, uint64_t &mediaDts) const
+{
+    uint64_t markIdx = runSampleIdx / SAMPLE_LOCATOR_MARK_STEP;
+    offset           = run.offsetMarks[markIdx];
+    mediaDts         = run.dtsMarks[markIdx];
+    for (uint64_t i = markIdx * SAMPLE_LOCATOR_MARK_STEP; i < runSampleIdx; i++)
+    {
+        offset += MP4ParserImpl::fragmentGetSampleSize(mTrex, run.tfhd, run.trun, i);
+        mediaDts += MP4ParserImpl::fragmentGetSampleDuration(mTrex, run.tfhd, run.trun, i);
+    }
+}
@@ -0,0 +1,117 @@
+#ifndef MP4_SAMPLE_LOCATOR_H
+#define MP4_SAMPLE_LOCATOR_H
+
+#include <vector>
+#include "Mp4Types.h"
+#include "Mp4BoxTypes.h"
+#include "Mp4SampleTableTypes.h"
+
+#define SAMPLE_LOCATOR_MARK_STEP 16 // samples between two prefix sums kept by a locator
+
+// per-track sample lookup for Mp4ParseOptions::lazySampleTable;
+// only keeps prefix values per run-length entry and every SAMPLE_LOCATOR_MARK_STEP samples,
+// each sample is computed from the boxes when asked
+struct SampleLocator
+{
+    virtual ~SampleLocator() {}
+
+    uint64_t sampleCount     = 0;
+    uint64_t totalSize       = 0;
+    uint64_t totalDurationMs = 0; // sum of all dtsDeltaMs
+
+    virtual int getSampleItem(uint64_t sampleIdx, Mp4SampleItem &item) const = 0;
+
+    // last sample whose dtsMs is not after dtsMs, -1 if there's none
+    virtual int64_t findSampleByDts(uint64_t dtsMs) const                 = 0;
+    // nearest key sample not after sampleIdx (not before it if forward), -1 if there's none
+    virtual int64_t findKeySample(uint64_t sampleIdx, bool forward) const = 0;
+};
+using SampleLocatorPtr = std::shared_ptr<SampleLocator>;
+
+// stts/ctts/stsc/stss are located by binary search over their entries,
+// the offset inside a chunk comes from the stsz sums kept every SAMPLE_LOCATOR_MARK_STEP samples
+struct IsoSampleLocator : public SampleLocator
+{
+    int build(CommonBoxPtr stbl, uint32_t timescale);
+
+    int     getSampleItem(uint64_t sampleIdx, Mp4SampleItem &item) const override;
+    int64_t findSampleByDts(uint64_t dtsMs) const override;
+    int64_t findKeySample(uint64_t sampleIdx, bool forward) const override;
+
+private:
+    uint64_t getSampleSize(uint64_t sampleIdx) const;
+    uint64_t getSizeBefore(uint64_t sampleIdx) const; // sum of the sizes of the samples before sampleIdx
+    uint64_t getChunkOffset(uint64_t chunkIdx) const;
+
+    TimeToSampleBoxPtr      mStts;
+    CompositionOffsetBoxPtr mCtts;
+    SampleToChunkBoxPtr     mStsc;
+    ChunkOffsetBoxPtr       mStco;
+    ChunkLargeOffsetBoxPtr  mCo64;
+    SyncSampleBoxPtr        mStss;
+    SampleSizeBoxPtr        mStsz;
+    CompactSampleSizeBoxPtr mStz2;
+
+    uint32_t mTimescale  = 1;
+    uint64_t mChunkCount = 0;
+
+    std::vector<uint64_t> mSttsFirstSample;
+    std::vector<uint64_t> mSttsFirstDtsMs;
+    std::vector<uint64_t> mCttsFirstSample;
+    std::vector<uint64_t> mStscFirstSample;
+    std::vector<uint64_t> mSizeMarks; // getSizeBefore() of every SAMPLE_LOCATOR_MARK_STEP sample, empty with a default size
+};
+
+// one run per trun of the track, the sample is located by binary search over the runs, then over the offset/dts
+// sums the run keeps every SAMPLE_LOCATOR_MARK_STEP samples; key samples are kept as ranges of consecutive ones
+struct FragmentSampleLocator : public SampleLocator
+{
+    int  build(const std::vector<CommonBoxPtr> &moofBoxes, TrackExtendsBoxPtr trex, uint32_t trackId, uint32_t timescale);
+    // walk moof boxes that follow the ones already built aside, nothing the getters read changes;
+    // commit() then adds them, so a refresh only needs the tables exclusive for that
+    int  prepare(const std::vector<CommonBoxPtr> &moofBoxes);
+    void commit();
+
+    int     getSampleItem(uint64_t sampleIdx, Mp4SampleItem &item) const override;
+    int64_t findSampleByDts(uint64_t dtsMs) const override;
+    int64_t findKeySample(uint64_t sampleIdx, bool forward) const override;
+
+private:
+    struct TrunRun
+    {
+        uint64_t                  firstSample  = 0;
+        uint64_t                  dataOffset   = 0;
+        uint64_t                  baseMediaDts = 0; // media timescale
+        uint64_t                  firstDtsMs   = 0;
+        TrackFragmentHeaderBoxPtr tfhd;
+        TrackRunBoxPtr            trun;
+        std::vector<uint64_t>     offsetMarks; // offset of every SAMPLE_LOCATOR_MARK_STEP sample of the run
+        std::vector<uint64_t>     dtsMarks;    // its dts, media timescale
+    };
+    // offset and dts (media timescale) of a sample of the run, from the mark before it
+    void getRunSample(const TrunRun &run, uint64_t runSampleIdx, uint64_t &offset, uint64_t &mediaDts) const;
+
+    // runs walked by prepare() and the totals after them, not committed yet
+    struct PendingRuns
+    {
+        bool                                       ready = false;
+        std::vector<TrunRun>                       runs;
+        std::vector<std::pair<uint64_t, uint64_t>> keyRanges;
+        uint64_t                                   sampleCount     = 0;
+        uint64_t                                   totalSize       = 0;
+        uint64_t                                   totalDurationMs = 0;
+        uint64_t                                   nextMediaDts    = 0;
+    };
+
+    TrackExtendsBoxPtr   mTrex;
+    uint32_t             mTrackId      = 0;
+    uint32_t             mTimescale    = 1;
+    uint64_t             mNextMediaDts = 0; // media timescale; used if a fragment has no tfdt
+    std::vector<TrunRun> mRuns;
+    PendingRuns          mPending;
+
+    // first and end sample of each range of consecutive key samples
+    std::vector<std::pair<uint64_t, uint64_t>> mKeyRanges;
+};
+
+#endif
@@ -5,41 +5,61 @@
 #include "Mp4ParseTools.h"
 #include "Mp4BoxTypes.h"
 
-struct BasicSampleItem
+// boxes made of an entry count and a table of entries
+struct SampleTableBox : public FullBox
 {
-    virtual std::shared_ptr<const Mp4BoxData> getData()                  = 0;
-    virtual std::shared_ptr<const Mp4BoxData> getData(uint64_t data_idx) = 0;
+    uint32_t entryCount = 0; // u32
+
+    explicit SampleTableBox(const char *boxTypeStr) : FullBox(boxTypeStr), entryCount(0) {}
 
-    virtual void setColumnsName(std::shared_ptr<Mp4BoxData> src) = 0;
+    std::shared_ptr<Mp4BoxData> getData(std::shared_ptr<Mp4BoxData> src = nullptr) const override;
+    virtual uint64_t            getDecodedEntryCount() const { return 0; } // entries actually read, for the stats
 };
+using SampleTableBoxPtr = std::shared_ptr<SampleTableBox>;
 
-struct SampleTableBox : public FullBox
+// entries stored by value in one array; the rows of the "Entrys" table in getData() are made when they are shown,
+// from the getData()/getData(idx)/setColumnsName() of the entry type
+template <typename T>
+struct EntryTableBox : public SampleTableBox
 {
-    uint32_t                                      entryCount = 0; // u32
-    std::vector<std::shared_ptr<BasicSampleItem>> entries;
+    std::vector<T> entries;
 
-    explicit SampleTableBox(const char *boxTypeStr) : FullBox(boxTypeStr), entryCount(0) {}
-    template <typename _T>
-    _T *getEntry(uint64_t idx)
+    explicit EntryTableBox(const char *boxTypeStr) : SampleTableBox(boxTypeStr) {}
+
+    uint64_t getDecodedEntryCount() const override { return entries.size(); }
+
+    std::shared_ptr<Mp4BoxData> getData(std::shared_ptr<Mp4BoxData> src = nullptr) const override
     {
-        return (_T*)(entries[idx].get());
-    }
+        std::shared_ptr<Mp4BoxData> item = SampleTableBox::getData(src);
 
-    std::shared_ptr<Mp4BoxData> getData(std::shared_ptr<Mp4BoxData> src = nullptr) const override;
+        // check if there's no entry table, for example, stsz could only use default size but no entry
+        if (entries.empty())
+            return item;
+
+        std::shared_ptr<Mp4BoxData> entryTable = item->kvAddKey("Entrys", MP4_BOX_DATA_TYPE_TABLE);
+
+        entries[0].setColumnsName(entryTable);
+        entryTable->tableSetCallbacks([](const void *userData) { return (uint64_t)((const std::vector<T> *)userData)->size(); },
+                                      [](const void *userData, uint64_t rowIdx)
+                                      { return (*(const std::vector<T> *)userData)[rowIdx].getData(); },
+                                      [](const void *userData, uint64_t rowIdx, uint64_t colIdx)
+                                      { return (*(const std::vector<T> *)userData)[rowIdx].getData(colIdx); },
+                                      &entries);
+        return item;
+    }
 };
-using SampleTableBoxPtr = std::shared_ptr<SampleTableBox>;
 
-struct sttsItem : public BasicSampleItem
+struct sttsItem
 {
     uint32_t                          sampleCount = 0; // u32
     uint32_t                          delta       = 0; // u32
-    std::shared_ptr<const Mp4BoxData> getData() override
+    std::shared_ptr<const Mp4BoxData> getData() const
     {
         auto res = Mp4BoxData::createArrayData();
         res->arrayAddItem(sampleCount)->arrayAddItem(delta);
         return res;
     }
-    std::shared_ptr<const Mp4BoxData> getData(uint64_t dataIdx) override
+    std::shared_ptr<const Mp4BoxData> getData(uint64_t dataIdx) const
     {
         switch (dataIdx)
         {
@@ -52,29 +72,29 @@ struct sttsItem : public BasicSampleItem
         }
     }
 
-    void setColumnsName(std::shared_ptr<Mp4BoxData> src) override { src->setColumnsName("Sample Count", "Delta"); }
+    void setColumnsName(std::shared_ptr<Mp4BoxData> src) const { src->setColumnsName("Sample Count", "Delta"); }
 };
-struct TimeToSampleBox : public SampleTableBox
+struct TimeToSampleBox : public EntryTableBox<sttsItem>
 {
-    TimeToSampleBox() : SampleTableBox("stts") {}
+    TimeToSampleBox() : EntryTableBox("stts") {}
     int parse(BinaryFileReader &reader, uint64_t boxPosition, uint64_t boxSize, uint64_t boxBodySize) override;
 
     // SampleTableBox::getData()
 };
 using TimeToSampleBoxPtr = std::shared_ptr<TimeToSampleBox>;
 
-struct cttsItem : public BasicSampleItem
+struct cttsItem
 {
     uint32_t sampleCount  = 0; // u32
     uint64_t sampleOffset = 0; // u32/s32
 
-    std::shared_ptr<const Mp4BoxData> getData() override
+    std::shared_ptr<const Mp4BoxData> getData() const
     {
         auto res = Mp4BoxData::createArrayData();
         res->arrayAddItem(sampleCount)->arrayAddItem(sampleOffset);
         return res;
     }
-    std::shared_ptr<const Mp4BoxData> getData(uint64_t dataIdx) override
+    std::shared_ptr<const Mp4BoxData> getData(uint64_t dataIdx) const
     {
         switch (dataIdx)
         {
@@ -86,14 +106,14 @@ struct cttsItem : public BasicSampleItem
                 return nullptr;
         }
     }
-    void setColumnsName(std::shared_ptr<Mp4BoxData> src) override
+    void setColumnsName(std::shared_ptr<Mp4BoxData> src) const
     {
         src->setColumnsName("Sample Count", "Sample Offset");
     }
 };
-struct CompositionOffsetBox : public SampleTableBox
+struct CompositionOffsetBox : public EntryTableBox<cttsItem>
 {
-    CompositionOffsetBox() : SampleTableBox("ctts") {}
+    CompositionOffsetBox() : EntryTableBox("ctts") {}
 
     int parse(BinaryFileReader &reader, uint64_t boxPosition, uint64_t boxSize, uint64_t boxBodySize) override;
 
@@ -101,19 +121,19 @@ struct CompositionOffsetBox : public SampleTableBox
 };
 using CompositionOffsetBoxPtr = std::shared_ptr<CompositionOffsetBox>;
 
-struct stscItem : public BasicSampleItem
+struct stscItem
 {
     uint32_t firstChunk    = 0; // u32
     uint32_t sampleCount   = 0; // u32
     uint32_t sampleDescIdx = 0; // u32
 
-    std::shared_ptr<const Mp4BoxData> getData() override
+    std::shared_ptr<const Mp4BoxData> getData() const
     {
         auto res = Mp4BoxData::createArrayData();
         res->arrayAddItem(firstChunk)->arrayAddItem(sampleCount)->arrayAddItem(sampleDescIdx);
         return res;
     }
-    std::shared_ptr<const Mp4BoxData> getData(uint64_t dataIdx) override
+    std::shared_ptr<const Mp4BoxData> getData(uint64_t dataIdx) const
     {
         switch (dataIdx)
         {
@@ -128,14 +148,14 @@ struct stscItem : public BasicSampleItem
         }
     }
 
-    void setColumnsName(std::shared_ptr<Mp4BoxData> src) override
+    void setColumnsName(std::shared_ptr<Mp4BoxData> src) const
     {
         src->setColumnsName("First Chunk", "Sample Count", "Sample Description index");
     }
 };
-struct SampleToChunkBox : public SampleTableBox
+struct SampleToChunkBox : public EntryTableBox<stscItem>
 {
-    SampleToChunkBox() : SampleTableBox("stsc") {}
+    SampleToChunkBox() : EntryTableBox("stsc") {}
 
     int parse(BinaryFileReader &reader, uint64_t boxPosition, uint64_t boxSize, uint64_t boxBodySize) override;
 
@@ -143,15 +163,15 @@ struct SampleToChunkBox : public SampleTableBox
 };
 using SampleToChunkBoxPtr = std::shared_ptr<SampleToChunkBox>;
 
-struct stszItem : public BasicSampleItem
+struct stszItem
 {
     uint32_t sampleSize = 0; // u32
 
-    std::shared_ptr<const Mp4BoxData> getData() override
+    std::shared_ptr<const Mp4BoxData> getData() const
     {
         return Mp4BoxData::createArrayData()->arrayAddItem(sampleSize);
     }
-    std::shared_ptr<const Mp4BoxData> getData(uint64_t dataIdx) override
+    std::shared_ptr<const Mp4BoxData> getData(uint64_t dataIdx) const
     {
         switch (dataIdx)
         {
@@ -162,28 +182,28 @@ struct stszItem : public BasicSampleItem
         }
     }
 
-    void setColumnsName(std::shared_ptr<Mp4BoxData> src) override { src->setColumnsName("Sample Size"); }
+    void setColumnsName(std::shared_ptr<Mp4BoxData> src) const { src->setColumnsName("Sample Size"); }
 };
-struct SampleSizeBox : public SampleTableBox
+struct SampleSizeBox : public EntryTableBox<stszItem>
 {
     uint32_t defaultSampleSize = 0; // u32
 
-    SampleSizeBox() : SampleTableBox("stsz") {}
+    SampleSizeBox() : EntryTableBox("stsz") {}
     int parse(BinaryFileReader &reader, uint64_t boxPosition, uint64_t boxSize, uint64_t boxBodySize) override;
 
     std::shared_ptr<Mp4BoxData> getData(std::shared_ptr<Mp4BoxData> src = nullptr) const override;
 };
 using SampleSizeBoxPtr = std::shared_ptr<SampleSizeBox>;
 
-struct stz2Item : public BasicSampleItem
+struct stz2Item
 {
     uint16_t sampleSize = 0; // field_size bits
 
-    std::shared_ptr<const Mp4BoxData> getData() override
+    std::shared_ptr<const Mp4BoxData> getData() const
     {
         return Mp4BoxData::createArrayData()->arrayAddItem(sampleSize);
     }
-    std::shared_ptr<const Mp4BoxData> getData(uint64_t dataIdx) override
+    std::shared_ptr<const Mp4BoxData> getData(uint64_t dataIdx) const
     {
         switch (dataIdx)
         {
@@ -194,13 +214,13 @@ struct stz2Item : public BasicSampleItem
         }
     }
 
-    void setColumnsName(std::shared_ptr<Mp4BoxData> src) override { src->setColumnsName("Sample Size"); }
+    void setColumnsName(std::shared_ptr<Mp4BoxData> src) const { src->setColumnsName("Sample Size"); }
 };
-struct CompactSampleSizeBox : public SampleTableBox
+struct CompactSampleSizeBox : public EntryTableBox<stz2Item>
 {
     uint8_t fieldSize = 0; // u8
 
-    CompactSampleSizeBox() : SampleTableBox("stz2") {}
+    CompactSampleSizeBox() : EntryTableBox("stz2") {}
 
     int parse(BinaryFileReader &reader, uint64_t boxPosition, uint64_t boxSize, uint64_t boxBodySize) override;
 
@@ -208,15 +228,15 @@ struct CompactSampleSizeBox : public SampleTableBox
 };
 using CompactSampleSizeBoxPtr = std::shared_ptr<CompactSampleSizeBox>;
 
-struct stcoItem : public BasicSampleItem
+struct stcoItem
 {
     uint32_t chunkOffset = 0; // u32
 
-    std::shared_ptr<const Mp4BoxData> getData() override
+    std::shared_ptr<const Mp4BoxData> getData() const
     {
         return Mp4BoxData::createArrayData()->arrayAddItem(chunkOffset);
     }
-    std::shared_ptr<const Mp4BoxData> getData(uint64_t dataIdx) override
+    std::shared_ptr<const Mp4BoxData> getData(uint64_t dataIdx) const
     {
         switch (dataIdx)
         {
@@ -227,11 +247,11 @@ struct stcoItem : public BasicSampleItem
         }
     }
 
-    void setColumnsName(std::shared_ptr<Mp4BoxData> src) override { src->setColumnsName("Chunk Offset"); }
+    void setColumnsName(std::shared_ptr<Mp4BoxData> src) const { src->setColumnsName("Chunk Offset"); }
 };
-struct ChunkOffsetBox : public SampleTableBox
+struct ChunkOffsetBox : public EntryTableBox<stcoItem>
 {
-    explicit ChunkOffsetBox() : SampleTableBox("stco") {}
+    explicit ChunkOffsetBox() : EntryTableBox("stco") {}
 
     int parse(BinaryFileReader &reader, uint64_t boxPosition, uint64_t boxSize, uint64_t boxBodySize) override;
 
@@ -239,15 +259,15 @@ struct ChunkOffsetBox : public SampleTableBox
 };
 using ChunkOffsetBoxPtr = std::shared_ptr<ChunkOffsetBox>;
 
-struct co64Item : public BasicSampleItem
+struct co64Item
 {
     uint64_t chunkOffset = 0; // u64
 
-    std::shared_ptr<const Mp4BoxData> getData() override
+    std::shared_ptr<const Mp4BoxData> getData() const
     {
         return Mp4BoxData::createArrayData()->arrayAddItem(chunkOffset);
     }
-    std::shared_ptr<const Mp4BoxData> getData(uint64_t dataIdx) override
+    std::shared_ptr<const Mp4BoxData> getData(uint64_t dataIdx) const
     {
         switch (dataIdx)
         {
@@ -258,11 +278,11 @@ struct co64Item : public BasicSampleItem
         }
     }
 
-    void setColumnsName(std::shared_ptr<Mp4BoxData> src) override { src->setColumnsName("Chunk Offset"); }
+    void setColumnsName(std::shared_ptr<Mp4BoxData> src) const { src->setColumnsName("Chunk Offset"); }
 };
-struct ChunkLargeOffsetBox : public SampleTableBox
+struct ChunkLargeOffsetBox : public EntryTableBox<co64Item>
 {
-    explicit ChunkLargeOffsetBox() : SampleTableBox("co64") {}
+    explicit ChunkLargeOffsetBox() : EntryTableBox("co64") {}
 
     int parse(BinaryFileReader &reader, uint64_t boxPosition, uint64_t boxSize, uint64_t boxBodySize) override;
 
@@ -270,16 +290,16 @@ struct ChunkLargeOffsetBox : public SampleTableBox
 };
 using ChunkLargeOffsetBoxPtr = std::shared_ptr<ChunkLargeOffsetBox>;
 
-struct stssItem : public BasicSampleItem
+struct stssItem
 {
-    uint64_t sampleNumber = 0; // u32, start from 1
+    uint32_t sampleNumber = 0; // u32, start from 1
 
-    std::shared_ptr<const Mp4BoxData> getData() override
+    std::shared_ptr<const Mp4BoxData> getData() const
     {
         return Mp4BoxData::createArrayData()->arrayAddItem(sampleNumber);
     }
 
-    std::shared_ptr<const Mp4BoxData> getData(uint64_t dataIdx) override
+    std::shared_ptr<const Mp4BoxData> getData(uint64_t dataIdx) const
     {
         switch (dataIdx)
         {
@@ -290,11 +310,11 @@ struct stssItem : public BasicSampleItem
         }
     }
 
-    void setColumnsName(std::shared_ptr<Mp4BoxData> src) override { src->setColumnsName("Sample Number"); }
+    void setColumnsName(std::shared_ptr<Mp4BoxData> src) const { src->setColumnsName("Sample Number"); }
 };
-struct SyncSampleBox : public SampleTableBox
+struct SyncSampleBox : public EntryTableBox<stssItem>
 {
-    SyncSampleBox() : SampleTableBox("stss") {}
+    SyncSampleBox() : EntryTableBox("stss") {}
 
     int parse(BinaryFileReader &reader, uint64_t boxPosition, uint64_t boxSize, uint64_t boxBodySize) override;
 
@@ -302,14 +322,14 @@ struct SyncSampleBox : public SampleTableBox
 };
 using SyncSampleBoxPtr = std::shared_ptr<SyncSampleBox>;
 
-struct sdtpItem : public BasicSampleItem
+struct sdtpItem
 {
     uint8_t isLeading           = 0; // 2 bits
     uint8_t sampleDependsOn     = 0; // 2 bits
     uint8_t sampleDependedOn    = 0; // 2 bits
     uint8_t sampleHasRedundancy = 0; // 2 bits
 
-    std::shared_ptr<const Mp4BoxData> getData() override
+    std::shared_ptr<const Mp4BoxData> getData() const
     {
         auto res = Mp4BoxData::createArrayData();
         res->arrayAddItem(isLeading)
@@ -319,7 +339,7 @@ struct sdtpItem : public BasicSampleItem
         return res;
     }
 
-    std::shared_ptr<const Mp4BoxData> getData(uint64_t dataIdx) override
+    std::shared_ptr<const Mp4BoxData> getData(uint64_t dataIdx) const
     {
         switch (dataIdx)
         {
@@ -335,14 +355,14 @@ struct sdtpItem : public BasicSampleItem
                 return nullptr;
         }
     }
-    void setColumnsName(std::shared_ptr<Mp4BoxData> src) override
+    void setColumnsName(std::shared_ptr<Mp4BoxData> src) const
     {
         src->setColumnsName("Is Leading", "Sample Depends On", "Sample Depended On", "Sample has Redundancy");
     }
 };
-struct SampleDependencyTypeBox : public SampleTableBox
+struct SampleDependencyTypeBox : public EntryTableBox<sdtpItem>
 {
-    SampleDependencyTypeBox() : SampleTableBox("sdtp") {}
+    SampleDependencyTypeBox() : EntryTableBox("sdtp") {}
 
     int parse(BinaryFileReader &reader, uint64_t boxPosition, uint64_t boxSize, uint64_t boxBodySize) override;
 
@@ -350,14 +370,14 @@ struct SampleDependencyTypeBox : public SampleTableBox
 };
 using SampleDependencyTypeBoxPtr = std::shared_ptr<SampleDependencyTypeBox>;
 
-struct sgpdEntry : public BasicSampleItem
+struct sgpdEntry
 {
     // if (version==1 && default_length==0)
     uint32_t descriptionLength = 0; // u32
 
     BinaryData description; // descriptionLength
 
-    std::shared_ptr<const Mp4BoxData> getData() override
+    std::shared_ptr<const Mp4BoxData> getData() const
     {
         auto res        = Mp4BoxData::createArrayData();
         auto binaryData = Mp4BoxData::createBinaryData();
@@ -385,7 +405,7 @@ struct sgpdEntry : public BasicSampleItem
             return res->arrayAddItem(descriptionLength)->arrayAddItem(binaryData);
         }
     }
-    std::shared_ptr<const Mp4BoxData> createDescriptionData()
+    std::shared_ptr<const Mp4BoxData> createDescriptionData() const
     {
         auto binaryData = Mp4BoxData::createBinaryData();
         binaryData->binarySetCallbacks(
@@ -404,7 +424,7 @@ struct sgpdEntry : public BasicSampleItem
             &description);
         return binaryData;
     }
-    std::shared_ptr<const Mp4BoxData> getData(uint64_t dataIdx) override
+    std::shared_ptr<const Mp4BoxData> getData(uint64_t dataIdx) const
     {
         if (0 == descriptionLength)
         {
@@ -430,7 +450,7 @@ struct sgpdEntry : public BasicSampleItem
         }
     }
 
-    void setColumnsName(std::shared_ptr<Mp4BoxData> src) override
+    void setColumnsName(std::shared_ptr<Mp4BoxData> src) const
     {
         if (descriptionLength > 0)
             src->setColumnsName("Description Length", "Description");
@@ -438,7 +458,7 @@ struct sgpdEntry : public BasicSampleItem
             src->setColumnsName("Description");
     }
 };
-struct SampleGroupDescriptionBox : public SampleTableBox
+struct SampleGroupDescriptionBox : public EntryTableBox<sgpdEntry>
 {
     uint32_t groupingType = 0; // u32
 
@@ -448,26 +468,26 @@ struct SampleGroupDescriptionBox : public SampleTableBox
     // if (version >= 2)
     uint32_t defaultSampleDescIdx = 0; //  u32
 
-    SampleGroupDescriptionBox() : SampleTableBox("sgpd") {}
+    SampleGroupDescriptionBox() : EntryTableBox("sgpd") {}
     int parse(BinaryFileReader &reader, uint64_t boxPosition, uint64_t boxSize, uint64_t boxBodySize) override;
 
     std::shared_ptr<Mp4BoxData> getData(std::shared_ptr<Mp4BoxData> src = nullptr) const override;
 };
 using SampleGroupDescriptionBoxPtr = std::shared_ptr<SampleGroupDescriptionBox>;
 
-struct sbgpItem : public BasicSampleItem
+struct sbgpItem
 {
     uint32_t sampleCount           = 0; // u32
     uint32_t groupDescriptionIndex = 0; // u32
 
-    std::shared_ptr<const Mp4BoxData> getData() override
+    std::shared_ptr<const Mp4BoxData> getData() const
     {
         auto res = Mp4BoxData::createArrayData();
         res->arrayAddItem(sampleCount)->arrayAddItem(groupDescriptionIndex);
         return res;
     }
 
-    std::shared_ptr<const Mp4BoxData> getData(uint64_t dataIdx) override
+    std::shared_ptr<const Mp4BoxData> getData(uint64_t dataIdx) const
     {
         switch (dataIdx)
         {
@@ -480,18 +500,18 @@ struct sbgpItem : public BasicSampleItem
         }
     }
 
-    void setColumnsName(std::shared_ptr<Mp4BoxData> src) override
+    void setColumnsName(std::shared_ptr<Mp4BoxData> src) const
     {
         src->setColumnsName("Sample Count", "Group Description Index");
     }
 };
-struct SampleToGroupBox : public SampleTableBox
+struct SampleToGroupBox : public EntryTableBox<sbgpItem>
 {
     uint32_t groupingType    = 0; // u32
     // if (version == 1)
     uint32_t groupingTypePar = 0; // u32
 
-    SampleToGroupBox() : SampleTableBox("sbgp") {}
+    SampleToGroupBox() : EntryTableBox("sbgp") {}
 
     int parse(BinaryFileReader &reader, uint64_t boxPosition, uint64_t boxSize, uint64_t boxBodySize) override;
 
@@ -499,14 +519,14 @@ struct SampleToGroupBox : public SampleTableBox
 };
 using SampleToGroupBoxPtr = std::shared_ptr<SampleToGroupBox>;
 
-struct elstItem : public BasicSampleItem
+struct elstItem
 {
     uint64_t segmentDuration   = 0; // u64/u32
     int64_t  mediaTime         = 0; // s64/s32
     int16_t  mediaRateInteger  = 0; // s16
     int16_t  mediaRateFraction = 0; // s16
 
-    std::shared_ptr<const Mp4BoxData> getData() override
+    std::shared_ptr<const Mp4BoxData> getData() const
     {
         auto res = Mp4BoxData::createArrayData();
         res->arrayAddItem(segmentDuration)
@@ -516,7 +536,7 @@ struct elstItem : public BasicSampleItem
         return res;
     }
 
-    std::shared_ptr<const Mp4BoxData> getData(uint64_t dataIdx) override
+    std::shared_ptr<const Mp4BoxData> getData(uint64_t dataIdx) const
     {
         switch (dataIdx)
         {
@@ -533,14 +553,14 @@ struct elstItem : public BasicSampleItem
         }
     }
 
-    void setColumnsName(std::shared_ptr<Mp4BoxData> src) override
+    void setColumnsName(std::shared_ptr<Mp4BoxData> src) const
     {
         src->setColumnsName("Segment Duration", "Media Time", "Media Rate Integer", "Media Rate Fraction");
     }
 };
-struct EditListBox : public SampleTableBox
+struct EditListBox : public EntryTableBox<elstItem>
 {
-    EditListBox() : SampleTableBox("elst") {}
+    EditListBox() : EntryTableBox("elst") {}
 
     int parse(BinaryFileReader &reader, uint64_t boxPosition, uint64_t boxSize, uint64_t boxBodySize) override;
 
@@ -548,7 +568,7 @@ struct EditListBox : public SampleTableBox
 };
 using EditListBoxPtr = std::shared_ptr<EditListBox>;
 
-struct trunItem : public BasicSampleItem
+struct trunItem
 {
     uint32_t boxFlags     = 0;
     // if (mFullboxFlags & MP4_TRUN_FLAG_SAMPLE_DURATION_PRESENT)
@@ -560,7 +580,7 @@ struct trunItem : public BasicSampleItem
     // if (mFullboxFlags & MP4_TRUN_FLAG_SAMPLE_COMPOSITION_TIME_OFFSETS_PRESENT)
     uint32_t composOffset = 0;
 
-    std::shared_ptr<const Mp4BoxData> getData() override
+    std::shared_ptr<const Mp4BoxData> getData() const
     {
         auto res = Mp4BoxData::createArrayData();
         if (boxFlags & MP4_TRUN_FLAG_SAMPLE_DURATION_PRESENT)
@@ -573,7 +593,7 @@ struct trunItem : public BasicSampleItem
             res->arrayAddItem(composOffset);
         return res;
     }
-    std::shared_ptr<const Mp4BoxData> getData(uint64_t dataIdx) override
+    std::shared_ptr<const Mp4BoxData> getData(uint64_t dataIdx) const
     {
         int idx = -1;
         if (boxFlags & MP4_TRUN_FLAG_SAMPLE_DURATION_PRESENT)
@@ -606,7 +626,7 @@ struct trunItem : public BasicSampleItem
         return nullptr;
     }
 
-    void setColumnsName(std::shared_ptr<Mp4BoxData> src) override
+    void setColumnsName(std::shared_ptr<Mp4BoxData> src) const
     {
         if (boxFlags & MP4_TRUN_FLAG_SAMPLE_DURATION_PRESENT)
             src->tableAddColumn("Duration");
@@ -618,14 +638,14 @@ struct trunItem : public BasicSampleItem
             src->tableAddColumn("Sample Composition Time Offset");
     }
 };
-struct TrackRunBox : public SampleTableBox
+struct TrackRunBox : public EntryTableBox<trunItem>
 {
     // if (mFullboxFlags & MP4_TRUN_FLAG_DATA_OFFSET_PRESENT)
     int32_t  dataOffset       = 0;
     // if (mFullboxFlags & MP4_TRUN_FLAG_FIRST_SAMPLE_FLAGS_PRESENT)
     uint32_t firstSampleFlags = 0;
 
-    TrackRunBox() : SampleTableBox("trun") {}
+    TrackRunBox() : EntryTableBox("trun") {}
 
     int parse(BinaryFileReader &reader, uint64_t boxPosition, uint64_t boxSize, uint64_t boxBodySize) override;
 
@@ -633,7 +653,7 @@ struct TrackRunBox : public SampleTableBox
 };
 using TrackRunBoxPtr = std::shared_ptr<TrackRunBox>;
 
-struct tfraItem : public BasicSampleItem
+struct tfraItem
 {
     uint64_t time         = 0; // u64/u32
     uint64_t moofOffset   = 0; // u64/u32
@@ -641,7 +661,7 @@ struct tfraItem : public BasicSampleItem
     uint64_t trunNum      = 0; // lenSzTrunNum
     uint64_t sampleNumber = 0; // lenSzSampleNum
 
-    std::shared_ptr<const Mp4BoxData> getData() override
+    std::shared_ptr<const Mp4BoxData> getData() const
     {
         auto res = Mp4BoxData::createArrayData();
         res->arrayAddItem(time)
@@ -651,7 +671,7 @@ struct tfraItem : public BasicSampleItem
             ->arrayAddItem(sampleNumber);
         return res;
     }
-    std::shared_ptr<const Mp4BoxData> getData(uint64_t dataIdx) override
+    std::shared_ptr<const Mp4BoxData> getData(uint64_t dataIdx) const
     {
         switch (dataIdx)
         {
@@ -670,19 +690,19 @@ struct tfraItem : public BasicSampleItem
         }
     }
 
-    void setColumnsName(std::shared_ptr<Mp4BoxData> src) override
+    void setColumnsName(std::shared_ptr<Mp4BoxData> src) const
     {
         src->setColumnsName("Time", "Moof Offset", "Traf Number", "Trun Number", "Sample Number");
     }
 };
-struct TrackFragmentRandomAccessBox : public SampleTableBox
+struct TrackFragmentRandomAccessBox : public EntryTableBox<tfraItem>
 {
     uint32_t trackId        = 0; // u32
     uint8_t  lenSzTrafNum   = 0; // 2 bits
     uint8_t  lenSzTrunNum   = 0; // 2 bits
     uint8_t  lenSzSampleNum = 0; // 2 bits
 
-    TrackFragmentRandomAccessBox() : SampleTableBox("tfra") {}
+    TrackFragmentRandomAccessBox() : EntryTableBox("tfra") {}
 
     int parse(BinaryFileReader &reader, uint64_t boxPosition, uint64_t boxSize, uint64_t boxBodySize) override;
 
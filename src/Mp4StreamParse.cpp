@@ -0,0 +1,375 @@
+#include <algorithm>
+#include <deque>
+#include <string.h>
+
+#include "Mp4Parse.h"
+#include "Mp4ParseInternal.h"
+
+using std::string;
+using std::vector;
+
+static uint64_t readBigEndian(const uint8_t *data, uint32_t bytes)
+{
+    uint64_t val = 0;
+    for (uint32_t i = 0; i < bytes; ++i)
+        val = (val << 8) | data[i];
+    return val;
+}
+
+class Mp4StreamParserImpl : public Mp4StreamParser
+{
+public:
+    explicit Mp4StreamParserImpl(uint64_t maxBufferSize)
+        : mMaxBufferSize(maxBufferSize), mParser(std::make_shared<MP4ParserImpl>())
+    {
+    }
+
+    void setBoxCallback(BoxCallback callback) override { mBoxCallback = callback; }
+    void setSampleCallback(SampleCallback callback) override { mSampleCallback = callback; }
+
+    int push(const uint8_t *data, uint64_t len) override;
+
+    MP4_TYPE_E                       getMp4Type() const override { return mParser->mMp4Type; }
+    const std::vector<TrackInfoPtr> &getTracksInfo() const override { return mParser->tracksInfo; }
+    uint64_t                         getStreamPos() const override { return mBufferPos + getBufferedSize(); }
+    uint64_t                         getBufferedSize() const override { return mBuffer.size() - mBufferStart; }
+    std::string                      getErrorMessage() override { return mParser->getErrorMessage(); }
+
+private:
+    int  processBuffer();
+    int  parseBufferedBox(uint64_t boxSize);
+    int  onMoov();
+    int  onMoof(CommonBoxPtr moof);
+    int  emitSamples();
+    void pushError(const std::string &err) { mParser->pushError(err); }
+
+    // the buffered byte at stream offset pos, from mBufferPos to getStreamPos()
+    const uint8_t *bufferAt(uint64_t pos) const { return mBuffer.data() + mBufferStart + (pos - mBufferPos); }
+
+private:
+    struct PendingSample
+    {
+        uint32_t      trackIdx = 0;
+        Mp4SampleItem item;
+    };
+
+    uint64_t       mMaxBufferSize;
+    BoxCallback    mBoxCallback;
+    SampleCallback mSampleCallback;
+    bool           mBroken = false;
+
+    // boxes are parsed by a file parser reading from memory, it keeps ftyp/moov and the tracks
+    std::shared_ptr<MP4ParserImpl> mParser;
+
+    std::vector<uint8_t> mBuffer;
+    uint64_t             mBufferStart = 0; // bytes of mBuffer already passed, dropped once they outweigh the rest
+    uint64_t             mBufferPos   = 0; // stream offset of mBuffer[mBufferStart]
+    uint64_t             mBoxPos      = 0; // stream offset of the next top-level box
+
+    std::deque<PendingSample>       mPendingSamples; // by sample offset
+    std::vector<uint64_t>           mTimescales;     // by track index
+    std::vector<uint64_t>           mNextSampleIdx;
+    std::vector<TrackExtendsBoxPtr> mTrackTrex;
+};
+
+Mp4StreamParserHandle createMp4StreamParser(uint64_t maxBufferSize)
+{
+    return std::make_shared<Mp4StreamParserImpl>(maxBufferSize);
+}
+
+int Mp4StreamParserImpl::push(const uint8_t *data, uint64_t len)
+{
+    if (mBroken)
+        return -1;
+    if (nullptr == data && len > 0)
+        return -1;
+
+    // inside mdat and before the next sample nothing waits for the bytes, don't copy them
+    if (0 == getBufferedSize())
+    {
+        uint64_t skipEnd = mBoxPos;
+        if (!mPendingSamples.empty())
+            skipEnd = MIN(skipEnd, mPendingSamples.front().item.sampleOffset);
+        if (skipEnd > mBufferPos)
+        {
+            uint64_t skipSize = MIN(len, skipEnd - mBufferPos);
+            data += skipSize;
+            len -= skipSize;
+            mBufferPos += skipSize;
+        }
+    }
+    mBuffer.insert(mBuffer.end(), data, data + len);
+
+    int ret = processBuffer();
+    if (ret < 0)
+        mBroken = true;
+    return ret;
+}
+
+int Mp4StreamParserImpl::processBuffer()
+{
+    while (true)
+    {
+        CHECK_RET(emitSamples());
+
+        uint64_t bufferEnd = getStreamPos();
+        if (mBoxPos >= bufferEnd)
+            break;
+
+        const uint8_t *header     = bufferAt(mBoxPos);
+        uint64_t       available  = bufferEnd - mBoxPos;
+        uint64_t       headerSize = 8;
+        if (available < headerSize)
+            break;
+
+        uint64_t boxSize = readBigEndian(header, 4);
+        uint32_t boxType = (uint32_t)readBigEndian(header + 4, 4);
+        if (1 == boxSize)
+        {
+            headerSize = 16;
+            if (available < headerSize)
+                break;
+            boxSize = readBigEndian(header + 8, 8);
+        }
+        else if (0 == boxSize)
+        {
+            if (MP4_BOX_MAKE_TYPE("mdat") != boxType)
+            {
+                MP4_PARSE_ERR("%s at %#" PRIx64 " extends to the end of stream\n", boxType2Str(boxType).c_str(), mBoxPos);
+                return -1;
+            }
+            boxSize = UINT64_MAX - mBoxPos;
+        }
+        if (boxSize < headerSize)
+        {
+            MP4_PARSE_ERR("box size err %" PRIu64 " at %#" PRIx64 "\n", boxSize, mBoxPos);
+            return -1;
+        }
+
+        // the body isn't needed, only the samples inside it
+        if (MP4_BOX_MAKE_TYPE("mdat") == boxType || MP4_BOX_MAKE_TYPE("free") == boxType
+            || MP4_BOX_MAKE_TYPE("skip") == boxType)
+        {
+            mBoxPos += boxSize;
+            continue;
+        }
+
+        if (boxSize > mMaxBufferSize)
+        {
+            MP4_PARSE_ERR("%s at %#" PRIx64 " too big %" PRIu64 " > %" PRIu64 "\n", boxType2Str(boxType).c_str(), mBoxPos,
+                          boxSize, mMaxBufferSize);
+            return -1;
+        }
+        if (available < boxSize)
+            break;
+
+        CHECK_RET(parseBufferedBox(boxSize));
+        mBoxPos += boxSize;
+    }
+
+    // keep from the box not complete yet, or the first sample still waiting for its bytes
+    uint64_t keepPos = MIN(mBoxPos, getStreamPos());
+    if (!mPendingSamples.empty())
+        keepPos = MIN(keepPos, mPendingSamples.front().item.sampleOffset);
+    if (keepPos > mBufferPos)
+    {
+        mBufferStart += keepPos - mBufferPos;
+        mBufferPos = keepPos;
+    }
+    // the bytes kept are moved to the front only once the passed ones outweigh them, not on every push
+    if (mBufferStart > 0 && mBufferStart >= getBufferedSize())
+    {
+        mBuffer.erase(mBuffer.begin(), mBuffer.begin() + mBufferStart);
+        mBufferStart = 0;
+    }
+
+    return 0;
+}
+
+int Mp4StreamParserImpl::parseBufferedBox(uint64_t boxSize)
+{
+    BinaryFileReader &reader = mParser->mFileReader;
+    CHECK_RET(reader.openMemory(bufferAt(mBoxPos), boxSize, mBoxPos));
+
+    bool         parseErr = false;
+    CommonBoxPtr box      = mParser->parseBox(reader, nullptr, parseErr);
+    reader.close();
+    if (nullptr == box)
+    {
+        MP4_PARSE_ERR("parse box at %#" PRIx64 " fail\n", mBoxPos);
+        return -1;
+    }
+    if (parseErr)
+        MP4_WARN("%s at %#" PRIx64 " not parsed completely\n", box->getBoxTypeStr().c_str(), mBoxPos);
+
+    if (mBoxCallback)
+        mBoxCallback(box);
+
+    switch (box->getBoxType())
+    {
+        case MP4_BOX_MAKE_TYPE("ftyp"):
+            mParser->mContainBoxes.push_back(box);
+            break;
+        case MP4_BOX_MAKE_TYPE("moov"):
+            mParser->mContainBoxes.push_back(box);
+            CHECK_RET(onMoov());
+            break;
+        case MP4_BOX_MAKE_TYPE("moof"):
+            CHECK_RET(onMoof(box));
+            break;
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+int Mp4StreamParserImpl::onMoov()
+{
+    if (!mParser->tracksInfo.empty())
+    {
+        MP4_PARSE_ERR("more than one moov\n");
+        return -1;
+    }
+    CHECK_RET(mParser->generateTracks());
+
+    vector<TrackInfoPtr> &tracks    = mParser->tracksInfo;
+    vector<CommonBoxPtr>  trakBoxes = mParser->getSubBox("moov")->getSubBoxes("trak");
+
+    mNextSampleIdx.assign(tracks.size(), 0);
+    mTimescales.assign(tracks.size(), 0);
+    for (size_t trackIdx = 0; trackIdx < tracks.size() && trackIdx < trakBoxes.size(); ++trackIdx)
+    {
+        MediaHeaderBoxPtr mdhd = trakBoxes[trackIdx]->getSubBoxRecursive<MediaHeaderBox>("mdhd", 2);
+        if (mdhd != nullptr)
+            mTimescales[trackIdx] = mdhd->timescale;
+    }
+
+    if (MP4_TYPE_FRAGMENT == mParser->mMp4Type)
+    {
+        mParser->mFragmentNextDts.assign(tracks.size(), 0);
+        return mParser->getTrackTrex(mTrackTrex);
+    }
+
+    // the whole sample table is known, the samples come in file order
+    vector<PendingSample> samples;
+    uint64_t              passedCount = 0;
+    for (uint32_t trackIdx = 0; trackIdx < tracks.size(); ++trackIdx)
+    {
+        if (nullptr == tracks[trackIdx]->mediaInfo)
+            continue;
+        const Mp4SampleIndex &sampleList = tracks[trackIdx]->mediaInfo->samplesInfo;
+        for (size_t sampleIdx = 0; sampleIdx < sampleList.size(); ++sampleIdx)
+        {
+            if (sampleList.getSampleOffset(sampleIdx) < mBufferPos)
+            {
+                passedCount++;
+                continue;
+            }
+            PendingSample pending;
+            pending.trackIdx = trackIdx;
+            sampleList.getItem(sampleIdx, pending.item, false);
+            samples.push_back(pending);
+        }
+    }
+    if (passedCount > 0)
+        MP4_WARN("moov after its mdat, %" PRIu64 " samples already passed\n", passedCount);
+
+    std::stable_sort(samples.begin(), samples.end(), [](const PendingSample &a, const PendingSample &b) {
+        return a.item.sampleOffset < b.item.sampleOffset;
+    });
+    mPendingSamples.insert(mPendingSamples.end(), samples.begin(), samples.end());
+
+    return 0;
+}
+
+int Mp4StreamParserImpl::onMoof(CommonBoxPtr moof)
+{
+    if (MP4_TYPE_FRAGMENT != mParser->mMp4Type)
+    {
+        MP4_PARSE_ERR("moof before moov\n");
+        return -1;
+    }
+
+    vector<TrackInfoPtr>        &tracks = mParser->tracksInfo;
+    vector<CommonBoxPtr>         moofBoxes(1, moof);
+    vector<FragmentRangeSamples> trackRanges(tracks.size());
+    CHECK_RET(mParser->walkFragmentRange(moofBoxes, 0, 1, mTrackTrex, trackRanges));
+
+    vector<PendingSample> samples;
+    for (uint32_t trackIdx = 0; trackIdx < tracks.size(); ++trackIdx)
+    {
+        FragmentRangeSamples &range = trackRanges[trackIdx];
+        if (range.ret < 0 || 0 == mTimescales[trackIdx])
+        {
+            MP4_WARN("track %u of moof at %#" PRIx64 " skipped\n", trackIdx, moof->getBoxPos());
+            continue;
+        }
+
+        uint64_t &curMediaDts = mParser->mFragmentNextDts[trackIdx];
+        size_t    baseDtsIdx  = 0;
+        for (uint64_t i = 0; i < range.samples.size(); ++i)
+        {
+            while (baseDtsIdx < range.baseDts.size() && range.baseDts[baseDtsIdx].first == i)
+                curMediaDts = range.baseDts[baseDtsIdx++].second;
+
+            FragmentSample &fragSample = range.samples[i];
+            PendingSample   pending;
+
+            pending.trackIdx          = trackIdx;
+            pending.item.sampleIdx    = (int64_t)mNextSampleIdx[trackIdx]++;
+            pending.item.sampleOffset = fragSample.offset;
+            pending.item.sampleSize   = fragSample.size;
+            pending.item.isKeyFrame   = fragSample.isKeyFrame;
+            MP4ParserImpl::fragmentSampleTimes(fragSample, curMediaDts, mTimescales[trackIdx], pending.item);
+            curMediaDts += fragSample.duration;
+
+            samples.push_back(pending);
+        }
+    }
+
+    // tracks are interleaved inside mdat
+    std::stable_sort(samples.begin(), samples.end(), [](const PendingSample &a, const PendingSample &b) {
+        return a.item.sampleOffset < b.item.sampleOffset;
+    });
+    bool ordered = mPendingSamples.empty() || samples.empty()
+                   || mPendingSamples.back().item.sampleOffset <= samples.front().item.sampleOffset;
+    mPendingSamples.insert(mPendingSamples.end(), samples.begin(), samples.end());
+    if (!ordered)
+    {
+        std::stable_sort(mPendingSamples.begin(), mPendingSamples.end(), [](const PendingSample &a, const PendingSample &b) {
+            return a.item.sampleOffset < b.item.sampleOffset;
+        });
+    }
+
+    return 0;
+}
+
+int Mp4StreamParserImpl::emitSamples()
+{
+    uint64_t bufferEnd = getStreamPos();
+    while (!mPendingSamples.empty())
+    {
+        PendingSample &pending = mPendingSamples.front();
+        if (pending.item.sampleOffset < mBufferPos)
+        {
+            MP4_WARN("track %u sample %" PRId64 " at %#" PRIx64 " already passed\n", pending.trackIdx, pending.item.sampleIdx,
+                     pending.item.sampleOffset);
+            mPendingSamples.pop_front();
+            continue;
+        }
+        if (pending.item.sampleSize > mMaxBufferSize)
+        {
+            MP4_PARSE_ERR("track %u sample %" PRId64 " too big %" PRIu64 " > %" PRIu64 "\n", pending.trackIdx,
+                          pending.item.sampleIdx, pending.item.sampleSize, mMaxBufferSize);
+            return -1;
+        }
+        if (pending.item.sampleOffset + pending.item.sampleSize > bufferEnd)
+            break;
+
+        if (mSampleCallback)
+            mSampleCallback(pending.trackIdx, pending.item, bufferAt(pending.item.sampleOffset));
+        mPendingSamples.pop_front();
+    }
+    return 0;
+}